@@ -36,6 +36,7 @@
 *
 * @section PageSampleAudioAudioOut_SectionHowToOperate  How to Use
 *  Run the sample program to play square waves.
+*  Pass <tt>signal sine</tt> or <tt>signal sweep</tt> on the command line to play sine waves or a logarithmic sweep instead.
 *  You can operate the program using input from a keyboard or from <tt>DebugPad</tt>.
 *
 *  <p>
@@ -53,7 +54,9 @@
 *  Build the sample program and then run it.
 *
 * @section PageSampleAudioAudioOut_SectionDetail  Description
-*  This sample program dynamically generates a square wave and outputs it to audio output.
+*  This sample program dynamically generates a test signal (square wave, sine wave or sweep) and outputs it to audio output.
+*  Every sample format is supported: the signal is generated in blocks of float values, then converted and interleaved by
+*  a function specialized at compile time for the sample type (vectorized for 16-bit, 32-bit and float output).
 *
 *  This sample program has the following flow.
 *
@@ -83,7 +86,7 @@
 *  Actual playback is not performed until <tt>nn::audio::StartAudioOut()</tt> is called.
 *
 *  After playback starts, information in the buffer that completed playback is obtained with <tt>nn::audio::GetReleasedAudioOutBuffer()</tt>
-*  and the dynamically generated square waveform data is copied to the playback buffer, and that data is registered again.
+*  and the dynamically generated test signal is copied to the playback buffer, and that data is registered again.
 *  If downmixing or sample rate conversion is required, it is performed at this time.
 *  Audio playback is realized by repeating these processes.
 *
@@ -97,7 +100,10 @@
 */
 
 #include <algorithm>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <limits>
 
 #include <nn/nn_Abort.h>
 #include <nn/nn_Assert.h>
@@ -123,6 +129,8 @@
 #endif // USE_NPAD
 #include <nn/settings/settings_DebugPad.h>
 
+#include "SwitchVoiceChatSimd.h"
+
 namespace
 {
 
@@ -211,113 +219,306 @@ const char* GetSampleFormatName(nn::audio::SampleFormat format)
 }
 
 //
-// The square waveform generating function that supports nn::audio::SampleFormat_PcmInt8. Not yet implemented.
+// The test signals. The square wave uses a different frequency on every channel, the sweep is the same on all of them.
+//
+enum SignalType
+{
+    SignalType_Square,
+    SignalType_Sine,
+    SignalType_Sweep
+};
+
+const int ChannelCountMax = 6;
+const int ToneBlockFrameCount = 256;                                   // Frames generated per block.
+const double ToneFrequencies[ChannelCountMax] = { 415, 698, 554, 104, 349, 277 };
+const double SweepStartFrequency = 20.0;
+const double SweepEndFrequency = 20000.0;
+const int SweepDurationSeconds = 5;                                    // Logarithmic sweep, restarted at the end.
+const double Pi = 3.14159265358979323846;
+
+//
+// This function returns the signal name.
 //
-void GenerateSquareWaveInt8(void* buffer, int channelCount, int sampleRate, int sampleCount, int amplitude)
+const char* GetSignalTypeName(SignalType signalType)
 {
-    NN_UNUSED(buffer);
-    NN_UNUSED(channelCount);
-    NN_UNUSED(sampleRate);
-    NN_UNUSED(sampleCount);
-    NN_UNUSED(amplitude);
-    NN_ABORT("Not implemented yet\n");
+    switch (signalType)
+    {
+        case SignalType_Square:
+            return "Square";
+        case SignalType_Sine:
+            return "Sine";
+        case SignalType_Sweep:
+            return "Sweep";
+        default:
+            NN_UNEXPECTED_DEFAULT;
+    }
 }
 
+SignalType g_SignalType = SignalType_Square;
+double g_TonePhases[ChannelCountMax] = { 0 };                          // Position in the period, from 0 to 1.
+int g_SweepSampleCount = 0;                                            // Samples since the start of the sweep.
+float g_ToneBlock[ChannelCountMax][ToneBlockFrameCount];               // One block of every channel, already scaled.
+
 //
-// The square waveform generating function that supports nn::audio::SampleFormat_PcmInt16.
+// This function generates one block of every channel into g_ToneBlock, with values from -scale to scale.
 //
-void GenerateSquareWaveInt16(void* buffer, int channelCount, int sampleRate, int sampleCount, int amplitude)
+void GenerateToneBlock(int channelCount, int sampleRate, int frameCount, float scale)
 {
-    static int s_TotalSampleCount[6] = { 0 };
-    const int frequencies[6] = { 415, 698, 554, 104, 349, 277 };
+    if (g_SignalType == SignalType_Sweep)
+    {
+        const int sweepLength = sampleRate * SweepDurationSeconds;
+        const double sweepRate = std::log(SweepEndFrequency / SweepStartFrequency) / sweepLength;
+        for (int frame = 0; frame < frameCount; ++frame)
+        {
+            double frequency = SweepStartFrequency * std::exp(sweepRate * g_SweepSampleCount);
+            g_ToneBlock[0][frame] = scale * static_cast<float>(std::sin(2 * Pi * g_TonePhases[0]));
+            g_TonePhases[0] += frequency / sampleRate;
+            g_TonePhases[0] -= std::floor(g_TonePhases[0]);
+            if (++g_SweepSampleCount == sweepLength)
+            {
+                g_SweepSampleCount = 0;
+            }
+        }
+        for (int ch = 1; ch < channelCount; ch++)
+        {
+            std::memcpy(g_ToneBlock[ch], g_ToneBlock[0], frameCount * sizeof(float));
+        }
+        return;
+    }
 
-    int16_t* buf = reinterpret_cast<int16_t*>(buffer);
     for (int ch = 0; ch < channelCount; ch++)
     {
-        int waveLength = sampleRate / frequencies[ch]; // Length of the waveform for one period (in sample count units).
-
-        for (int sample = 0; sample < sampleCount; sample++)
+        const double increment = ToneFrequencies[ch] / sampleRate;
+        double phase = g_TonePhases[ch];
+        float* block = g_ToneBlock[ch];
+        if (g_SignalType == SignalType_Square)
+        {
+            for (int frame = 0; frame < frameCount; ++frame)
+            {
+                block[frame] = phase < 0.5 ? scale : -scale;
+                phase += increment;
+                phase -= std::floor(phase);
+            }
+        }
+        else
         {
-            int16_t value = static_cast<int16_t>(s_TotalSampleCount[ch] < (waveLength / 2) ? amplitude : -amplitude);
-            buf[sample*channelCount + ch] = value;
-            s_TotalSampleCount[ch]++;
-            if (s_TotalSampleCount[ch] == waveLength)
+            for (int frame = 0; frame < frameCount; ++frame)
             {
-                s_TotalSampleCount[ch] = 0;
+                block[frame] = scale * static_cast<float>(std::sin(2 * Pi * phase));
+                phase += increment;
+                phase -= std::floor(phase);
             }
         }
+        g_TonePhases[ch] = phase;
     }
 }
 
 //
-// The square waveform generating function that supports nn::audio::SampleFormat_PcmInt24. Not yet implemented.
+// Packed 24-bit sample of nn::audio::SampleFormat_PcmInt24 (little endian).
 //
-void GenerateSquareWaveInt24(void* buffer, int channelCount, int sampleRate, int sampleCount, int amplitude)
+struct Int24
 {
-    NN_UNUSED(buffer);
-    NN_UNUSED(channelCount);
-    NN_UNUSED(sampleRate);
-    NN_UNUSED(sampleCount);
-    NN_UNUSED(amplitude);
-    NN_ABORT("Not implemented yet\n");
+    uint8_t bytes[3];
+};
+
+//
+// The full scale of every sample type. PcmInt32 stops at the largest float below 2^31, so the conversion never overflows.
+//
+template <typename T> struct SampleTraits;
+template <> struct SampleTraits<int8_t>  { static float Scale() { return 127.0f; } };
+template <> struct SampleTraits<int16_t> { static float Scale() { return 32767.0f; } };
+template <> struct SampleTraits<Int24>   { static float Scale() { return 8388607.0f; } };
+template <> struct SampleTraits<int32_t> { static float Scale() { return 2147483520.0f; } };
+template <> struct SampleTraits<float>   { static float Scale() { return 1.0f; } };
+
+template <typename T>
+void StoreSample(T* out, float value)
+{
+    *out = static_cast<T>(std::lrint(value));
+}
+
+template <>
+void StoreSample<Int24>(Int24* out, float value)
+{
+    int32_t sample = static_cast<int32_t>(std::lrint(value));
+    out->bytes[0] = static_cast<uint8_t>(sample);
+    out->bytes[1] = static_cast<uint8_t>(sample >> 8);
+    out->bytes[2] = static_cast<uint8_t>(sample >> 16);
+}
+
+template <>
+void StoreSample<float>(float* out, float value)
+{
+    *out = value;
 }
 
 //
-// The square waveform generating function that supports nn::audio::SampleFormat_PcmInt32. Not yet implemented.
+// This function interleaves the frames of g_ToneBlock into out.
 //
-void GenerateSquareWaveInt32(void* buffer, int channelCount, int sampleRate, int sampleCount, int amplitude)
+template <typename T>
+void InterleaveToneBlock(T* out, int channelCount, int frameCount)
 {
-    NN_UNUSED(buffer);
-    NN_UNUSED(channelCount);
-    NN_UNUSED(sampleRate);
-    NN_UNUSED(sampleCount);
-    NN_UNUSED(amplitude);
-    NN_ABORT("Not implemented yet\n");
+    for (int frame = 0; frame < frameCount; ++frame)
+    {
+        for (int ch = 0; ch < channelCount; ch++)
+        {
+            StoreSample(&out[frame * channelCount + ch], g_ToneBlock[ch][frame]);
+        }
+    }
 }
 
 //
-// The square waveform generating function that supports nn::audio::SampleFormat_PcmFloat. Not yet implemented.
+// The common formats are vectorized for mono and stereo output.
 //
-void GenerateSquareWaveFloat(void* buffer, int channelCount, int sampleRate, int sampleCount, int amplitude)
+template <>
+void InterleaveToneBlock<int16_t>(int16_t* out, int channelCount, int frameCount)
 {
-    NN_UNUSED(buffer);
-    NN_UNUSED(channelCount);
-    NN_UNUSED(sampleRate);
-    NN_UNUSED(sampleCount);
-    NN_UNUSED(amplitude);
-    NN_ABORT("Not implemented yet\n");
+    const float* planes[ChannelCountMax];
+    for (int ch = 0; ch < channelCount; ch++)
+    {
+        planes[ch] = g_ToneBlock[ch];
+    }
+    SwitchVoiceChatSimd::InterleaveSaturateToInt16(out, planes, channelCount, frameCount);
+}
+
+template <>
+void InterleaveToneBlock<int32_t>(int32_t* out, int channelCount, int frameCount)
+{
+    int frame = 0;
+#if defined(WNTGD_SIMD_NEON)
+    if (channelCount == 2)
+    {
+        for (; frame + 4 <= frameCount; frame += 4)
+        {
+            int32x4x2_t samples;
+            samples.val[0] = vcvtnq_s32_f32(vld1q_f32(g_ToneBlock[0] + frame));
+            samples.val[1] = vcvtnq_s32_f32(vld1q_f32(g_ToneBlock[1] + frame));
+            vst2q_s32(out + frame * 2, samples);
+        }
+    }
+    else if (channelCount == 1)
+    {
+        for (; frame + 4 <= frameCount; frame += 4)
+        {
+            vst1q_s32(out + frame, vcvtnq_s32_f32(vld1q_f32(g_ToneBlock[0] + frame)));
+        }
+    }
+#elif defined(WNTGD_SIMD_AVX2) || defined(WNTGD_SIMD_SSE2)
+    if (channelCount == 2)
+    {
+        for (; frame + 4 <= frameCount; frame += 4)
+        {
+            __m128i left = _mm_cvtps_epi32(_mm_loadu_ps(g_ToneBlock[0] + frame));
+            __m128i right = _mm_cvtps_epi32(_mm_loadu_ps(g_ToneBlock[1] + frame));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + frame * 2), _mm_unpacklo_epi32(left, right));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + frame * 2 + 4), _mm_unpackhi_epi32(left, right));
+        }
+    }
+    else if (channelCount == 1)
+    {
+        for (; frame + 4 <= frameCount; frame += 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + frame), _mm_cvtps_epi32(_mm_loadu_ps(g_ToneBlock[0] + frame)));
+        }
+    }
+#endif
+    for (; frame < frameCount; ++frame)
+    {
+        for (int ch = 0; ch < channelCount; ch++)
+        {
+            StoreSample(&out[frame * channelCount + ch], g_ToneBlock[ch][frame]);
+        }
+    }
+}
+
+template <>
+void InterleaveToneBlock<float>(float* out, int channelCount, int frameCount)
+{
+    int frame = 0;
+    if (channelCount == 1)
+    {
+        std::memcpy(out, g_ToneBlock[0], frameCount * sizeof(float));
+        return;
+    }
+#if defined(WNTGD_SIMD_NEON)
+    if (channelCount == 2)
+    {
+        for (; frame + 4 <= frameCount; frame += 4)
+        {
+            float32x4x2_t samples;
+            samples.val[0] = vld1q_f32(g_ToneBlock[0] + frame);
+            samples.val[1] = vld1q_f32(g_ToneBlock[1] + frame);
+            vst2q_f32(out + frame * 2, samples);
+        }
+    }
+#elif defined(WNTGD_SIMD_AVX2) || defined(WNTGD_SIMD_SSE2)
+    if (channelCount == 2)
+    {
+        for (; frame + 4 <= frameCount; frame += 4)
+        {
+            __m128 left = _mm_loadu_ps(g_ToneBlock[0] + frame);
+            __m128 right = _mm_loadu_ps(g_ToneBlock[1] + frame);
+            _mm_storeu_ps(out + frame * 2, _mm_unpacklo_ps(left, right));
+            _mm_storeu_ps(out + frame * 2 + 4, _mm_unpackhi_ps(left, right));
+        }
+    }
+#endif
+    for (; frame < frameCount; ++frame)
+    {
+        for (int ch = 0; ch < channelCount; ch++)
+        {
+            StoreSample(&out[frame * channelCount + ch], g_ToneBlock[ch][frame]);
+        }
+    }
 }
 
 //
-// Returns the square waveform generating function supported by the sample format.
+// The waveform generating function, specialized for every sample type. The amplitude is given in the 16-bit scale.
 //
-typedef void (*GenerateSquareWaveFunction)(void* buffer, int channelCount, int sampleRate, int sampleCount, int amplitude);
-GenerateSquareWaveFunction GetGenerateSquareWaveFunction(nn::audio::SampleFormat format)
+template <typename T>
+void GenerateTone(void* buffer, int channelCount, int sampleRate, int sampleCount, int amplitude)
+{
+    NN_ASSERT(channelCount <= ChannelCountMax);
+    T* out = reinterpret_cast<T*>(buffer);
+    const float scale = SampleTraits<T>::Scale() * amplitude / std::numeric_limits<int16_t>::max();
+    for (int offset = 0; offset < sampleCount; offset += ToneBlockFrameCount)
+    {
+        const int frameCount = std::min(ToneBlockFrameCount, sampleCount - offset);
+        GenerateToneBlock(channelCount, sampleRate, frameCount, scale);
+        InterleaveToneBlock<T>(out + offset * channelCount, channelCount, frameCount);
+    }
+}
+
+//
+// Returns the waveform generating function supported by the sample format.
+//
+typedef void (*GenerateToneFunction)(void* buffer, int channelCount, int sampleRate, int sampleCount, int amplitude);
+GenerateToneFunction GetGenerateToneFunction(nn::audio::SampleFormat format)
 {
     switch (format)
     {
         case nn::audio::SampleFormat_PcmInt8:
-            return GenerateSquareWaveInt8;
+            return GenerateTone<int8_t>;
         case nn::audio::SampleFormat_PcmInt16:
-            return GenerateSquareWaveInt16;
+            return GenerateTone<int16_t>;
         case nn::audio::SampleFormat_PcmInt24:
-            return GenerateSquareWaveInt24;
+            return GenerateTone<Int24>;
         case nn::audio::SampleFormat_PcmInt32:
-            return GenerateSquareWaveInt32;
+            return GenerateTone<int32_t>;
         case nn::audio::SampleFormat_PcmFloat:
-            return GenerateSquareWaveFloat;
+            return GenerateTone<float>;
         default:
             NN_UNEXPECTED_DEFAULT;
     }
 }
 
 //
-// Function to create a square waveform.
+// Function to create the test signal.
 //
-void GenerateSquareWave(nn::audio::SampleFormat format, void* buffer, int channelCount, int sampleRate, int sampleCount, int amplitude)
+void GenerateTone(nn::audio::SampleFormat format, void* buffer, int channelCount, int sampleRate, int sampleCount, int amplitude)
 {
     NN_ASSERT_NOT_NULL(buffer);
-    GenerateSquareWaveFunction func = GetGenerateSquareWaveFunction(format);
+    GenerateToneFunction func = GetGenerateToneFunction(format);
     if (func)
     {
         func(buffer, channelCount, sampleRate, sampleCount, amplitude);
@@ -357,6 +558,14 @@ extern "C" void nnMain()
             if(i < nn::os::GetHostArgc())
                 timeout = atoi(argvs[i + 1]);
         }
+        // signal square|sine|sweep selects the test signal (square by default).
+        if(strcmp("signal", argvs[i]) == 0 && i + 1 < nn::os::GetHostArgc())
+        {
+            if(strcmp("sine", argvs[i + 1]) == 0)
+                g_SignalType = SignalType_Sine;
+            else if(strcmp("sweep", argvs[i + 1]) == 0)
+                g_SignalType = SignalType_Sweep;
+        }
     }
 
     nn::TimeSpan endTime = nn::os::GetSystemTick().ToTimeSpan() + nn::TimeSpan::FromSeconds(timeout);
@@ -409,8 +618,7 @@ extern "C" void nnMain()
     NNS_LOG("  ChannelCount: %d\n", channelCount);
     NNS_LOG("  SampleRate: %d\n", sampleRate);
     NNS_LOG("  SampleFormat: %s\n", GetSampleFormatName(sampleFormat));
-    // This sample assumes that the sample format is 16-bit.
-    NN_ASSERT(sampleFormat == nn::audio::SampleFormat_PcmInt16);
+    NNS_LOG("  Signal: %s\n", GetSignalTypeName(g_SignalType));
 
     // Prepare parameters for the buffer.
     const int frameRate = 20;                             // 20 fps
@@ -426,7 +634,7 @@ extern "C" void nnMain()
     {
         outBuffer[i] = allocator.Allocate(bufferSize, nn::audio::AudioOutBuffer::AddressAlignment);
         NN_ASSERT(outBuffer[i]);
-        GenerateSquareWave(sampleFormat, outBuffer[i], channelCount, sampleRate, frameSampleCount, amplitude);
+        GenerateTone(sampleFormat, outBuffer[i], channelCount, sampleRate, frameSampleCount, amplitude);
         nn::audio::SetAudioOutBufferInfo(&audioOutBuffer[i], outBuffer[i], bufferSize, dataSize);
         nn::audio::AppendAudioOutBuffer(&audioOut, &audioOutBuffer[i]);
     }
@@ -527,10 +735,10 @@ extern "C" void nnMain()
         pAudioOutBuffer = nn::audio::GetReleasedAudioOutBuffer(&audioOut);
         while (pAudioOutBuffer)
         {
-            // Create square waveform data and register it again.
+            // Create the test signal and register it again.
             void* pOutBuffer = nn::audio::GetAudioOutBufferDataPointer(pAudioOutBuffer);
             NN_ASSERT(nn::audio::GetAudioOutBufferDataSize(pAudioOutBuffer) == frameSampleCount * channelCount * nn::audio::GetSampleByteSize(sampleFormat));
-            GenerateSquareWave(sampleFormat, pOutBuffer, channelCount, sampleRate, frameSampleCount, amplitude);
+            GenerateTone(sampleFormat, pOutBuffer, channelCount, sampleRate, frameSampleCount, amplitude);
             nn::audio::AppendAudioOutBuffer(&audioOut, pAudioOutBuffer);
 
             pAudioOutBuffer = nn::audio::GetReleasedAudioOutBuffer(&audioOut);
@@ -0,0 +1,247 @@
+#include "SwitchVoiceChatBatchDecodeNativeCode.h"
+
+namespace SwitchVoiceChatBatchDecodeNativeCode {
+	using namespace SwitchVoiceChatDecodeNativeCode;
+	using namespace SwitchVoiceChatMemoryNativeCode;
+
+	// worker threads, waiting for batchStartEvents between two batches
+	nn::os::ThreadType batchThreads[BATCH_DECODE_THREAD_COUNT_MAX];
+	nn::os::EventType batchStartEvents[BATCH_DECODE_THREAD_COUNT_MAX];
+	nn::os::EventType batchDoneEvent;
+	int batchThreadCount;
+	std::atomic<bool> isBatchDecoderRunning;
+	std::atomic<int> pendingBatchThreadCount; // workers still running the current batch
+
+	// the batch being decoded, only one at a time
+	nn::os::Mutex batchMutex(false);
+	VoiceBatchItem* batchItems;
+	int batchNextItems[BATCH_DECODE_CHUNK_ITEM_COUNT]; // next item of the same speaker, -1 at the end
+	BatchTask batchTasks[BATCH_DECODE_CHUNK_ITEM_COUNT];
+	int batchTaskCount;
+	int batchTaskOfDecoder[MAX_DECODER_COUNT]; // -1 if the decoder has no task yet
+	BatchTaskRange batchTaskRanges[BATCH_DECODE_THREAD_COUNT_MAX + 1]; // one per participant, the calling thread is 0
+	int batchParticipantCount;
+	void* batchAudioOut;
+	DecodeOutputFormat batchFormat;
+	int batchAudioOutCapacity;
+	std::atomic<int> batchAudioOutUsed;
+	std::atomic<int> batchDecodedCount;
+
+	size_t GetBatchDecodeMemorySize(const VoiceMemoryBudget& budget)
+	{
+		size_t size = 0;
+		int threadCount = budget.decodeThreadCount < BATCH_DECODE_THREAD_COUNT_MAX ? budget.decodeThreadCount : BATCH_DECODE_THREAD_COUNT_MAX;
+		for (int i = 0; i < threadCount; i++)
+		{
+			AddRegionAllocation(&size, BATCH_DECODE_THREAD_STACK_SIZE, nn::os::ThreadStackAlignment);
+		}
+		return size;
+	}
+
+	// Start the workers (called by wntgd_InitializeDecoder, their stacks come from the decoder region)
+	bool StartBatchDecodeThreads(VoiceArenaRegion* region, int threadCount)
+	{
+		if (threadCount > BATCH_DECODE_THREAD_COUNT_MAX) threadCount = BATCH_DECODE_THREAD_COUNT_MAX;
+		batchMutex.Lock();
+		nn::os::InitializeEvent(&batchDoneEvent, false, nn::os::EventClearMode_AutoClear);
+		isBatchDecoderRunning.store(true, std::memory_order_release);
+		batchThreadCount = 0;
+		for (int i = 0; i < threadCount; i++)
+		{
+			void* stack = AllocateFromRegion(region, BATCH_DECODE_THREAD_STACK_SIZE, nn::os::ThreadStackAlignment);
+			nn::os::InitializeEvent(&batchStartEvents[i], false, nn::os::EventClearMode_AutoClear);
+			if (!stack || !nn::os::CreateThread(&batchThreads[i], BatchDecodeThreadFunction, reinterpret_cast<void*>(static_cast<intptr_t>(i)),
+				stack, BATCH_DECODE_THREAD_STACK_SIZE, nn::os::DefaultThreadPriority).IsSuccess())
+			{
+				nn::os::FinalizeEvent(&batchStartEvents[i]);
+				batchMutex.Unlock();
+				StopBatchDecodeThreads();
+				return false;
+			}
+			nn::os::SetThreadName(&batchThreads[i], "wntgd_BatchDecode");
+			nn::os::StartThread(&batchThreads[i]);
+			batchThreadCount++;
+		}
+		batchMutex.Unlock();
+		return true;
+	}
+
+	// Called by wntgd_FinalizeDecoder, after the running batch if any
+	void StopBatchDecodeThreads()
+	{
+		batchMutex.Lock();
+		if (!isBatchDecoderRunning.exchange(false, std::memory_order_acq_rel))
+		{
+			batchMutex.Unlock();
+			return;
+		}
+		for (int i = 0; i < batchThreadCount; i++)
+		{
+			nn::os::SignalEvent(&batchStartEvents[i]);
+		}
+		for (int i = 0; i < batchThreadCount; i++)
+		{
+			nn::os::WaitThread(&batchThreads[i]);
+			nn::os::DestroyThread(&batchThreads[i]);
+			nn::os::FinalizeEvent(&batchStartEvents[i]);
+		}
+		batchThreadCount = 0;
+		nn::os::FinalizeEvent(&batchDoneEvent);
+		batchMutex.Unlock();
+	}
+
+	intptr_t GetBatchItemSpeakerHandle(const VoiceBatchItem& item)
+	{
+		return item.speakerHandle ? item.speakerHandle : GetDefaultDecoderHandle();
+	}
+
+	// Group the items by decoder, keeping their order (items of an unknown decoder are left undecoded)
+	void BuildBatchTasks(VoiceBatchItem* items, int itemCount)
+	{
+		for (int i = 0; i < MAX_DECODER_COUNT; i++)
+		{
+			batchTaskOfDecoder[i] = -1;
+		}
+		batchItems = items;
+		batchTaskCount = 0;
+		for (int i = 0; i < itemCount; i++)
+		{
+			items[i].outOffset = 0;
+			items[i].outSampleCount = 0;
+			batchNextItems[i] = -1;
+			intptr_t speakerHandle = GetBatchItemSpeakerHandle(items[i]);
+			int decoderIndex = GetDecoderIndex(speakerHandle);
+			if (decoderIndex < 0) continue;
+
+			int taskIndex = batchTaskOfDecoder[decoderIndex];
+			if (taskIndex < 0)
+			{
+				taskIndex = batchTaskCount++;
+				batchTaskOfDecoder[decoderIndex] = taskIndex;
+				batchTasks[taskIndex].speakerHandle = speakerHandle;
+				batchTasks[taskIndex].firstItem = i;
+			}
+			else
+			{
+				batchNextItems[batchTasks[taskIndex].lastItem] = i;
+			}
+			batchTasks[taskIndex].lastItem = i;
+		}
+	}
+
+	// Decode every item of one speaker (the decoder is acquired once, so no other thread touches it meanwhile).
+	// A decoder held by another call, e.g. the mixer pulling the speaker, is waited for.
+	void DecodeBatchTask(const BatchTask& task)
+	{
+		DecoderContext* context = WaitDecoderContext(task.speakerHandle);
+		if (!context) return; // stale handle
+
+		for (int i = task.firstItem; i >= 0; i = batchNextItems[i])
+		{
+			VoiceBatchItem* item = &batchItems[i];
+			if (GetBatchItemSpeakerHandle(*item) != task.speakerHandle) continue; // an older handle of the same decoder
+
+			int sampleCount = 0;
+			if (!DecodeSpeakerFrames(context, item->inputBuffer, item->count, nullptr, batchFormat, 0, false, &sampleCount)) continue;
+
+			// take the samples from the output arena, the packets that do not fit are not decoded
+			int offset = batchAudioOutUsed.load(std::memory_order_relaxed);
+			do
+			{
+				if (offset + sampleCount > batchAudioOutCapacity) break;
+			} while (!batchAudioOutUsed.compare_exchange_weak(offset, offset + sampleCount, std::memory_order_relaxed));
+			if (offset + sampleCount > batchAudioOutCapacity) continue;
+
+			void* audioOut = OffsetAudioOut(batchAudioOut, batchFormat, offset);
+			if (!DecodeSpeakerFrames(context, item->inputBuffer, item->count, audioOut, batchFormat, sampleCount, true, &sampleCount)) continue;
+			item->outOffset = offset;
+			item->outSampleCount = sampleCount;
+			batchDecodedCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		ReleaseDecoderContext(context);
+	}
+
+	// Take the tasks of the own range first, then steal from the others until every range is empty
+	void RunBatchTasks(int participant)
+	{
+		for (int i = 0; i < batchParticipantCount; i++)
+		{
+			BatchTaskRange* range = &batchTaskRanges[(participant + i) % batchParticipantCount];
+			for (int task = range->next.fetch_add(1, std::memory_order_relaxed); task < range->end; task = range->next.fetch_add(1, std::memory_order_relaxed))
+			{
+				DecodeBatchTask(batchTasks[task]);
+			}
+		}
+	}
+
+	void BatchDecodeThreadFunction(void* arg)
+	{
+		int thread = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+		for (;;)
+		{
+			nn::os::WaitEvent(&batchStartEvents[thread]);
+			if (!isBatchDecoderRunning.load(std::memory_order_acquire)) break;
+			RunBatchTasks(thread + 1);
+			if (pendingBatchThreadCount.fetch_sub(1, std::memory_order_acq_rel) == 1) nn::os::SignalEvent(&batchDoneEvent);
+		}
+	}
+
+	int DecompressBatch(VoiceBatchItem* items, int itemCount, void* audioOut, DecodeOutputFormat format, int audioOutCapacity)
+	{
+		if (!items || itemCount <= 0) return 0;
+
+		batchMutex.Lock();
+		if (!isBatchDecoderRunning.load(std::memory_order_relaxed))
+		{
+			batchMutex.Unlock();
+			return 0; // the decoder is not initialized
+		}
+		batchAudioOut = audioOut;
+		batchFormat = format;
+		batchAudioOutCapacity = audioOut ? audioOutCapacity : 0;
+		batchAudioOutUsed.store(0, std::memory_order_relaxed);
+		batchDecodedCount.store(0, std::memory_order_relaxed);
+		for (int start = 0; start < itemCount; start += BATCH_DECODE_CHUNK_ITEM_COUNT)
+		{
+			int chunkCount = itemCount - start < BATCH_DECODE_CHUNK_ITEM_COUNT ? itemCount - start : BATCH_DECODE_CHUNK_ITEM_COUNT;
+			BuildBatchTasks(items + start, chunkCount);
+
+			// no more threads than tasks, a worker that is not woken up costs nothing
+			batchParticipantCount = batchThreadCount + 1 < batchTaskCount ? batchThreadCount + 1 : batchTaskCount;
+			if (batchParticipantCount == 0) continue;
+			for (int i = 0; i < batchParticipantCount; i++)
+			{
+				batchTaskRanges[i].next.store(i * batchTaskCount / batchParticipantCount, std::memory_order_relaxed);
+				batchTaskRanges[i].end = (i + 1) * batchTaskCount / batchParticipantCount;
+			}
+
+			int workerCount = batchParticipantCount - 1;
+			pendingBatchThreadCount.store(workerCount, std::memory_order_relaxed);
+			nn::os::ClearEvent(&batchDoneEvent);
+			for (int i = 0; i < workerCount; i++)
+			{
+				nn::os::SignalEvent(&batchStartEvents[i]);
+			}
+			RunBatchTasks(0);
+			while (pendingBatchThreadCount.load(std::memory_order_acquire) > 0)
+			{
+				nn::os::WaitEvent(&batchDoneEvent);
+			}
+		}
+		int decodedCount = batchDecodedCount.load(std::memory_order_relaxed);
+		batchMutex.Unlock();
+		return decodedCount;
+	}
+
+	// Decode every packet of items into audioOut (audioOutCapacity samples, 48 kHz mono). Each item gets the position
+	// of its samples; the packets of a speaker are decoded in their order in items. Returns the number of items decoded.
+	extern "C" int wntgd_DecompressVoiceBatch(VoiceBatchItem* items, int itemCount, float* audioOut, int audioOutCapacity)
+	{
+		return DecompressBatch(items, itemCount, audioOut, DecodeOutputFormat_Float, audioOutCapacity);
+	}
+
+	extern "C" int wntgd_DecompressVoiceBatchPcm16(VoiceBatchItem* items, int itemCount, int16_t* audioOut, int audioOutCapacity)
+	{
+		return DecompressBatch(items, itemCount, audioOut, DecodeOutputFormat_PcmInt16, audioOutCapacity);
+	}
+}
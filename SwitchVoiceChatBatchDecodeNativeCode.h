@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <cstdlib>
+#include <atomic>
+#include <nn/os.h>
+#include <nn/nn_Log.h>
+#include "SwitchVoiceChatDecodeNativeCode.h"
+#include "SwitchVoiceChatMemoryNativeCode.h"
+
+
+
+// Decodes many (speaker, packet) pairs in one call, for servers and spectators that receive dozens of streams per tick.
+// The packets of a speaker form one task, decoded in order by a single thread; the tasks are split between the worker threads
+// (VoiceMemoryBudget::decodeThreadCount, started by wntgd_InitializeDecoder) and the calling thread, and a thread that runs
+// out of tasks steals from the others.
+namespace SwitchVoiceChatBatchDecodeNativeCode {
+	const int BATCH_DECODE_THREAD_COUNT_MAX = 16;
+	const size_t BATCH_DECODE_THREAD_STACK_SIZE = 64 * 1024;
+	const int BATCH_DECODE_CHUNK_ITEM_COUNT = 1024; // longer batches are decoded in several rounds
+	const size_t BATCH_DECODE_CACHE_LINE_SIZE = 64;
+
+	// One packet of wntgd_DecompressVoiceBatch
+	struct VoiceBatchItem
+	{
+		intptr_t speakerHandle; // 0: the default speaker of wntgd_DecompressVoiceData
+		const unsigned char* inputBuffer; // voice data as returned by wntgd_GetVoiceBuffer
+		int count;
+		int outOffset; // set by the call: first sample in the output arena
+		int outSampleCount; // set by the call: 0 if the packet was not decoded
+	};
+
+	// The items of one speaker, linked in their order in the batch
+	struct BatchTask
+	{
+		intptr_t speakerHandle;
+		int firstItem;
+		int lastItem;
+	};
+
+	// Tasks [next, end) not taken yet. The owner and the thieves take them with the same atomic increment,
+	// so they only contend once a thread steals.
+	struct alignas(BATCH_DECODE_CACHE_LINE_SIZE) BatchTaskRange
+	{
+		std::atomic<int> next;
+		int end;
+	};
+
+	size_t GetBatchDecodeMemorySize(const SwitchVoiceChatMemoryNativeCode::VoiceMemoryBudget& budget);
+	bool StartBatchDecodeThreads(SwitchVoiceChatMemoryNativeCode::VoiceArenaRegion* region, int threadCount);
+	void StopBatchDecodeThreads();
+	intptr_t GetBatchItemSpeakerHandle(const VoiceBatchItem& item);
+	void BuildBatchTasks(VoiceBatchItem* items, int itemCount);
+	void DecodeBatchTask(const BatchTask& task);
+	void RunBatchTasks(int participant);
+	void BatchDecodeThreadFunction(void* arg);
+	int DecompressBatch(VoiceBatchItem* items, int itemCount, void* audioOut, SwitchVoiceChatDecodeNativeCode::DecodeOutputFormat format, int audioOutCapacity);
+	extern "C" int wntgd_DecompressVoiceBatch(VoiceBatchItem* items, int itemCount, float* audioOut, int audioOutCapacity);
+	extern "C" int wntgd_DecompressVoiceBatchPcm16(VoiceBatchItem* items, int itemCount, int16_t* audioOut, int audioOutCapacity);
+}
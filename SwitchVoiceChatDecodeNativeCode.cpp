@@ -1,108 +1,1059 @@
-#include "SwitchVoiceChatDEcodeNativeCode.h";
+#include "SwitchVoiceChatDecodeNativeCode.h"
+#include <new>
 #include <nns/nns_Log.h>
+#include "SwitchVoiceChatSimd.h"
+#include "SwitchVoiceChatPacketFormat.h"
+#include "SwitchVoiceChatStatsNativeCode.h"
+#include "SwitchVoiceChatMemoryNativeCode.h"
+#include "SwitchVoiceChatBatchDecodeNativeCode.h"
 
 namespace SwitchVoiceChatDecodeNativeCode {
 	using namespace nn::audio;
 	using namespace nn::codec;
+	using namespace SwitchVoiceChatPacketFormat;
+	using namespace SwitchVoiceChatStatsNativeCode;
+	using namespace SwitchVoiceChatMemoryNativeCode;
 
-	const int TOTAL_BUFFER_SIZE = 1024 * 1024;
+	const int SAMPLE_RATE = 48000;
+	const int MAX_DECODED_FRAME_SAMPLE_COUNT = SAMPLE_RATE * 120 / 1000; // the longest Opus packet is 120 ms
+	const int OPUS_PACKET_HEADER_SIZE = 8;
+	const int MAX_RECYCLED_DECOMPRESS_VECTOR_COUNT = 32;
+	const int JITTER_BUFFER_FRAME_COUNT = 32; // must be a power of two
+	const int MAX_PULL_SAMPLE_COUNT = SAMPLE_RATE * 60 / 1000;
+	const size_t DECODER_BUFFER_ALIGNMENT = 64;
+	const int JITTER_DELAY_FACTOR = 3; // target delay = one frame + JITTER_DELAY_FACTOR * jitter
+	const int JITTER_TARGET_DELAY_MAX = SAMPLE_RATE * 200 / 1000;
+	const int MAX_CONCEALED_FRAME_COUNT = 5; // longer gaps are a new talk spurt rather than a loss
+	const float CONCEAL_ATTENUATION = 0.6f; // gain applied again for every consecutive concealed frame
+	const int COMFORT_NOISE_HOLD_SAMPLE_COUNT = SAMPLE_RATE * COMFORT_NOISE_INTERVAL_MILIS * 5 / 2 / 1000; // then the speaker is gone
+	const int COMFORT_NOISE_LEVEL_MIN = 30; // louder background noise is clamped to -30 dBov
+	const int DECODER_BUSY_RETRY_MICRO_SECONDS = 100;
+
+	struct JitterSlot
+	{
+		bool filled;
+		uint16_t sequence;
+		uint32_t timestamp;
+		int payloadSize;
+		bool comfortNoise; // the payload is the noise level
+	};
 
-	nn::mem::StandardAllocator decoderAllocator;
-	unsigned char* totalBufferDecoder;
-	int16_t* decoderOutBuffer;
-	int decoderOutBufferSize;
+	// Per speaker playout buffer. Packets are kept (encoded) in a slot per sequence number and decoded when pulled.
+	// Timestamps and delays are counted in 48 kHz samples.
+	struct JitterBuffer
+	{
+		JitterSlot slots[JITTER_BUFFER_FRAME_COUNT];
+		unsigned char* payloads; // JITTER_BUFFER_FRAME_COUNT * jitterPayloadSizeMaximum bytes
+		int16_t* pcm; // decoded samples not pulled yet (jitterPcmSampleCount)
+		int pcmCount;
+		int packetCount;
+		bool playing;
+		uint16_t nextSequence;
+		uint32_t decodedTimestamp; // timestamp of the sample right after the end of pcm
+		uint32_t newestTimestamp; // timestamp of the sample right after the newest packet
+		bool hasTransit;
+		int32_t lastTransit;
+		float jitter;
+		int targetDelay;
+		int lastFrameSampleCount;
+	};
+
+	// One decoder per remote speaker, so the Opus inter-frame state of different speakers never mixes.
+	// A context is only touched by the thread that acquired it, so different speakers can be decoded in parallel.
+	struct DecoderContext
+	{
+		OpusDecoder decoder;
+		unsigned char* workBuffer;
+		int16_t* outBuffer;
+		int16_t* lastFrame; // last decoded frame, repeated to conceal losses
+		int lastFrameSampleCount;
+		int concealedFrameCount;
+		bool hasSequence;
+		uint16_t lastSequence; // last frame decoded through DecompressInto
+		float comfortNoiseAmplitude; // RMS of the noise, from the last comfort noise frame
+		int comfortNoiseSampleCount; // samples of comfort noise left before the speaker is considered gone
+		uint32_t comfortNoiseSeed;
+		uint32_t generation;
+		uint64_t lastUsed;
+		bool allocated;
+		bool pinned; // never recycled (used by the default speaker)
+		bool busy;
+		nn::os::MutexType jitterMutex; // the jitter buffer is shared by the network (push) and audio (pull) threads
+		JitterBuffer jitterBuffer;
+	};
 
+	// the contexts and all their work, out and jitter buffers live in the decoder region, sized by the memory budget
+	VoiceArenaRegion* decoderRegion;
 	size_t opusDecoderWorkBufferSize;
-	unsigned char* opusDecoderWorkBuffer;
-	OpusDecoder* decoder;
+	int decodedFrameSampleCountMaximum;
+	int jitterPayloadSizeMaximum;
+	int jitterPcmSampleCount;
 
-	const int SAMPLE_RATE = 48000;
+	DecoderContext* decoderContexts;
+	int decoderCount;
+	nn::os::Mutex decoderPoolMutex(false);
+	uint64_t decoderUseCounter;
+	intptr_t defaultDecoderHandle;
+
+	// vectors returned by wntgd_ReleaseDecompressBuffer are kept (with their capacity) for the next legacy decode
+	std::vector<float>* recycledDecompressVectors[MAX_RECYCLED_DECOMPRESS_VECTOR_COUNT];
+	int recycledDecompressVectorCount;
+	nn::os::Mutex decompressVectorMutex(false);
+
+	inline intptr_t MakeDecoderHandle(int index)
+	{
+		return (static_cast<intptr_t>(decoderContexts[index].generation) << 8) | (index + 1);
+	}
+
+	// Find the context of a handle (call this function with decoderPoolMutex locked)
+	DecoderContext* FindDecoderContext(intptr_t speakerHandle)
+	{
+		int index = static_cast<int>(speakerHandle & 0xff) - 1;
+		if (index < 0 || index >= decoderCount) return nullptr;
+
+		DecoderContext* context = &decoderContexts[index];
+		if (!context->allocated || MakeDecoderHandle(index) != speakerHandle) return nullptr;
+		return context;
+	}
+
+	void ResetJitterBuffer(JitterBuffer* jitterBuffer)
+	{
+		for (int i = 0; i < JITTER_BUFFER_FRAME_COUNT; i++)
+		{
+			jitterBuffer->slots[i].filled = false;
+		}
+		jitterBuffer->pcmCount = 0;
+		jitterBuffer->packetCount = 0;
+		jitterBuffer->playing = false;
+		jitterBuffer->hasTransit = false;
+		jitterBuffer->jitter = 0;
+		jitterBuffer->targetDelay = 0;
+		jitterBuffer->lastFrameSampleCount = SAMPLE_RATE / 100;
+	}
+
+	// Reset the Opus state of a context, so a new speaker does not inherit the previous one
+	bool ResetDecoderContext(DecoderContext* context)
+	{
+		context->lastFrameSampleCount = 0;
+		context->concealedFrameCount = 0;
+		context->hasSequence = false;
+		context->comfortNoiseSampleCount = 0;
+
+		nn::os::LockMutex(&context->jitterMutex);
+		ResetJitterBuffer(&context->jitterBuffer);
+		nn::os::UnlockMutex(&context->jitterMutex);
+
+		context->decoder.Finalize();
+		OpusResult result = context->decoder.Initialize(SAMPLE_RATE, 1, context->workBuffer, opusDecoderWorkBufferSize);
+		return result == OpusResult_Success;
+	}
+
+	intptr_t GetDefaultDecoderHandle()
+	{
+		return defaultDecoderHandle;
+	}
+
+	// Get exclusive access to the decoder of a speaker and mark it used for the recycling (returns nullptr if the handle is stale or the decoder is in use)
+	DecoderContext* AcquireDecoderContext(intptr_t speakerHandle)
+	{
+		decoderPoolMutex.Lock();
+		DecoderContext* context = FindDecoderContext(speakerHandle);
+		if (context)
+		{
+			if (context->busy)
+			{
+				context = nullptr;
+			}
+			else
+			{
+				context->busy = true;
+				context->lastUsed = ++decoderUseCounter;
+			}
+		}
+		decoderPoolMutex.Unlock();
+		return context;
+	}
+
+	// AcquireDecoderContext that waits while another call (a push, a pull of the mixer) holds the decoder.
+	// Those calls hold it for one packet or one frame, so this only returns nullptr if the handle is stale.
+	DecoderContext* WaitDecoderContext(intptr_t speakerHandle)
+	{
+		for (;;)
+		{
+			decoderPoolMutex.Lock();
+			DecoderContext* context = FindDecoderContext(speakerHandle);
+			bool busy = context && context->busy;
+			if (context && !busy)
+			{
+				context->busy = true;
+				context->lastUsed = ++decoderUseCounter;
+			}
+			decoderPoolMutex.Unlock();
+			if (!busy) return context;
+			nn::os::SleepThread(nn::TimeSpan::FromMicroSeconds(DECODER_BUSY_RETRY_MICRO_SECONDS));
+		}
+	}
+
+	void ReleaseDecoderContext(DecoderContext* context)
+	{
+		decoderPoolMutex.Lock();
+		context->busy = false;
+		decoderPoolMutex.Unlock();
+	}
+
+	int GetDecodedFrameSampleCountMaximum(int frameDuration)
+	{
+		int sampleCount = SAMPLE_RATE / 1000 * frameDuration / 1000;
+		return sampleCount < MAX_DECODED_FRAME_SAMPLE_COUNT ? sampleCount : MAX_DECODED_FRAME_SAMPLE_COUNT;
+	}
+
+	// Size of the decoder region for a budget: the contexts, then every Opus work buffer, then the out and jitter buffers
+	// of each context, then the stacks of the batch decode threads (the same layout as wntgd_InitializeDecoder)
+	size_t GetDecoderMemorySize(const VoiceMemoryBudget& budget)
+	{
+		OpusDecoder sizingDecoder;
+		size_t workBufferSize = nn::util::align_up(sizingDecoder.GetWorkBufferSize(SAMPLE_RATE, 1), AudioInBuffer::AddressAlignment);
+		int frameSampleCount = GetDecodedFrameSampleCountMaximum(budget.maxFrameDurationMicroSeconds);
+		int contextCount = budget.maxSpeakerCount + 1; // the default speaker
+		size_t size = 0;
+		AddRegionAllocation(&size, contextCount * sizeof(DecoderContext), alignof(DecoderContext));
+		for (int i = 0; i < contextCount; i++)
+		{
+			AddRegionAllocation(&size, workBufferSize, AudioInBuffer::AddressAlignment);
+		}
+		for (int i = 0; i < contextCount; i++)
+		{
+			AddRegionAllocation(&size, frameSampleCount * sizeof(int16_t), DECODER_BUFFER_ALIGNMENT);
+			AddRegionAllocation(&size, frameSampleCount * sizeof(int16_t), DECODER_BUFFER_ALIGNMENT);
+			AddRegionAllocation(&size, JITTER_BUFFER_FRAME_COUNT * budget.maxPayloadSize, DECODER_BUFFER_ALIGNMENT);
+			AddRegionAllocation(&size, (frameSampleCount + MAX_PULL_SAMPLE_COUNT) * sizeof(int16_t), DECODER_BUFFER_ALIGNMENT);
+		}
+		return size + SwitchVoiceChatBatchDecodeNativeCode::GetBatchDecodeMemorySize(budget);
+	}
 
 	extern "C" bool wntgd_InitializeDecoder()
 	{
-		totalBufferDecoder = new unsigned char[TOTAL_BUFFER_SIZE]();
-		decoderAllocator.Initialize(totalBufferDecoder, TOTAL_BUFFER_SIZE);
+		decoderRegion = AcquireDecoderRegion();
+		if (!decoderRegion) return false;
+		const VoiceMemoryBudget& budget = GetVoiceMemoryBudget();
+		decoderCount = budget.maxSpeakerCount + 1;
+		decodedFrameSampleCountMaximum = GetDecodedFrameSampleCountMaximum(budget.maxFrameDurationMicroSeconds);
+		jitterPayloadSizeMaximum = budget.maxPayloadSize;
+		jitterPcmSampleCount = decodedFrameSampleCountMaximum + MAX_PULL_SAMPLE_COUNT;
+
+		// the region is sized by GetDecoderMemorySize for exactly these allocations, so none of them fails
+		decoderContexts = reinterpret_cast<DecoderContext*>(AllocateFromRegion(decoderRegion, decoderCount * sizeof(DecoderContext), alignof(DecoderContext)));
+		for (int i = 0; i < decoderCount; i++)
+		{
+			new (&decoderContexts[i]) DecoderContext();
+		}
+		opusDecoderWorkBufferSize = decoderContexts[0].decoder.GetWorkBufferSize(SAMPLE_RATE, 1); // channelCount = 1, because we use mono
+		opusDecoderWorkBufferSize = nn::util::align_up(opusDecoderWorkBufferSize, AudioInBuffer::AddressAlignment);
+		for (int i = 0; i < decoderCount; i++)
+		{
+			decoderContexts[i].workBuffer = reinterpret_cast<unsigned char*>(AllocateFromRegion(decoderRegion, opusDecoderWorkBufferSize, AudioInBuffer::AddressAlignment));
+		}
+		NNS_LOG("OPUS DECODER WORK BUFFER SIZE: %i\n", static_cast<int>(opusDecoderWorkBufferSize));
+
+		decoderUseCounter = 0;
+		for (int i = 0; i < decoderCount; i++)
+		{
+			DecoderContext* context = &decoderContexts[i];
+			context->outBuffer = reinterpret_cast<int16_t*>(AllocateFromRegion(decoderRegion, decodedFrameSampleCountMaximum * sizeof(int16_t), DECODER_BUFFER_ALIGNMENT));
+			context->lastFrame = reinterpret_cast<int16_t*>(AllocateFromRegion(decoderRegion, decodedFrameSampleCountMaximum * sizeof(int16_t), DECODER_BUFFER_ALIGNMENT));
+			context->jitterBuffer.payloads = reinterpret_cast<unsigned char*>(AllocateFromRegion(decoderRegion, JITTER_BUFFER_FRAME_COUNT * jitterPayloadSizeMaximum, DECODER_BUFFER_ALIGNMENT));
+			context->jitterBuffer.pcm = reinterpret_cast<int16_t*>(AllocateFromRegion(decoderRegion, jitterPcmSampleCount * sizeof(int16_t), DECODER_BUFFER_ALIGNMENT));
+			context->lastFrameSampleCount = 0;
+			context->concealedFrameCount = 0;
+			context->hasSequence = false;
+			context->comfortNoiseSampleCount = 0;
+			context->comfortNoiseSeed = 22222 + i;
+			ResetJitterBuffer(&context->jitterBuffer);
+			nn::os::InitializeMutex(&context->jitterMutex, false, 0);
+			context->generation = 0;
+			context->lastUsed = 0;
+			context->allocated = false;
+			context->pinned = false;
+			context->busy = false;
+			OpusResult result = context->decoder.Initialize(SAMPLE_RATE, 1, context->workBuffer, opusDecoderWorkBufferSize);
+			if (result != OpusResult_Success)
+			{
+				NNS_LOG("OPUS RESULT: %i\n", result);
+				for (int j = 0; j < i; j++) decoderContexts[j].decoder.Finalize();
+				for (int j = 0; j <= i; j++) nn::os::FinalizeMutex(&decoderContexts[j].jitterMutex);
+				FreeDecoderContexts();
+				return false;
+			}
+		}
+		NNS_LOG("OPUS DECODER MEMORY: %i for %i decoders\n", static_cast<int>(decoderRegion->used.load(std::memory_order_relaxed)), decoderCount);
 
-		decoderOutBufferSize = TOTAL_BUFFER_SIZE * 9 / 10;
-		NNS_LOG("OPUS DECODER out BUFFER SIZE: %i\n", decoderOutBufferSize);
-		decoderOutBuffer = reinterpret_cast<int16_t*>(decoderAllocator.Allocate(decoderOutBufferSize, AudioInBuffer::AddressAlignment));
-		decoderOutBufferSize = decoderOutBufferSize / sizeof(int16_t);
-		NNS_LOG("OPUS DECODER out BUFFER SIZE: %i\n", decoderOutBufferSize);
-		if (!decoderOutBuffer)
+		// the default speaker keeps the old single decoder API working
+		if (!wntgd_CreateSpeakerDecoder(&defaultDecoderHandle))
+		{
+			wntgd_FinalizeDecoder();
+			return false;
+		}
+		decoderContexts[(defaultDecoderHandle & 0xff) - 1].pinned = true;
+		if (!SwitchVoiceChatBatchDecodeNativeCode::StartBatchDecodeThreads(decoderRegion, budget.decodeThreadCount))
 		{
-			decoderAllocator.Finalize();
-			delete totalBufferDecoder;
+			wntgd_FinalizeDecoder();
 			return false;
 		}
+		return true;
+	}
+
+	// Destroy the contexts and give the decoder region back
+	void FreeDecoderContexts()
+	{
+		for (int i = 0; i < decoderCount; i++)
+		{
+			decoderContexts[i].~DecoderContext();
+		}
+		decoderContexts = nullptr;
+		decoderCount = 0;
+		ReleaseRegion(decoderRegion);
+		decoderRegion = nullptr;
+	}
+
+	extern "C" void wntgd_FinalizeDecoder()
+	{
+		if (!decoderRegion) return;
+		SwitchVoiceChatBatchDecodeNativeCode::StopBatchDecodeThreads();
+		for (int i = 0; i < decoderCount; i++)
+		{
+			decoderContexts[i].decoder.Finalize();
+			decoderContexts[i].allocated = false;
+			nn::os::FinalizeMutex(&decoderContexts[i].jitterMutex);
+		}
+		FreeDecoderContexts();
 
-		decoder = new OpusDecoder();
-		opusDecoderWorkBufferSize = decoder->GetWorkBufferSize(SAMPLE_RATE, 1); // channelCount = 1, because we use mono
-		NNS_LOG("OPUS DECODER WORK BUFFER SIZE: %i\n", opusDecoderWorkBufferSize);
-		opusDecoderWorkBuffer = new unsigned char[opusDecoderWorkBufferSize];
-		OpusResult result = decoder->Initialize(SAMPLE_RATE, 1, opusDecoderWorkBuffer, opusDecoderWorkBufferSize);
-		NNS_LOG("OPUS RESULT: %i\n", result);
-		if (result != OpusResult_Success)
+		decompressVectorMutex.Lock();
+		while (recycledDecompressVectorCount > 0)
 		{
+			delete recycledDecompressVectors[--recycledDecompressVectorCount];
+		}
+		decompressVectorMutex.Unlock();
+	}
+
+	// Create a decoder for a remote speaker. If the pool is full, the least recently used idle decoder is recycled.
+	extern "C" bool wntgd_CreateSpeakerDecoder(intptr_t * speakerHandle)
+	{
+		decoderPoolMutex.Lock();
+		int index = -1;
+		for (int i = 0; i < decoderCount; i++)
+		{
+			if (!decoderContexts[i].allocated)
+			{
+				index = i;
+				break;
+			}
+		}
+		if (index < 0)
+		{
+			uint64_t oldestUse = UINT64_MAX;
+			for (int i = 0; i < decoderCount; i++)
+			{
+				DecoderContext* context = &decoderContexts[i];
+				if (!context->pinned && !context->busy && context->lastUsed < oldestUse)
+				{
+					oldestUse = context->lastUsed;
+					index = i;
+				}
+			}
+		}
+		if (index < 0)
+		{
+			decoderPoolMutex.Unlock();
 			return false;
 		}
+
+		DecoderContext* context = &decoderContexts[index];
+		bool result = ResetDecoderContext(context);
+		context->generation = (context->generation + 1) & 0xffffff; // invalidates the handle of a recycled speaker
+		context->lastUsed = ++decoderUseCounter;
+		context->allocated = result;
+		*speakerHandle = result ? MakeDecoderHandle(index) : 0;
+		decoderPoolMutex.Unlock();
+		return result;
+	}
+
+	extern "C" void wntgd_DestroySpeakerDecoder(intptr_t speakerHandle)
+	{
+		decoderPoolMutex.Lock();
+		DecoderContext* context = FindDecoderContext(speakerHandle);
+		if (context && !context->pinned)
+		{
+			context->allocated = false;
+		}
+		decoderPoolMutex.Unlock();
+	}
+
+	// Number of samples (at 48 kHz) of one Opus packet, read from its TOC byte (RFC 6716, section 3.1)
+	int GetOpusPacketSampleCount(const unsigned char* payload, size_t payloadSize)
+	{
+		if (payloadSize < 1) return -1;
+
+		int config = payload[0] >> 3;
+		int frameSampleCount;
+		if (config < 12)
+		{
+			const int silkFrameSampleCounts[4] = { 480, 960, 1920, 2880 };
+			frameSampleCount = silkFrameSampleCounts[config & 3];
+		}
+		else if (config < 16)
+		{
+			frameSampleCount = (config & 1) ? 960 : 480;
+		}
 		else
 		{
-			return true;
+			frameSampleCount = 120 << (config & 3);
 		}
+
+		int frameCount;
+		switch (payload[0] & 3)
+		{
+		case 0:
+			frameCount = 1;
+			break;
+		case 1:
+		case 2:
+			frameCount = 2;
+			break;
+		default:
+			if (payloadSize < 2) return -1;
+			frameCount = payload[1] & 0x3f;
+			break;
+		}
+		return frameSampleCount * frameCount;
 	}
 
-	extern "C" void wntgd_FinalizeDecoder()
+	// Number of samples of one nn::codec Opus packet (it starts with a big endian payload size and the final range)
+	int GetOpusPayloadSampleCount(const unsigned char* payload, int payloadSize)
 	{
-		decoder->Finalize();
-		delete opusDecoderWorkBuffer;
-		decoderAllocator.Free(decoderOutBuffer);
-		decoderAllocator.Finalize();
-		delete totalBufferDecoder;
+		if (payloadSize < OPUS_PACKET_HEADER_SIZE) return -1;
+		int opusSize = (payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) | payload[3];
+		if (opusSize <= 0 || opusSize > payloadSize - OPUS_PACKET_HEADER_SIZE) return -1;
+		return GetOpusPacketSampleCount(payload + OPUS_PACKET_HEADER_SIZE, opusSize);
 	}
 
-	extern "C" bool wntgd_DecompressVoiceData(intptr_t * handle, unsigned char* inputBuffer, int count, float** audioOut, int* outSampleCount, unsigned int* sampleRateOut)
+	// Number of samples of the payload of a frame (comfort noise frames have none)
+	int GetFrameSampleCount(const FrameHeader& header, const unsigned char* payload)
+	{
+		if (header.flags & FRAME_FLAG_COMFORT_NOISE) return 0;
+		return GetOpusPayloadSampleCount(payload, header.payloadSize);
+	}
+
+	// Walk the frames of inputBuffer and add up their decoded sample count, so the output can be sized before decoding
+	extern "C" bool wntgd_GetDecompressedSampleCount(const unsigned char* inputBuffer, int count, int* outSampleCount)
+	{
+		int totalOutSampleCount = 0;
+		while (count > 0)
+		{
+			FrameHeader header;
+			int headerSize = ReadFrameHeader(inputBuffer, count, &header);
+			if (headerSize < 0) return false;
+
+			int sampleCount = GetFrameSampleCount(header, inputBuffer + headerSize);
+			if (sampleCount < 0) return false;
+
+			totalOutSampleCount += sampleCount;
+			inputBuffer += headerSize + header.payloadSize;
+			count -= headerSize + header.payloadSize;
+		}
+		*outSampleCount = totalOutSampleCount;
+		return true;
+	}
+
+	// Decode one Opus packet to audioOut. PcmInt16 output is decoded straight into audioOut;
+	// float output goes through the context out buffer. Packets longer than decodedFrameSampleCountMaximum fail,
+	// whatever the format, since lastFrame only holds that many samples.
+	bool DecodePayload(DecoderContext* context, const unsigned char* payload, int payloadSize, void* audioOut, DecodeOutputFormat format, int audioOutCapacity, int* outSampleCount)
 	{
-		size_t partialConsumed = 0;
-		int partialOutSampleCount = 0;
-		size_t totalConsumed = 0;
-		size_t totalOutSampleCount = 0;
-		std::vector<float>* outVector = new std::vector<float>(0);
+		int16_t* decodeBuffer = context->outBuffer;
+		size_t decodeBufferSize = decodedFrameSampleCountMaximum;
+		if (format == DecodeOutputFormat_PcmInt16)
+		{
+			decodeBuffer = reinterpret_cast<int16_t*>(audioOut);
+			if (audioOutCapacity < decodedFrameSampleCountMaximum) decodeBufferSize = audioOutCapacity;
+		}
+
+		size_t consumed = 0;
+		nn::os::Tick decodeStart = nn::os::GetSystemTick();
+		OpusResult decoderResult = context->decoder.DecodeInterleaved(&consumed, outSampleCount,
+			decodeBuffer, decodeBufferSize * sizeof(int16_t), payload, payloadSize); // the size is in bytes
+		RecordVoiceValue(VoiceHistogram_DecodeMicroSeconds, GetMicroSecondsSince(decodeStart));
+		if (decoderResult != OpusResult_Success || *outSampleCount > audioOutCapacity || *outSampleCount > decodedFrameSampleCountMaximum)
+		{
+			CountVoiceEvent(VoiceCounter_DecodeFailures);
+			return false;
+		}
+		CountVoiceEvent(VoiceCounter_DecodedFrames);
+
+		memcpy(context->lastFrame, decodeBuffer, *outSampleCount * sizeof(int16_t));
+		context->lastFrameSampleCount = *outSampleCount;
+		context->concealedFrameCount = 0;
+		context->comfortNoiseSampleCount = 0;
+		if (format == DecodeOutputFormat_Float)
+		{
+			SwitchVoiceChatSimd::ConvertInt16ToFloat(reinterpret_cast<float*>(audioOut), context->outBuffer, *outSampleCount);
+		}
+		return true;
+	}
+
+	// Synthesize a lost frame by repeating the last decoded one, fading out further with every consecutive loss
+	// (sampleCount must not exceed decodedFrameSampleCountMaximum)
+	void ConcealFrame(DecoderContext* context, void* audioOut, DecodeOutputFormat format, int sampleCount)
+	{
+		int16_t* concealBuffer = format == DecodeOutputFormat_PcmInt16 ? reinterpret_cast<int16_t*>(audioOut) : context->outBuffer;
+		if (context->lastFrameSampleCount == 0 || context->concealedFrameCount >= MAX_CONCEALED_FRAME_COUNT)
+		{
+			memset(concealBuffer, 0, sampleCount * sizeof(int16_t));
+		}
+		else
+		{
+			// the gain is ramped over the frame, so the fade does not click
+			float startGain = 1;
+			for (int i = 0; i < context->concealedFrameCount; i++) startGain *= CONCEAL_ATTENUATION;
+			float gainStep = startGain * (CONCEAL_ATTENUATION - 1) / sampleCount;
+			float gain = startGain;
+			int sourceIndex = 0;
+			for (int i = 0; i < sampleCount; i++)
+			{
+				concealBuffer[i] = static_cast<int16_t>(context->lastFrame[sourceIndex] * gain);
+				gain += gainStep;
+				if (++sourceIndex == context->lastFrameSampleCount) sourceIndex = 0;
+			}
+		}
+		context->concealedFrameCount++;
+		CountVoiceEvent(VoiceCounter_ConcealedFrames);
+
+		if (format == DecodeOutputFormat_Float)
+		{
+			SwitchVoiceChatSimd::ConvertInt16ToFloat(reinterpret_cast<float*>(audioOut), context->outBuffer, sampleCount);
+		}
+	}
+
+	void SetComfortNoiseLevel(DecoderContext* context, uint8_t audioLevel)
+	{
+		if (audioLevel < COMFORT_NOISE_LEVEL_MIN) audioLevel = COMFORT_NOISE_LEVEL_MIN;
+		context->comfortNoiseAmplitude = 32767 * powf(10, -audioLevel / 20.0f);
+		context->comfortNoiseSampleCount = COMFORT_NOISE_HOLD_SAMPLE_COUNT;
+	}
+
+	// White noise at the level the speaker sent, so the silence between talk spurts does not sound dead
+	// (silence once the speaker stopped sending comfort noise frames)
+	void GenerateComfortNoise(DecoderContext* context, int16_t* out, int sampleCount)
+	{
+		if (context->comfortNoiseSampleCount <= 0)
+		{
+			memset(out, 0, sampleCount * sizeof(int16_t));
+			return;
+		}
+
+		// uniform noise in [-a * sqrt(3), a * sqrt(3)] has an RMS of a
+		float scale = context->comfortNoiseAmplitude * 1.7320508f / 32768;
+		uint32_t seed = context->comfortNoiseSeed;
+		for (int i = 0; i < sampleCount; i++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			out[i] = static_cast<int16_t>(static_cast<int16_t>(seed >> 16) * scale);
+		}
+		context->comfortNoiseSeed = seed;
+		context->comfortNoiseSampleCount -= sampleCount;
+	}
+
+	// Walk the frames of a speaker, rebuilding a lost frame from the redundant payload of the next one or concealing it.
+	// Without decode, only the output sample count is computed and the context is not modified.
+	bool DecodeSpeakerFrames(DecoderContext* context, const unsigned char* inputBuffer, int count, void* audioOut, DecodeOutputFormat format, int audioOutCapacity, bool decode, int* outSampleCount)
+	{
+		bool hasSequence = context->hasSequence;
+		uint16_t lastSequence = context->lastSequence;
+		int totalOutSampleCount = 0;
 		bool result = true;
 
 		while (count > 0)
 		{
-			OpusResult decoderResult = decoder->DecodeInterleaved(&partialConsumed, &partialOutSampleCount,
-				decoderOutBuffer, decoderOutBufferSize, inputBuffer, count);
+			FrameHeader header;
+			int payloadOffset = ReadFrameHeader(inputBuffer, count, &header);
+			if (payloadOffset < 0)
+			{
+				result = false;
+				break;
+			}
+			const unsigned char* payload = inputBuffer + payloadOffset;
+			int sampleCount = GetFrameSampleCount(header, payload);
+			if (sampleCount < 0 || sampleCount > decodedFrameSampleCountMaximum)
+			{
+				CountVoiceEvent(VoiceCounter_DecodeFailures);
+				result = false;
+				break;
+			}
+
+			int lostCount = hasSequence ? static_cast<int16_t>(header.sequence - lastSequence - 1) : 0;
+			if (lostCount > MAX_CONCEALED_FRAME_COUNT) lostCount = 0;
+			for (int i = 0; i < lostCount; i++)
+			{
+				// the redundant payload is a copy of the frame right before this one
+				const unsigned char* redundantPayload = payload - header.redundantPayloadSize;
+				int lostSampleCount = -1;
+				if (i == lostCount - 1 && header.redundantPayloadSize > 0)
+				{
+					lostSampleCount = GetOpusPayloadSampleCount(redundantPayload, header.redundantPayloadSize);
+				}
+				bool recoverable = lostSampleCount > 0 && lostSampleCount <= decodedFrameSampleCountMaximum;
+				if (!recoverable) lostSampleCount = sampleCount;
+
+				if (decode && lostSampleCount > audioOutCapacity - totalOutSampleCount)
+				{
+					result = false;
+					break;
+				}
+				if (decode)
+				{
+					void* lostOut = OffsetAudioOut(audioOut, format, totalOutSampleCount);
+					int recoveredSampleCount = 0;
+					if (!recoverable || !DecodePayload(context, redundantPayload, header.redundantPayloadSize,
+						lostOut, format, audioOutCapacity - totalOutSampleCount, &recoveredSampleCount))
+					{
+						ConcealFrame(context, lostOut, format, lostSampleCount);
+					}
+				}
+				totalOutSampleCount += lostSampleCount;
+			}
+			if (!result) break;
+
+			if (decode && (header.flags & FRAME_FLAG_COMFORT_NOISE))
+			{
+				SetComfortNoiseLevel(context, header.audioLevel);
+			}
+			else if (decode)
+			{
+				int partialOutSampleCount = 0;
+				if (!DecodePayload(context, payload, header.payloadSize,
+					OffsetAudioOut(audioOut, format, totalOutSampleCount), format, audioOutCapacity - totalOutSampleCount, &partialOutSampleCount))
+				{
+					result = false;
+					break;
+				}
+			}
+			totalOutSampleCount += sampleCount;
+			hasSequence = true;
+			lastSequence = header.sequence;
+
+			inputBuffer += payloadOffset + header.payloadSize;
+			count -= payloadOffset + header.payloadSize;
+		}
+
+		if (decode)
+		{
+			context->hasSequence = hasSequence;
+			context->lastSequence = lastSequence;
+		}
+		*outSampleCount = totalOutSampleCount;
+		return result;
+	}
+
+	// Output size of wntgd_DecompressSpeakerVoiceDataInto, including the frames it will rebuild or conceal
+	extern "C" bool wntgd_GetSpeakerDecompressedSampleCount(intptr_t speakerHandle, const unsigned char* inputBuffer, int count, int* outSampleCount)
+	{
+		DecoderContext* context = AcquireDecoderContext(speakerHandle);
+		if (!context) return false;
+		bool result = DecodeSpeakerFrames(context, inputBuffer, count, nullptr, DecodeOutputFormat_PcmInt16, 0, false, outSampleCount);
+		ReleaseDecoderContext(context);
+		return result;
+	}
+
+	// Decode into a caller owned buffer (e.g. a pinned managed array). Nothing is allocated here.
+	// If audioOutCapacity is too small nothing is decoded, false is returned and outSampleCount has the required size.
+	bool DecompressInto(intptr_t speakerHandle, const unsigned char* inputBuffer, int count, void* audioOut, DecodeOutputFormat format, int audioOutCapacity, int* outSampleCount, unsigned int* sampleRateOut)
+	{
+		*sampleRateOut = SAMPLE_RATE;
+		*outSampleCount = 0;
+
+		DecoderContext* context = AcquireDecoderContext(speakerHandle);
+		if (!context) return false;
+
+		bool result = DecodeSpeakerFrames(context, inputBuffer, count, nullptr, format, 0, false, outSampleCount);
+		if (result && *outSampleCount <= audioOutCapacity)
+		{
+			result = DecodeSpeakerFrames(context, inputBuffer, count, audioOut, format, audioOutCapacity, true, outSampleCount);
+		}
+		else result = false;
+		ReleaseDecoderContext(context);
+		return result;
+	}
+
+	extern "C" bool wntgd_DecompressSpeakerVoiceDataInto(intptr_t speakerHandle, const unsigned char* inputBuffer, int count, float* audioOut, int audioOutCapacity, int* outSampleCount, unsigned int* sampleRateOut)
+	{
+		return DecompressInto(speakerHandle, inputBuffer, count, audioOut, DecodeOutputFormat_Float, audioOutCapacity, outSampleCount, sampleRateOut);
+	}
+
+	// Raw PCM output, half the memory traffic of float when the consumer plays SampleFormat_PcmInt16 anyway
+	extern "C" bool wntgd_DecompressSpeakerVoiceDataPcm16Into(intptr_t speakerHandle, const unsigned char* inputBuffer, int count, int16_t* audioOut, int audioOutCapacity, int* outSampleCount, unsigned int* sampleRateOut)
+	{
+		return DecompressInto(speakerHandle, inputBuffer, count, audioOut, DecodeOutputFormat_PcmInt16, audioOutCapacity, outSampleCount, sampleRateOut);
+	}
 
-			if (decoderResult == OpusResult_Success)
+	// Arrival time of a packet, in 48 kHz samples (wraps like the frame timestamps)
+	uint32_t GetArrivalTimestamp()
+	{
+		return static_cast<uint32_t>(nn::os::GetSystemTick().ToTimeSpan().GetMicroSeconds() * SAMPLE_RATE / 1000000);
+	}
+
+	// Store the payload of a sequence number (call this function with jitterMutex locked)
+	bool InsertJitterFrame(JitterBuffer* jitterBuffer, uint16_t sequence, uint32_t timestamp, const unsigned char* payload, int payloadSize, int sampleCount, bool comfortNoise)
+	{
+		if (payloadSize > jitterPayloadSizeMaximum) return false;
+
+		int16_t ahead = static_cast<int16_t>(sequence - jitterBuffer->nextSequence);
+		if (jitterBuffer->packetCount == 0 && !jitterBuffer->playing)
+		{
+			jitterBuffer->nextSequence = sequence;
+			jitterBuffer->newestTimestamp = timestamp + sampleCount;
+			ahead = 0;
+		}
+		else if (ahead < 0)
+		{
+			if (jitterBuffer->playing) return false; // too late, its turn is over
+			jitterBuffer->nextSequence = sequence; // older than everything buffered before playout started
+			ahead = 0;
+		}
+		if (ahead >= JITTER_BUFFER_FRAME_COUNT)
+		{
+			// too far ahead to be the same stream (e.g. the speaker restarted recording)
+			ResetJitterBuffer(jitterBuffer);
+			jitterBuffer->nextSequence = sequence;
+			jitterBuffer->newestTimestamp = timestamp + sampleCount;
+		}
+
+		int index = sequence & (JITTER_BUFFER_FRAME_COUNT - 1);
+		JitterSlot* slot = &jitterBuffer->slots[index];
+		if (slot->filled)
+		{
+			if (slot->sequence == sequence) return true; // duplicate
+			jitterBuffer->packetCount--;
+		}
+		slot->filled = true;
+		slot->sequence = sequence;
+		slot->timestamp = timestamp;
+		slot->payloadSize = payloadSize;
+		slot->comfortNoise = comfortNoise;
+		memcpy(jitterBuffer->payloads + index * jitterPayloadSizeMaximum, payload, payloadSize);
+		jitterBuffer->packetCount++;
+
+		if (static_cast<int32_t>(timestamp + sampleCount - jitterBuffer->newestTimestamp) > 0)
+		{
+			jitterBuffer->newestTimestamp = timestamp + sampleCount;
+		}
+		return true;
+	}
+
+	// Store one frame and update the jitter estimate (call this function with jitterMutex locked)
+	bool PushJitterFrame(JitterBuffer* jitterBuffer, const FrameHeader& header, const unsigned char* payload)
+	{
+		int sampleCount = GetFrameSampleCount(header, payload);
+		if (sampleCount < 0) return false;
+
+		// interarrival jitter as defined by RFC 3550
+		int32_t transit = static_cast<int32_t>(GetArrivalTimestamp() - header.timestamp);
+		if (jitterBuffer->hasTransit)
+		{
+			int32_t difference = transit - jitterBuffer->lastTransit;
+			if (difference < 0) difference = -difference;
+			jitterBuffer->jitter += (difference - jitterBuffer->jitter) / 16;
+		}
+		jitterBuffer->lastTransit = transit;
+		jitterBuffer->hasTransit = true;
+
+		int targetDelay = sampleCount + static_cast<int>(JITTER_DELAY_FACTOR * jitterBuffer->jitter);
+		if (targetDelay > JITTER_TARGET_DELAY_MAX) targetDelay = JITTER_TARGET_DELAY_MAX;
+		jitterBuffer->targetDelay = targetDelay;
+
+		// the redundant copy fills the slot of the previous frame if it was lost (ignored if it is already there or too late)
+		if (header.redundantPayloadSize > 0)
+		{
+			const unsigned char* redundantPayload = payload - header.redundantPayloadSize;
+			int redundantSampleCount = GetOpusPayloadSampleCount(redundantPayload, header.redundantPayloadSize);
+			if (redundantSampleCount > 0)
+			{
+				InsertJitterFrame(jitterBuffer, header.sequence - 1, header.timestamp - redundantSampleCount,
+					redundantPayload, header.redundantPayloadSize, redundantSampleCount, false);
+			}
+		}
+		if (header.flags & FRAME_FLAG_COMFORT_NOISE)
+		{
+			return InsertJitterFrame(jitterBuffer, header.sequence, header.timestamp, &header.audioLevel, 1, 0, true);
+		}
+		return InsertJitterFrame(jitterBuffer, header.sequence, header.timestamp, payload, header.payloadSize, sampleCount, false);
+	}
+
+	// Decode the next frame to the end of pcm (call this function with jitterMutex locked).
+	// Returns false if there is nothing to play, which means the buffer ran dry.
+	bool DecodeNextJitterFrame(DecoderContext* context)
+	{
+		JitterBuffer* jitterBuffer = &context->jitterBuffer;
+		int16_t* pcmEnd = jitterBuffer->pcm + jitterBuffer->pcmCount;
+		int pcmFree = jitterPcmSampleCount - jitterBuffer->pcmCount;
+
+		int index = jitterBuffer->nextSequence & (JITTER_BUFFER_FRAME_COUNT - 1);
+		JitterSlot* slot = &jitterBuffer->slots[index];
+		if (slot->filled && slot->sequence == jitterBuffer->nextSequence)
+		{
+			// a timestamp jump without a sequence jump means the sender stopped sending: play comfort noise over the gap
+			int32_t gap = static_cast<int32_t>(slot->timestamp - jitterBuffer->decodedTimestamp);
+			if (gap > 0)
 			{
-				inputBuffer += partialConsumed;
-				count -= partialConsumed;
-				totalConsumed += partialConsumed;
-				totalOutSampleCount += partialOutSampleCount;
-				outVector->resize(totalOutSampleCount);
-				for (int i = 0; i < partialOutSampleCount; i++)
+				if (gap > pcmFree) gap = pcmFree;
+				GenerateComfortNoise(context, pcmEnd, gap);
+				jitterBuffer->pcmCount += gap;
+				jitterBuffer->decodedTimestamp += gap;
+				return true;
+			}
+
+			int sampleCount = 0;
+			const unsigned char* payload = jitterBuffer->payloads + index * jitterPayloadSizeMaximum;
+			if (slot->comfortNoise)
+			{
+				SetComfortNoiseLevel(context, payload[0]);
+			}
+			else if (!DecodePayload(context, payload, slot->payloadSize, pcmEnd, DecodeOutputFormat_PcmInt16, pcmFree, &sampleCount))
+			{
+				sampleCount = 0;
+			}
+			slot->filled = false;
+			jitterBuffer->packetCount--;
+			jitterBuffer->nextSequence++;
+			jitterBuffer->pcmCount += sampleCount;
+			jitterBuffer->decodedTimestamp = slot->timestamp + sampleCount;
+			if (sampleCount > 0) jitterBuffer->lastFrameSampleCount = sampleCount;
+			return true;
+		}
+
+		if (jitterBuffer->packetCount > 0)
+		{
+			// lost (and not rebuilt from a redundant copy): later frames are already here, so conceal one frame and move on
+			int sampleCount = jitterBuffer->lastFrameSampleCount;
+			if (sampleCount > pcmFree) sampleCount = pcmFree;
+			ConcealFrame(context, pcmEnd, DecodeOutputFormat_PcmInt16, sampleCount);
+			jitterBuffer->nextSequence++;
+			jitterBuffer->pcmCount += sampleCount;
+			jitterBuffer->decodedTimestamp += sampleCount;
+			return true;
+		}
+		return false;
+	}
+
+	// Time-compress two consecutive frames of pcm into the length of the second one: the first fades into the second,
+	// so the result starts where the previous output ended and ends where the next frame starts. Returns the new sample count.
+	int CrossfadeJitterFrames(int16_t* pcm, int firstSampleCount, int secondSampleCount)
+	{
+		int overlap = firstSampleCount < secondSampleCount ? firstSampleCount : secondSampleCount;
+		if (overlap == 0) return firstSampleCount + secondSampleCount;
+		const int16_t* second = pcm + firstSampleCount;
+		for (int i = 0; i < overlap; i++)
+		{
+			float weight = (i + 0.5f) / overlap;
+			pcm[i] = SwitchVoiceChatSimd::SaturateToInt16(pcm[i] + (second[i] - pcm[i]) * weight);
+		}
+		memmove(pcm + overlap, second + overlap, (secondSampleCount - overlap) * sizeof(int16_t));
+		return secondSampleCount;
+	}
+
+	// Produce exactly sampleCount samples of a speaker (silence while buffering).
+	// Returns true if the output contains voice.
+	bool PullSpeakerFrame(intptr_t speakerHandle, void* audioOut, DecodeOutputFormat format, int sampleCount)
+	{
+		size_t sampleSize = format == DecodeOutputFormat_Float ? sizeof(float) : sizeof(int16_t);
+		if (sampleCount > MAX_PULL_SAMPLE_COUNT) return false;
+
+		DecoderContext* context = AcquireDecoderContext(speakerHandle);
+		if (!context)
+		{
+			memset(audioOut, 0, sampleCount * sampleSize);
+			return false;
+		}
+
+		nn::os::LockMutex(&context->jitterMutex);
+		JitterBuffer* jitterBuffer = &context->jitterBuffer;
+		if (!jitterBuffer->playing && jitterBuffer->packetCount > 0)
+		{
+			// start playing once enough audio is buffered to ride out the measured jitter
+			JitterSlot* oldest = &jitterBuffer->slots[jitterBuffer->nextSequence & (JITTER_BUFFER_FRAME_COUNT - 1)];
+			int32_t buffered = static_cast<int32_t>(jitterBuffer->newestTimestamp - oldest->timestamp);
+			if (buffered >= jitterBuffer->targetDelay)
+			{
+				jitterBuffer->playing = true;
+				jitterBuffer->decodedTimestamp = oldest->timestamp;
+			}
+		}
+
+		if (jitterBuffer->playing)
+		{
+			// more latency than the jitter requires: play two frames in the time of the second one to catch up
+			int32_t buffered = static_cast<int32_t>(jitterBuffer->newestTimestamp - jitterBuffer->decodedTimestamp) + jitterBuffer->pcmCount;
+			if (buffered > jitterBuffer->targetDelay + 2 * jitterBuffer->lastFrameSampleCount && jitterBuffer->pcmCount == 0
+				&& 2 * jitterBuffer->lastFrameSampleCount <= jitterPcmSampleCount && DecodeNextJitterFrame(context))
+			{
+				int firstSampleCount = jitterBuffer->pcmCount;
+				if (DecodeNextJitterFrame(context))
 				{
-					outVector->at(totalOutSampleCount - partialOutSampleCount + i) = static_cast<float>(decoderOutBuffer[i]) / 32767;
+					jitterBuffer->pcmCount = CrossfadeJitterFrames(jitterBuffer->pcm, firstSampleCount, jitterBuffer->pcmCount - firstSampleCount);
 				}
 			}
-			else
+
+			RecordVoiceValue(VoiceHistogram_JitterBufferFillMicroSeconds, static_cast<int64_t>(buffered) * 1000000 / SAMPLE_RATE);
+
+			while (jitterBuffer->pcmCount < sampleCount)
+			{
+				if (!DecodeNextJitterFrame(context))
+				{
+					jitterBuffer->playing = false; // ran dry: buffer up to the target delay again
+					CountVoiceEvent(VoiceCounter_JitterBufferUnderruns);
+					break;
+				}
+			}
+		}
+
+		int voiceCount = jitterBuffer->pcmCount < sampleCount ? jitterBuffer->pcmCount : sampleCount;
+		if (format == DecodeOutputFormat_Float)
+		{
+			SwitchVoiceChatSimd::ConvertInt16ToFloat(reinterpret_cast<float*>(audioOut), jitterBuffer->pcm, voiceCount);
+		}
+		else
+		{
+			memcpy(audioOut, jitterBuffer->pcm, voiceCount * sizeof(int16_t));
+		}
+
+		// the rest is comfort noise while the speaker is silent (or buffering), silence otherwise
+		int noiseCount = sampleCount - voiceCount;
+		if (format == DecodeOutputFormat_Float)
+		{
+			GenerateComfortNoise(context, context->outBuffer, noiseCount);
+			SwitchVoiceChatSimd::ConvertInt16ToFloat(reinterpret_cast<float*>(OffsetAudioOut(audioOut, format, voiceCount)), context->outBuffer, noiseCount);
+		}
+		else
+		{
+			GenerateComfortNoise(context, reinterpret_cast<int16_t*>(OffsetAudioOut(audioOut, format, voiceCount)), noiseCount);
+		}
+		jitterBuffer->pcmCount -= voiceCount;
+		memmove(jitterBuffer->pcm, jitterBuffer->pcm + voiceCount, jitterBuffer->pcmCount * sizeof(int16_t));
+
+		nn::os::UnlockMutex(&context->jitterMutex);
+		ReleaseDecoderContext(context);
+		return voiceCount > 0;
+	}
+
+	// Queue received voice data of a speaker (it can hold several frames, in any order) for wntgd_PullSpeakerVoiceFrame
+	extern "C" bool wntgd_PushSpeakerVoiceData(intptr_t speakerHandle, const unsigned char* inputBuffer, int count)
+	{
+		decoderPoolMutex.Lock();
+		DecoderContext* context = FindDecoderContext(speakerHandle);
+		if (context)
+		{
+			context->lastUsed = ++decoderUseCounter; // a speaker that is only pushed and pulled is in use too
+			nn::os::LockMutex(&context->jitterMutex);
+		}
+		decoderPoolMutex.Unlock();
+		if (!context) return false;
+
+		bool result = true;
+		while (count > 0)
+		{
+			FrameHeader header;
+			int headerSize = ReadFrameHeader(inputBuffer, count, &header);
+			if (headerSize < 0)
 			{
 				result = false;
 				break;
 			}
+			if (!PushJitterFrame(&context->jitterBuffer, header, inputBuffer + headerSize)) result = false;
+			inputBuffer += headerSize + header.payloadSize;
+			count -= headerSize + header.payloadSize;
+		}
+		nn::os::UnlockMutex(&context->jitterMutex);
+		return result;
+	}
+
+	// Exactly one tick of audio (sampleCount samples at 48 kHz, at most 60 ms) of a speaker
+	extern "C" bool wntgd_PullSpeakerVoiceFrame(intptr_t speakerHandle, float* audioOut, int sampleCount)
+	{
+		return PullSpeakerFrame(speakerHandle, audioOut, DecodeOutputFormat_Float, sampleCount);
+	}
+
+	extern "C" bool wntgd_PullSpeakerVoiceFramePcm16(intptr_t speakerHandle, int16_t* audioOut, int sampleCount)
+	{
+		return PullSpeakerFrame(speakerHandle, audioOut, DecodeOutputFormat_PcmInt16, sampleCount);
+	}
+
+	// Current jitter estimate and playout delay of a speaker, in microseconds
+	extern "C" bool wntgd_GetSpeakerJitterInfo(intptr_t speakerHandle, int* jitterMicroSeconds, int* targetDelayMicroSeconds)
+	{
+		decoderPoolMutex.Lock();
+		DecoderContext* context = FindDecoderContext(speakerHandle);
+		if (context) nn::os::LockMutex(&context->jitterMutex);
+		decoderPoolMutex.Unlock();
+		if (!context) return false;
+
+		*jitterMicroSeconds = static_cast<int>(context->jitterBuffer.jitter * 1000000 / SAMPLE_RATE);
+		*targetDelayMicroSeconds = static_cast<int>(static_cast<int64_t>(context->jitterBuffer.targetDelay) * 1000000 / SAMPLE_RATE);
+		nn::os::UnlockMutex(&context->jitterMutex);
+		return true;
+	}
+
+	// Take a vector from the recycled ones (only allocates until the steady state is reached)
+	std::vector<float>* AcquireDecompressVector()
+	{
+		std::vector<float>* outVector = nullptr;
+		decompressVectorMutex.Lock();
+		if (recycledDecompressVectorCount > 0)
+		{
+			outVector = recycledDecompressVectors[--recycledDecompressVectorCount];
+		}
+		decompressVectorMutex.Unlock();
+		return outVector ? outVector : new std::vector<float>(0);
+	}
+
+	// Sized by one walk of the frames, then decoded straight into the grown vector
+	extern "C" bool wntgd_DecompressSpeakerVoiceData(intptr_t speakerHandle, intptr_t * handle, unsigned char* inputBuffer, int count, float** audioOut, int* outSampleCount, unsigned int* sampleRateOut)
+	{
+		*sampleRateOut = SAMPLE_RATE;
+		*outSampleCount = 0;
+		std::vector<float>* outVector = AcquireDecompressVector();
+		bool result = false;
+		DecoderContext* context = AcquireDecoderContext(speakerHandle);
+		if (context)
+		{
+			int sampleCount = 0;
+			result = DecodeSpeakerFrames(context, inputBuffer, count, nullptr, DecodeOutputFormat_Float, 0, false, &sampleCount);
+			if (result)
+			{
+				outVector->resize(sampleCount);
+				result = DecodeSpeakerFrames(context, inputBuffer, count, outVector->data(), DecodeOutputFormat_Float, sampleCount, true, outSampleCount);
+			}
+			ReleaseDecoderContext(context);
 		}
+		outVector->resize(*outSampleCount);
 
 		*handle = reinterpret_cast<intptr_t>(outVector);
 		*audioOut = outVector->data();
-		*outSampleCount = totalOutSampleCount;
-		*sampleRateOut = SAMPLE_RATE;
 		return result;
 	}
 
+	extern "C" bool wntgd_DecompressVoiceData(intptr_t * handle, unsigned char* inputBuffer, int count, float** audioOut, int* outSampleCount, unsigned int* sampleRateOut)
+	{
+		return wntgd_DecompressSpeakerVoiceData(defaultDecoderHandle, handle, inputBuffer, count, audioOut, outSampleCount, sampleRateOut);
+	}
+
 	extern "C" bool wntgd_ReleaseDecompressBuffer(intptr_t * handler)
 	{
 		auto outVector = reinterpret_cast<std::vector<float>*>(handler);
+		decompressVectorMutex.Lock();
+		if (recycledDecompressVectorCount < MAX_RECYCLED_DECOMPRESS_VECTOR_COUNT)
+		{
+			recycledDecompressVectors[recycledDecompressVectorCount++] = outVector;
+			outVector = nullptr;
+		}
+		decompressVectorMutex.Unlock();
 		delete outVector;
 		return true;
 	}
@@ -7,12 +7,66 @@
 #include <nn/mem.h>
 #include <nn/os.h>
 #include <nn/nn_Log.h>
+#include "SwitchVoiceChatPacketFormat.h"
+#include "SwitchVoiceChatMemoryNativeCode.h"
 
 
 
 namespace SwitchVoiceChatDecodeNativeCode {
+	const int MAX_DECODER_COUNT = 255; // including the default speaker of wntgd_DecompressVoiceData (handles keep the index in 8 bits)
+
+	enum DecodeOutputFormat
+	{
+		DecodeOutputFormat_Float,
+		DecodeOutputFormat_PcmInt16
+	};
+
+	struct DecoderContext;
+
+	inline void* OffsetAudioOut(void* audioOut, DecodeOutputFormat format, int sampleCount)
+	{
+		size_t sampleSize = format == DecodeOutputFormat_Float ? sizeof(float) : sizeof(int16_t);
+		return reinterpret_cast<unsigned char*>(audioOut) + sampleCount * sampleSize;
+	}
+
+	// Index of the decoder of a handle, -1 if it cannot be one (the handle may still be stale)
+	inline int GetDecoderIndex(intptr_t speakerHandle)
+	{
+		int index = static_cast<int>(speakerHandle & 0xff) - 1;
+		return index >= 0 && index < MAX_DECODER_COUNT ? index : -1;
+	}
+
+	int GetDecodedFrameSampleCountMaximum(int frameDuration);
+	size_t GetDecoderMemorySize(const SwitchVoiceChatMemoryNativeCode::VoiceMemoryBudget& budget);
+	void FreeDecoderContexts();
+	int GetOpusPacketSampleCount(const unsigned char* payload, size_t payloadSize);
+	int GetOpusPayloadSampleCount(const unsigned char* payload, int payloadSize);
+	intptr_t GetDefaultDecoderHandle();
+	DecoderContext* AcquireDecoderContext(intptr_t speakerHandle);
+	DecoderContext* WaitDecoderContext(intptr_t speakerHandle);
+	void ReleaseDecoderContext(DecoderContext* context);
+	bool DecodePayload(DecoderContext* context, const unsigned char* payload, int payloadSize, void* audioOut, DecodeOutputFormat format, int audioOutCapacity, int* outSampleCount);
+	int GetFrameSampleCount(const SwitchVoiceChatPacketFormat::FrameHeader& header, const unsigned char* payload);
+	void SetComfortNoiseLevel(DecoderContext* context, uint8_t audioLevel);
+	void GenerateComfortNoise(DecoderContext* context, int16_t* out, int sampleCount);
+	void ConcealFrame(DecoderContext* context, void* audioOut, DecodeOutputFormat format, int sampleCount);
+	bool DecodeSpeakerFrames(DecoderContext* context, const unsigned char* inputBuffer, int count, void* audioOut, DecodeOutputFormat format, int audioOutCapacity, bool decode, int* outSampleCount);
+	int CrossfadeJitterFrames(int16_t* pcm, int firstSampleCount, int secondSampleCount);
+	bool PullSpeakerFrame(intptr_t speakerHandle, void* audioOut, DecodeOutputFormat format, int sampleCount);
+	bool DecompressInto(intptr_t speakerHandle, const unsigned char* inputBuffer, int count, void* audioOut, DecodeOutputFormat format, int audioOutCapacity, int* outSampleCount, unsigned int* sampleRateOut);
 	extern "C" bool wntgd_InitializeDecoder();
 	extern "C" void wntgd_FinalizeDecoder();
+	extern "C" bool wntgd_CreateSpeakerDecoder(intptr_t * speakerHandle);
+	extern "C" void wntgd_DestroySpeakerDecoder(intptr_t speakerHandle);
+	extern "C" bool wntgd_GetDecompressedSampleCount(const unsigned char* inputBuffer, int count, int* outSampleCount);
+	extern "C" bool wntgd_GetSpeakerDecompressedSampleCount(intptr_t speakerHandle, const unsigned char* inputBuffer, int count, int* outSampleCount);
+	extern "C" bool wntgd_DecompressSpeakerVoiceDataInto(intptr_t speakerHandle, const unsigned char* inputBuffer, int count, float* audioOut, int audioOutCapacity, int* outSampleCount, unsigned int* sampleRateOut);
+	extern "C" bool wntgd_DecompressSpeakerVoiceDataPcm16Into(intptr_t speakerHandle, const unsigned char* inputBuffer, int count, int16_t* audioOut, int audioOutCapacity, int* outSampleCount, unsigned int* sampleRateOut);
+	extern "C" bool wntgd_PushSpeakerVoiceData(intptr_t speakerHandle, const unsigned char* inputBuffer, int count);
+	extern "C" bool wntgd_PullSpeakerVoiceFrame(intptr_t speakerHandle, float* audioOut, int sampleCount);
+	extern "C" bool wntgd_PullSpeakerVoiceFramePcm16(intptr_t speakerHandle, int16_t* audioOut, int sampleCount);
+	extern "C" bool wntgd_GetSpeakerJitterInfo(intptr_t speakerHandle, int* jitterMicroSeconds, int* targetDelayMicroSeconds);
+	extern "C" bool wntgd_DecompressSpeakerVoiceData(intptr_t speakerHandle, intptr_t * handle, unsigned char* inputBuffer, int count, float** audioOut, int* outSampleCount, unsigned int* sampleRateOut);
 	extern "C" bool wntgd_DecompressVoiceData(intptr_t * handle, unsigned char* inputBuffer, int count, float** audioOut, int* outSampleCount, unsigned int* sampleRateOut);
 	extern "C" bool wntgd_ReleaseDecompressBuffer(intptr_t * handler);
 }
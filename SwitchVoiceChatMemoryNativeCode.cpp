@@ -0,0 +1,218 @@
+#include "SwitchVoiceChatMemoryNativeCode.h"
+#include <new>
+#include "SwitchVoiceChatNativeCode.h"
+#include "SwitchVoiceChatDecodeNativeCode.h"
+#include "SwitchVoiceChatMixNativeCode.h"
+
+namespace SwitchVoiceChatMemoryNativeCode {
+	unsigned char* arenaStorage;
+	size_t arenaSize;
+	VoiceMemoryBudget voiceMemoryBudget;
+	VoiceArenaRegion encoderRegions[SwitchVoiceChatNativeCode::MAX_CAPTURE_SESSION_COUNT]; // one per session recording at the same time
+	int encoderRegionCount;
+	VoiceArenaRegion decoderRegion;
+	VoiceArenaRegion mixerRegion;
+	nn::os::Mutex voiceMemoryMutex(false);
+
+	// Returns nullptr if the region is full: the budget is too small for the device or the caller
+	void* AllocateFromRegion(VoiceArenaRegion* region, size_t size, size_t alignment)
+	{
+		size_t start = (region->used.load(std::memory_order_relaxed) + alignment - 1) / alignment * alignment;
+		if (!region->base || start + size > region->size) return nullptr;
+		region->used.store(start + size, std::memory_order_relaxed);
+		return region->base + start;
+	}
+
+	// Give a region back to the arena, everything allocated from it is freed at once
+	void ReleaseRegion(VoiceArenaRegion* region)
+	{
+		voiceMemoryMutex.Lock();
+		region->used.store(0, std::memory_order_relaxed);
+		region->acquired = false;
+		voiceMemoryMutex.Unlock();
+	}
+
+	// Call this function with voiceMemoryMutex locked
+	bool IsAnyRegionAcquired()
+	{
+		bool result = decoderRegion.acquired || mixerRegion.acquired;
+		for (int i = 0; i < encoderRegionCount; i++)
+		{
+			if (encoderRegions[i].acquired) result = true;
+		}
+		return result;
+	}
+
+	int GetBudgetValue(int value, int defaultValue)
+	{
+		return value > 0 ? value : defaultValue;
+	}
+
+	// Free the arena (call this function with voiceMemoryMutex locked, and no region acquired)
+	void ReleaseVoiceMemory()
+	{
+		delete[] arenaStorage;
+		arenaStorage = nullptr;
+		arenaSize = 0;
+		for (int i = 0; i < encoderRegionCount; i++)
+		{
+			encoderRegions[i].base = nullptr;
+			encoderRegions[i].size = 0;
+		}
+		encoderRegionCount = 0;
+		decoderRegion.base = nullptr;
+		decoderRegion.size = 0;
+		mixerRegion.base = nullptr;
+		mixerRegion.size = 0;
+	}
+
+	// Reserve the arena for a budget (call this function with voiceMemoryMutex locked, and no region acquired)
+	bool ReserveVoiceMemory(const VoiceMemoryBudget& budget)
+	{
+		ReleaseVoiceMemory();
+		voiceMemoryBudget.maxSpeakerCount = GetBudgetValue(budget.maxSpeakerCount, VOICE_MEMORY_SPEAKER_COUNT_DEFAULT);
+		if (voiceMemoryBudget.maxSpeakerCount > SwitchVoiceChatDecodeNativeCode::MAX_DECODER_COUNT - 1)
+		{
+			voiceMemoryBudget.maxSpeakerCount = SwitchVoiceChatDecodeNativeCode::MAX_DECODER_COUNT - 1;
+		}
+		voiceMemoryBudget.maxFrameDurationMicroSeconds = GetBudgetValue(budget.maxFrameDurationMicroSeconds, VOICE_MEMORY_FRAME_DURATION_DEFAULT);
+		voiceMemoryBudget.maxPayloadSize = GetBudgetValue(budget.maxPayloadSize, VOICE_MEMORY_PAYLOAD_SIZE_DEFAULT);
+		voiceMemoryBudget.captureRingMilis = GetBudgetValue(budget.captureRingMilis, VOICE_MEMORY_CAPTURE_RING_MILIS_DEFAULT);
+		voiceMemoryBudget.maxCaptureBufferSize = GetBudgetValue(budget.maxCaptureBufferSize, VOICE_MEMORY_CAPTURE_BUFFER_SIZE_DEFAULT);
+		voiceMemoryBudget.maxCaptureSessionCount = GetBudgetValue(budget.maxCaptureSessionCount, VOICE_MEMORY_CAPTURE_SESSION_COUNT_DEFAULT);
+		if (voiceMemoryBudget.maxCaptureSessionCount > SwitchVoiceChatNativeCode::MAX_CAPTURE_SESSION_COUNT)
+		{
+			voiceMemoryBudget.maxCaptureSessionCount = SwitchVoiceChatNativeCode::MAX_CAPTURE_SESSION_COUNT;
+		}
+		voiceMemoryBudget.decodeThreadCount = budget.decodeThreadCount > 0 ? budget.decodeThreadCount : 0;
+
+		size_t sessionSize = nn::util::align_up(SwitchVoiceChatNativeCode::GetEncoderMemorySize(voiceMemoryBudget), VOICE_ARENA_ALIGNMENT);
+		size_t encoderSize = sessionSize * voiceMemoryBudget.maxCaptureSessionCount;
+		size_t decoderSize = nn::util::align_up(SwitchVoiceChatDecodeNativeCode::GetDecoderMemorySize(voiceMemoryBudget), VOICE_ARENA_ALIGNMENT);
+		size_t mixerSize = nn::util::align_up(SwitchVoiceChatMixNativeCode::GetMixerMemorySize(), VOICE_ARENA_ALIGNMENT);
+		arenaSize = encoderSize + decoderSize + mixerSize;
+		arenaStorage = new (std::nothrow) unsigned char[arenaSize + VOICE_ARENA_ALIGNMENT]();
+		if (!arenaStorage)
+		{
+			arenaSize = 0;
+			return false;
+		}
+
+		unsigned char* base = reinterpret_cast<unsigned char*>(nn::util::align_up(reinterpret_cast<uintptr_t>(arenaStorage), VOICE_ARENA_ALIGNMENT));
+		encoderRegionCount = voiceMemoryBudget.maxCaptureSessionCount;
+		for (int i = 0; i < encoderRegionCount; i++)
+		{
+			encoderRegions[i].base = base + i * sessionSize;
+			encoderRegions[i].size = sessionSize;
+			encoderRegions[i].used.store(0, std::memory_order_relaxed);
+		}
+		decoderRegion.base = base + encoderSize;
+		decoderRegion.size = decoderSize;
+		decoderRegion.used.store(0, std::memory_order_relaxed);
+		mixerRegion.base = base + encoderSize + decoderSize;
+		mixerRegion.size = mixerSize;
+		mixerRegion.used.store(0, std::memory_order_relaxed);
+		NN_LOG("Voice memory: %u bytes (encoder %u for %d sessions, decoder %u for %d speakers, mixer %u)\n", static_cast<unsigned>(arenaSize),
+			static_cast<unsigned>(encoderSize), encoderRegionCount, static_cast<unsigned>(decoderSize), voiceMemoryBudget.maxSpeakerCount,
+			static_cast<unsigned>(mixerSize));
+		return true;
+	}
+
+	// Reserve the default budget if the caller did not declare one (call this function with voiceMemoryMutex locked)
+	bool ReserveDefaultVoiceMemory()
+	{
+		if (arenaStorage) return true;
+		VoiceMemoryBudget budget = {};
+		return ReserveVoiceMemory(budget);
+	}
+
+	// Take a region for its owner (call this function with voiceMemoryMutex locked). Returns false if it is already in use.
+	bool AcquireRegion(VoiceArenaRegion* region)
+	{
+		if (region->acquired) return false;
+		region->used.store(0, std::memory_order_relaxed);
+		region->acquired = true;
+		return true;
+	}
+
+	// The region of one capture session, nullptr if the budget declares fewer sessions than are recording
+	VoiceArenaRegion* AcquireEncoderRegion()
+	{
+		VoiceArenaRegion* region = nullptr;
+		voiceMemoryMutex.Lock();
+		if (ReserveDefaultVoiceMemory())
+		{
+			for (int i = 0; i < encoderRegionCount && !region; i++)
+			{
+				if (AcquireRegion(&encoderRegions[i])) region = &encoderRegions[i];
+			}
+		}
+		voiceMemoryMutex.Unlock();
+		return region;
+	}
+
+	VoiceArenaRegion* AcquireDecoderRegion()
+	{
+		voiceMemoryMutex.Lock();
+		bool result = ReserveDefaultVoiceMemory() && AcquireRegion(&decoderRegion);
+		voiceMemoryMutex.Unlock();
+		return result ? &decoderRegion : nullptr;
+	}
+
+	VoiceArenaRegion* AcquireMixerRegion()
+	{
+		voiceMemoryMutex.Lock();
+		bool result = ReserveDefaultVoiceMemory() && AcquireRegion(&mixerRegion);
+		voiceMemoryMutex.Unlock();
+		return result ? &mixerRegion : nullptr;
+	}
+
+	// Only valid once a region was acquired
+	const VoiceMemoryBudget& GetVoiceMemoryBudget()
+	{
+		return voiceMemoryBudget;
+	}
+
+	// Declare the budget (nullptr for the default one) before starting the encoder, the decoder or the playback.
+	// Returns false if any of them is running.
+	extern "C" bool wntgd_InitializeVoiceMemory(const VoiceMemoryBudget* budget)
+	{
+		VoiceMemoryBudget defaultBudget = {};
+		voiceMemoryMutex.Lock();
+		bool result = !IsAnyRegionAcquired();
+		if (result) result = ReserveVoiceMemory(budget ? *budget : defaultBudget);
+		voiceMemoryMutex.Unlock();
+		return result;
+	}
+
+	// Give the arena back (returns false if the encoder, the decoder or the playback is running)
+	extern "C" bool wntgd_FinalizeVoiceMemory()
+	{
+		voiceMemoryMutex.Lock();
+		bool result = !IsAnyRegionAcquired();
+		if (result) ReleaseVoiceMemory();
+		voiceMemoryMutex.Unlock();
+		return result;
+	}
+
+	// footprintSize is sizeof(VoiceMemoryFootprint) of the caller
+	extern "C" bool wntgd_GetVoiceMemoryFootprint(VoiceMemoryFootprint* footprint, int footprintSize)
+	{
+		if (!footprint || footprintSize != static_cast<int>(sizeof(VoiceMemoryFootprint))) return false;
+		voiceMemoryMutex.Lock();
+		footprint->reservedSize = static_cast<uint32_t>(arenaSize);
+		footprint->encoderReservedSize = 0;
+		footprint->encoderUsedSize = 0;
+		for (int i = 0; i < encoderRegionCount; i++)
+		{
+			footprint->encoderReservedSize += static_cast<uint32_t>(encoderRegions[i].size);
+			footprint->encoderUsedSize += static_cast<uint32_t>(encoderRegions[i].used.load(std::memory_order_relaxed));
+		}
+		footprint->decoderReservedSize = static_cast<uint32_t>(decoderRegion.size);
+		footprint->decoderUsedSize = static_cast<uint32_t>(decoderRegion.used.load(std::memory_order_relaxed));
+		footprint->mixerReservedSize = static_cast<uint32_t>(mixerRegion.size);
+		footprint->mixerUsedSize = static_cast<uint32_t>(mixerRegion.used.load(std::memory_order_relaxed));
+		voiceMemoryMutex.Unlock();
+		return true;
+	}
+}
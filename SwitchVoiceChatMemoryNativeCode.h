@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include <cstdlib>
+#include <atomic>
+#include <nn/os.h>
+#include <nn/nn_Log.h>
+
+
+
+// Every encoder, decoder and mixer buffer lives in one arena, reserved once from a budget declared by the caller.
+// The arena is split into one encoder region per capture session, a decoder region and a mixer region; each one is a bump
+// allocator that is reset as a whole when its owner stops, so starting and stopping never fragments or allocates.
+// wntgd_InitializeVoiceMemory is optional: the first wntgd_InitializeDecoder, wntgd_StartRecordVoice or wntgd_StartVoicePlayback
+// reserves the default budget.
+namespace SwitchVoiceChatMemoryNativeCode {
+	const size_t VOICE_ARENA_ALIGNMENT = 4096; // the largest alignment asked for (thread stacks, AudioIn buffers)
+	const int VOICE_MEMORY_SPEAKER_COUNT_DEFAULT = 15;
+	const int VOICE_MEMORY_FRAME_DURATION_DEFAULT = 20000; // microseconds, the longest frame of the encoder profiles
+	const int VOICE_MEMORY_PAYLOAD_SIZE_DEFAULT = 256; // about 100 kbps at 20 ms
+	const int VOICE_MEMORY_CAPTURE_RING_MILIS_DEFAULT = 250;
+	const int VOICE_MEMORY_CAPTURE_SESSION_COUNT_DEFAULT = 1;
+	const int VOICE_MEMORY_CAPTURE_BUFFER_SIZE_DEFAULT = 48000 * 50 / 1000 * 6 * sizeof(float); // 50 ms of a 48 kHz microphone in the largest layout GetCaptureConvertFunction accepts (6 channels of 4 bytes)
+
+	// Fields <= 0 take the default
+	struct VoiceMemoryBudget
+	{
+		int maxSpeakerCount; // remote speakers decoded at the same time (the default speaker is added to it)
+		int maxFrameDurationMicroSeconds; // longest received Opus frame, longer ones fail to decode (every output format)
+		int maxPayloadSize; // bytes of the largest Opus payload (nn::codec header included), sent or received
+		int captureRingMilis; // depth of the ring between the capture and the encoder threads
+		int maxCaptureBufferSize; // bytes of one AudioIn buffer
+		int maxCaptureSessionCount; // capture sessions recording at the same time, the default one included
+		int decodeThreadCount; // worker threads of wntgd_DecompressVoiceBatch (0: the calling thread decodes alone)
+	};
+
+	// Returned by wntgd_GetVoiceMemoryFootprint, in bytes
+	struct VoiceMemoryFootprint
+	{
+		uint32_t reservedSize; // the whole arena
+		uint32_t encoderReservedSize; // of all the capture sessions
+		uint32_t encoderUsedSize; // 0 while no session records
+		uint32_t decoderReservedSize;
+		uint32_t decoderUsedSize; // 0 while the decoder is not initialized
+		uint32_t mixerReservedSize;
+		uint32_t mixerUsedSize; // 0 while the playback is stopped
+	};
+
+	struct VoiceArenaRegion
+	{
+		unsigned char* base;
+		size_t size;
+		std::atomic<size_t> used; // written by the owner, read by wntgd_GetVoiceMemoryFootprint
+		bool acquired; // between AcquireRegion and ReleaseRegion
+	};
+
+	// Grow size by one allocation placed like AllocateFromRegion places it, to compute the size of a region
+	inline void AddRegionAllocation(size_t* size, size_t allocationSize, size_t alignment)
+	{
+		*size = (*size + alignment - 1) / alignment * alignment + allocationSize;
+	}
+
+	void* AllocateFromRegion(VoiceArenaRegion* region, size_t size, size_t alignment);
+	void ReleaseRegion(VoiceArenaRegion* region);
+	bool IsAnyRegionAcquired();
+	int GetBudgetValue(int value, int defaultValue);
+	void ReleaseVoiceMemory();
+	bool ReserveVoiceMemory(const VoiceMemoryBudget& budget);
+	bool ReserveDefaultVoiceMemory();
+	bool AcquireRegion(VoiceArenaRegion* region);
+	VoiceArenaRegion* AcquireEncoderRegion();
+	VoiceArenaRegion* AcquireDecoderRegion();
+	VoiceArenaRegion* AcquireMixerRegion();
+	const VoiceMemoryBudget& GetVoiceMemoryBudget();
+	extern "C" bool wntgd_InitializeVoiceMemory(const VoiceMemoryBudget* budget);
+	extern "C" bool wntgd_FinalizeVoiceMemory();
+	extern "C" bool wntgd_GetVoiceMemoryFootprint(VoiceMemoryFootprint* footprint, int footprintSize);
+}
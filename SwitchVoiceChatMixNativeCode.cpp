@@ -0,0 +1,523 @@
+#include "SwitchVoiceChatMixNativeCode.h"
+#include "SwitchVoiceChatDecodeNativeCode.h"
+#include "SwitchVoiceChatSimd.h"
+#include "SwitchVoiceChatResampler.h"
+#include "SwitchVoiceChatStatsNativeCode.h"
+#include "SwitchVoiceChatMemoryNativeCode.h"
+
+namespace SwitchVoiceChatMixNativeCode {
+	using namespace nn::audio;
+	using namespace SwitchVoiceChatDecodeNativeCode;
+	using namespace SwitchVoiceChatResampler;
+	using namespace SwitchVoiceChatStatsNativeCode;
+	using namespace SwitchVoiceChatMemoryNativeCode;
+	const ResamplerQuality PLAYBACK_RESAMPLER_QUALITY = ResamplerQuality_Fast;
+	const int AUDIO_OUT_BUFFER_COUNT = 4;
+	const size_t PLAYBACK_THREAD_STACK_SIZE = 16 * 1024;
+	const float DISTANCE_REFERENCE = 1; // no attenuation closer than this
+	const float DISTANCE_ROLLOFF = 1;
+	const float DISTANCE_MAX = 50; // no more attenuation farther than this
+	const float PI = 3.14159265f;
+
+	// 5.1 channels (FL FR FC LFE RL RR) around the listener by increasing azimuth, the LFE is never panned to
+	const int SURROUND_RING_COUNT = 5;
+	const int SURROUND_RING_CHANNELS[SURROUND_RING_COUNT] = { 2, 1, 5, 4, 0 };
+	const float SURROUND_RING_AZIMUTHS[SURROUND_RING_COUNT + 1] = { 0, 30, 110, 250, 330, 360 };
+
+	AudioOut audioOut;
+	nn::os::SystemEvent audioOutEvent;
+	AudioOutBuffer audioOutBuffers[AUDIO_OUT_BUFFER_COUNT];
+	void* audioBuffers[AUDIO_OUT_BUFFER_COUNT];
+	VoiceArenaRegion* mixerRegion; // every buffer below comes from it, nullptr while not playing
+
+	// the playback thread refills every released buffer with the mix of the speakers
+	nn::os::ThreadType playbackThread;
+	void* playbackThreadStack;
+	std::atomic<bool> isPlaying;
+	nn::os::Mutex playbackMutex(false); // serializes wntgd_StartVoicePlayback and wntgd_StopVoicePlayback
+
+	// speakers are added and removed by the game, the playback thread takes a copy of the list for every frame
+	MixerSpeaker mixerSpeakers[MAX_MIXER_SPEAKER_COUNT];
+	nn::os::Mutex mixerMutex(false);
+
+	// gains applied to each speaker slot in the last buffer, the next one ramps from them (only used by the playback thread)
+	intptr_t appliedSpeakerHandles[MAX_MIXER_SPEAKER_COUNT];
+	float appliedChannelGains[MAX_MIXER_SPEAKER_COUNT][AUDIO_OUT_CHANNEL_COUNT_MAX];
+
+	// one buffer of one speaker, and the sum of all of them per channel (in the int16 scale, so it can go over the int16 range)
+	int16_t* speakerBuffer;
+	float* mixBuffers[AUDIO_OUT_CHANNEL_COUNT_MAX];
+
+	// if the device is not at MIX_SAMPLE_RATE every channel of the mix is converted, the samples left over wait for the next buffer
+	ResamplerFilter* outputResamplerFilter;
+	ResamplerState* outputResamplerStates[AUDIO_OUT_CHANNEL_COUNT_MAX];
+	int16_t* resampledBuffers[AUDIO_OUT_CHANNEL_COUNT_MAX];
+	int resampledBufferSize;
+	int resampledCount;
+
+	int playbackChannelCount = 2;
+	int channelCount = 0;
+	int frameSampleCount = 0; // of the mix
+	int outputSampleRate = 0;
+	int outputFrameSampleCount = 0; // of one AudioOut buffer
+
+	int GetResampledBufferSize(int rate)
+	{
+		int mixFrameSampleCount = MIX_SAMPLE_RATE * BUFFER_LENGTH_MILIS / 1000;
+		return rate * BUFFER_LENGTH_MILIS / 1000 + mixFrameSampleCount * rate / MIX_SAMPLE_RATE + 4;
+	}
+
+	// Upper bound of what AllocateBuffers takes from the mixer region, for any int16 device up to
+	// AUDIO_OUT_CHANNEL_COUNT_MAX channels at AUDIO_OUT_SAMPLE_RATE_MAX (same order as the allocations)
+	size_t GetMixerMemorySize()
+	{
+		size_t size = 0;
+		size_t dataSize = AUDIO_OUT_SAMPLE_RATE_MAX * BUFFER_LENGTH_MILIS / 1000 * AUDIO_OUT_CHANNEL_COUNT_MAX * sizeof(int16_t);
+		size_t audioBufferSize = nn::util::align_up(dataSize, AudioOutBuffer::SizeGranularity);
+		int mixFrameSampleCount = MIX_SAMPLE_RATE * BUFFER_LENGTH_MILIS / 1000;
+		for (int i = 0; i < AUDIO_OUT_BUFFER_COUNT; i++)
+		{
+			AddRegionAllocation(&size, audioBufferSize, AudioOutBuffer::AddressAlignment);
+		}
+		AddRegionAllocation(&size, PLAYBACK_THREAD_STACK_SIZE, nn::os::ThreadStackAlignment);
+		AddRegionAllocation(&size, mixFrameSampleCount * sizeof(int16_t), sizeof(float));
+		for (int channel = 0; channel < AUDIO_OUT_CHANNEL_COUNT_MAX; channel++)
+		{
+			AddRegionAllocation(&size, mixFrameSampleCount * sizeof(float), sizeof(float));
+		}
+		AddRegionAllocation(&size, sizeof(ResamplerFilter), sizeof(float));
+		for (int channel = 0; channel < AUDIO_OUT_CHANNEL_COUNT_MAX; channel++)
+		{
+			AddRegionAllocation(&size, sizeof(ResamplerState), sizeof(float));
+			AddRegionAllocation(&size, GetResampledBufferSize(AUDIO_OUT_SAMPLE_RATE_MAX) * sizeof(int16_t), sizeof(float));
+		}
+		return size;
+	}
+
+	bool AllocateBuffers()
+	{
+		channelCount = GetAudioOutChannelCount(&audioOut);
+		outputSampleRate = GetAudioOutSampleRate(&audioOut);
+		SampleFormat sampleFormat = GetAudioOutSampleFormat(&audioOut);
+
+		frameSampleCount = MIX_SAMPLE_RATE * BUFFER_LENGTH_MILIS / 1000;
+		outputFrameSampleCount = outputSampleRate * BUFFER_LENGTH_MILIS / 1000;
+		size_t dataSize = outputFrameSampleCount * channelCount * GetSampleByteSize(sampleFormat);
+		size_t audioBufferSize = nn::util::align_up(dataSize, AudioOutBuffer::SizeGranularity);
+
+		bool needResampler = outputSampleRate != MIX_SAMPLE_RATE;
+		resampledBufferSize = GetResampledBufferSize(outputSampleRate);
+		if (outputSampleRate > AUDIO_OUT_SAMPLE_RATE_MAX)
+		{
+			NN_LOG("Unsupported AudioOut sample rate %d\n", outputSampleRate);
+			return false;
+		}
+		mixerRegion = AcquireMixerRegion();
+		if (!mixerRegion) return false;
+
+		// same order as GetMixerMemorySize
+		bool result = true;
+		for (int i = 0; i < AUDIO_OUT_BUFFER_COUNT; i++)
+		{
+			audioBuffers[i] = AllocateFromRegion(mixerRegion, audioBufferSize, AudioOutBuffer::AddressAlignment);
+			if (audioBuffers[i])
+			{
+				SetAudioOutBufferInfo(&audioOutBuffers[i], audioBuffers[i], audioBufferSize, dataSize);
+			}
+			else result = false;
+		}
+		playbackThreadStack = AllocateFromRegion(mixerRegion, PLAYBACK_THREAD_STACK_SIZE, nn::os::ThreadStackAlignment);
+		speakerBuffer = reinterpret_cast<int16_t*>(AllocateFromRegion(mixerRegion, frameSampleCount * sizeof(int16_t), sizeof(float)));
+		if (!playbackThreadStack || !speakerBuffer) result = false;
+		for (int channel = 0; channel < channelCount; channel++)
+		{
+			mixBuffers[channel] = reinterpret_cast<float*>(AllocateFromRegion(mixerRegion, frameSampleCount * sizeof(float), sizeof(float)));
+			if (!mixBuffers[channel]) result = false;
+		}
+		for (int i = 0; i < MAX_MIXER_SPEAKER_COUNT; i++)
+		{
+			appliedSpeakerHandles[i] = 0;
+		}
+
+		resampledCount = 0;
+		if (needResampler)
+		{
+			outputResamplerFilter = reinterpret_cast<ResamplerFilter*>(AllocateFromRegion(mixerRegion, sizeof(ResamplerFilter), sizeof(float)));
+			if (outputResamplerFilter) InitializeResamplerFilter(outputResamplerFilter, MIX_SAMPLE_RATE, outputSampleRate, PLAYBACK_RESAMPLER_QUALITY);
+			else result = false;
+			for (int channel = 0; channel < channelCount; channel++)
+			{
+				outputResamplerStates[channel] = reinterpret_cast<ResamplerState*>(AllocateFromRegion(mixerRegion, sizeof(ResamplerState), sizeof(float)));
+				resampledBuffers[channel] = reinterpret_cast<int16_t*>(AllocateFromRegion(mixerRegion, resampledBufferSize * sizeof(int16_t), sizeof(float)));
+				if (outputResamplerStates[channel]) ClearResamplerState(outputResamplerStates[channel]);
+				if (!outputResamplerStates[channel] || !resampledBuffers[channel]) result = false;
+			}
+		}
+
+		if (!result) FreeBuffers();
+		return result;
+	}
+
+	// Everything comes from the mixer region, so it is released as a whole
+	void FreeBuffers()
+	{
+		for (int i = 0; i < AUDIO_OUT_BUFFER_COUNT; i++)
+		{
+			audioBuffers[i] = nullptr;
+		}
+		for (int channel = 0; channel < AUDIO_OUT_CHANNEL_COUNT_MAX; channel++)
+		{
+			mixBuffers[channel] = nullptr;
+			outputResamplerStates[channel] = nullptr;
+			resampledBuffers[channel] = nullptr;
+		}
+		outputResamplerFilter = nullptr;
+		playbackThreadStack = nullptr;
+		speakerBuffer = nullptr;
+		if (mixerRegion) ReleaseRegion(mixerRegion);
+		mixerRegion = nullptr;
+	}
+
+	// Inverse distance law, clamped between DISTANCE_REFERENCE and DISTANCE_MAX
+	float GetDistanceAttenuation(float distance)
+	{
+		if (distance <= DISTANCE_REFERENCE) return 1;
+		if (distance > DISTANCE_MAX) distance = DISTANCE_MAX;
+		return DISTANCE_REFERENCE / (DISTANCE_REFERENCE + DISTANCE_ROLLOFF * (distance - DISTANCE_REFERENCE));
+	}
+
+	// Gain of a speaker on every output channel. A voice is panned between the two channels around it (constant power),
+	// so at most two channels are not 0 whatever the layout.
+	void ComputeSpeakerChannelGains(const MixerSpeaker& speaker, float* gains)
+	{
+		float gain = speaker.gain * GetDistanceAttenuation(speaker.distance);
+		for (int channel = 0; channel < channelCount; channel++)
+		{
+			gains[channel] = 0;
+		}
+		if (channelCount == 1)
+		{
+			gains[0] = gain;
+			return;
+		}
+
+		float azimuth = fmodf(speaker.azimuth, 360);
+		if (azimuth < 0) azimuth += 360;
+		int firstChannel, secondChannel;
+		float position;
+		if (channelCount == AUDIO_OUT_CHANNEL_COUNT_MAX)
+		{
+			int ring = 0;
+			while (azimuth >= SURROUND_RING_AZIMUTHS[ring + 1]) ring++;
+			firstChannel = SURROUND_RING_CHANNELS[ring];
+			secondChannel = SURROUND_RING_CHANNELS[(ring + 1) % SURROUND_RING_COUNT];
+			position = (azimuth - SURROUND_RING_AZIMUTHS[ring]) / (SURROUND_RING_AZIMUTHS[ring + 1] - SURROUND_RING_AZIMUTHS[ring]);
+		}
+		else
+		{
+			// stereo (and the first two channels of other layouts): a voice behind is heard from the mirrored front position
+			if (azimuth > 180) azimuth -= 360;
+			if (azimuth > 90) azimuth = 180 - azimuth;
+			if (azimuth < -90) azimuth = -180 - azimuth;
+			firstChannel = 0;
+			secondChannel = 1;
+			position = (azimuth + 90) / 180;
+		}
+		gains[firstChannel] = gain * cosf(position * PI / 2);
+		gains[secondChannel] = gain * sinf(position * PI / 2);
+	}
+
+	// Mix one buffer (frameSampleCount samples) of every speaker into mixBuffers
+	void MixSpeakers()
+	{
+		MixerSpeaker speakers[MAX_MIXER_SPEAKER_COUNT];
+		mixerMutex.Lock();
+		for (int i = 0; i < MAX_MIXER_SPEAKER_COUNT; i++)
+		{
+			speakers[i] = mixerSpeakers[i];
+		}
+		mixerMutex.Unlock();
+
+		for (int channel = 0; channel < channelCount; channel++)
+		{
+			memset(mixBuffers[channel], 0, frameSampleCount * sizeof(float));
+		}
+		for (int i = 0; i < MAX_MIXER_SPEAKER_COUNT; i++)
+		{
+			float* appliedGains = appliedChannelGains[i];
+			if (speakers[i].speakerHandle != appliedSpeakerHandles[i])
+			{
+				// a new speaker in this slot fades in
+				for (int channel = 0; channel < channelCount; channel++)
+				{
+					appliedGains[channel] = 0;
+				}
+				appliedSpeakerHandles[i] = speakers[i].speakerHandle;
+			}
+			if (!speakers[i].speakerHandle) continue;
+
+			// a speaker without voice still gives its comfort noise (or silence if it is buffering or gone)
+			PullSpeakerFrame(speakers[i].speakerHandle, speakerBuffer, DecodeOutputFormat_PcmInt16, frameSampleCount);
+
+			// the gains move from the last buffer to this one over the buffer, only on the (at most four) channels involved
+			float gains[AUDIO_OUT_CHANNEL_COUNT_MAX];
+			ComputeSpeakerChannelGains(speakers[i], gains);
+			for (int channel = 0; channel < channelCount; channel++)
+			{
+				if (gains[channel] == appliedGains[channel])
+				{
+					if (gains[channel] != 0) SwitchVoiceChatSimd::MultiplyAccumulateInt16(mixBuffers[channel], speakerBuffer, gains[channel], frameSampleCount);
+				}
+				else
+				{
+					float gainStep = (gains[channel] - appliedGains[channel]) / frameSampleCount;
+					SwitchVoiceChatSimd::MultiplyAccumulateInt16Ramp(mixBuffers[channel], speakerBuffer, appliedGains[channel], gainStep, frameSampleCount);
+					appliedGains[channel] = gains[channel];
+				}
+			}
+		}
+
+	}
+
+	// Fill one AudioOut buffer (interleaved, channelCount channels)
+	void MixFrame(int16_t* out)
+	{
+		if (!outputResamplerFilter)
+		{
+			MixSpeakers();
+			SwitchVoiceChatSimd::InterleaveSaturateToInt16(out, mixBuffers, channelCount, frameSampleCount);
+			return;
+		}
+
+		while (resampledCount < outputFrameSampleCount)
+		{
+			MixSpeakers();
+			int count = 0;
+			for (int channel = 0; channel < channelCount; channel++)
+			{
+				// speakerBuffer is free again once the speakers are mixed
+				SwitchVoiceChatSimd::InterleaveSaturateToInt16(speakerBuffer, &mixBuffers[channel], 1, frameSampleCount);
+				count = Resample(outputResamplerFilter, outputResamplerStates[channel], speakerBuffer, frameSampleCount,
+					resampledBuffers[channel] + resampledCount, resampledBufferSize - resampledCount);
+			}
+			if (count < 0)
+			{
+				// cannot happen with buffers of GetResampledBufferSize: play silence rather than stale samples
+				memset(out, 0, outputFrameSampleCount * channelCount * sizeof(int16_t));
+				return;
+			}
+			resampledCount += count; // the same for every channel, their states move together
+		}
+
+		for (int i = 0; i < outputFrameSampleCount; i++)
+		{
+			for (int channel = 0; channel < channelCount; channel++)
+			{
+				out[i * channelCount + channel] = resampledBuffers[channel][i];
+			}
+		}
+		resampledCount -= outputFrameSampleCount;
+		for (int channel = 0; channel < channelCount; channel++)
+		{
+			memmove(resampledBuffers[channel], resampledBuffers[channel] + outputFrameSampleCount, resampledCount * sizeof(int16_t));
+		}
+	}
+
+	void PlaybackThreadFunction(void* arg)
+	{
+		NN_UNUSED(arg);
+		while (isPlaying.load(std::memory_order_acquire))
+		{
+			// wake up at least once per buffer, so a stop request is never missed
+			audioOutEvent.TimedWait(nn::TimeSpan::FromMilliSeconds(BUFFER_LENGTH_MILIS));
+
+			int bufferCount = 0;
+			AudioOutBuffer* releasedBuffer = GetReleasedAudioOutBuffer(&audioOut);
+			while (releasedBuffer)
+			{
+				MixFrame(reinterpret_cast<int16_t*>(GetAudioOutBufferDataPointer(releasedBuffer)));
+				AppendAudioOutBuffer(&audioOut, releasedBuffer);
+				releasedBuffer = GetReleasedAudioOutBuffer(&audioOut);
+				bufferCount++;
+			}
+			if (bufferCount > 0) CountVoiceEvent(VoiceCounter_MixedBuffers, bufferCount);
+			if (bufferCount >= AUDIO_OUT_BUFFER_COUNT) CountVoiceEvent(VoiceCounter_AudioOutUnderruns);
+		}
+	}
+
+	// Open the AudioOut device and prepare the mix. Nothing is mixed until MixFrame is called
+	// (by the playback thread, or directly by a benchmark).
+	bool OpenPlayback()
+	{
+		AudioOutParameter param;
+		InitializeAudioOutParameter(&param);
+		param.sampleRate = MIX_SAMPLE_RATE;
+		param.channelCount = playbackChannelCount;
+
+		if (!OpenDefaultAudioOut(&audioOut, &audioOutEvent, param).IsSuccess())
+		{
+			// the device does not support this rate (the mix is converted to its default one), or this many channels
+			param.sampleRate = 0;
+			if (!OpenDefaultAudioOut(&audioOut, &audioOutEvent, param).IsSuccess())
+			{
+				param.channelCount = 0;
+				if (!OpenDefaultAudioOut(&audioOut, &audioOutEvent, param).IsSuccess()) return false;
+			}
+		}
+		if (GetAudioOutSampleFormat(&audioOut) != SampleFormat_PcmInt16 || GetAudioOutChannelCount(&audioOut) > AUDIO_OUT_CHANNEL_COUNT_MAX)
+		{
+			NN_LOG("Unsupported AudioOut format\n");
+			CloseAudioOut(&audioOut);
+			nn::os::DestroySystemEvent(audioOutEvent.GetBase());
+			return false;
+		}
+
+		if (!AllocateBuffers())
+		{
+			CloseAudioOut(&audioOut);
+			nn::os::DestroySystemEvent(audioOutEvent.GetBase());
+			return false;
+		}
+
+		// start on silence, the playback thread mixes from the first released buffer on
+		for (int i = 0; i < AUDIO_OUT_BUFFER_COUNT; i++)
+		{
+			AppendAudioOutBuffer(&audioOut, &audioOutBuffers[i]);
+		}
+
+		if (!StartAudioOut(&audioOut).IsSuccess())
+		{
+			CloseAudioOut(&audioOut);
+			nn::os::DestroySystemEvent(audioOutEvent.GetBase());
+			FreeBuffers();
+			return false;
+		}
+		return true;
+	}
+
+	// Undo OpenPlayback (the playback thread must be stopped)
+	void ClosePlayback()
+	{
+		StopAudioOut(&audioOut);
+		CloseAudioOut(&audioOut);
+		nn::os::DestroySystemEvent(audioOutEvent.GetBase());
+		FreeBuffers();
+	}
+
+	// Play the mix of the speakers added with wntgd_AddMixerSpeaker (wntgd_InitializeDecoder must have been called).
+	// Returns false if the playback is already running.
+	extern "C" bool wntgd_StartVoicePlayback()
+	{
+		playbackMutex.Lock();
+		if (isPlaying.load(std::memory_order_acquire) || !OpenPlayback())
+		{
+			playbackMutex.Unlock();
+			return false;
+		}
+
+		isPlaying.store(true, std::memory_order_release);
+		bool result = nn::os::CreateThread(&playbackThread, PlaybackThreadFunction, nullptr,
+			playbackThreadStack, PLAYBACK_THREAD_STACK_SIZE, nn::os::HighestThreadPriority).IsSuccess();
+		if (result)
+		{
+			nn::os::SetThreadName(&playbackThread, "wntgd_Playback");
+			nn::os::StartThread(&playbackThread);
+		}
+		else
+		{
+			isPlaying.store(false, std::memory_order_release);
+			ClosePlayback();
+		}
+		playbackMutex.Unlock();
+		return result;
+	}
+
+	// Does nothing if the playback is not running
+	extern "C" void wntgd_StopVoicePlayback()
+	{
+		playbackMutex.Lock();
+		if (isPlaying.load(std::memory_order_acquire))
+		{
+			isPlaying.store(false, std::memory_order_release);
+			nn::os::WaitThread(&playbackThread);
+			nn::os::DestroyThread(&playbackThread);
+			ClosePlayback();
+		}
+		playbackMutex.Unlock();
+	}
+
+	// Add a speaker (from wntgd_CreateSpeakerDecoder) to the mix. The voice is pulled from its jitter buffer,
+	// so only wntgd_PushSpeakerVoiceData must be called for it. A gain of 1 is the original level.
+	extern "C" bool wntgd_AddMixerSpeaker(intptr_t speakerHandle, float gain)
+	{
+		if (!speakerHandle) return false;
+		bool result = false;
+		mixerMutex.Lock();
+		for (int i = 0; i < MAX_MIXER_SPEAKER_COUNT; i++)
+		{
+			if (!mixerSpeakers[i].speakerHandle)
+			{
+				mixerSpeakers[i].speakerHandle = speakerHandle;
+				mixerSpeakers[i].gain = gain;
+				mixerSpeakers[i].azimuth = 0;
+				mixerSpeakers[i].distance = 0;
+				result = true;
+				break;
+			}
+		}
+		mixerMutex.Unlock();
+		return result;
+	}
+
+	extern "C" void wntgd_RemoveMixerSpeaker(intptr_t speakerHandle)
+	{
+		mixerMutex.Lock();
+		for (int i = 0; i < MAX_MIXER_SPEAKER_COUNT; i++)
+		{
+			if (mixerSpeakers[i].speakerHandle == speakerHandle) mixerSpeakers[i].speakerHandle = 0;
+		}
+		mixerMutex.Unlock();
+	}
+
+	extern "C" bool wntgd_SetMixerSpeakerGain(intptr_t speakerHandle, float gain)
+	{
+		bool result = false;
+		mixerMutex.Lock();
+		for (int i = 0; i < MAX_MIXER_SPEAKER_COUNT; i++)
+		{
+			if (mixerSpeakers[i].speakerHandle == speakerHandle)
+			{
+				mixerSpeakers[i].gain = gain;
+				result = true;
+			}
+		}
+		mixerMutex.Unlock();
+		return result;
+	}
+
+	// Where the speaker is relative to the listener, usually updated every game tick. The change is smoothed over one buffer.
+	extern "C" bool wntgd_SetMixerSpeakerPosition(intptr_t speakerHandle, float azimuth, float distance)
+	{
+		bool result = false;
+		mixerMutex.Lock();
+		for (int i = 0; i < MAX_MIXER_SPEAKER_COUNT; i++)
+		{
+			if (mixerSpeakers[i].speakerHandle == speakerHandle)
+			{
+				mixerSpeakers[i].azimuth = azimuth;
+				mixerSpeakers[i].distance = distance;
+				result = true;
+			}
+		}
+		mixerMutex.Unlock();
+		return result;
+	}
+
+	// Output channels asked to the device by the next wntgd_StartVoicePlayback: 1, 2 or 6 (5.1)
+	extern "C" void wntgd_SetPlaybackChannelCount(int count)
+	{
+		if (count < 1) count = 1;
+		if (count > AUDIO_OUT_CHANNEL_COUNT_MAX) count = AUDIO_OUT_CHANNEL_COUNT_MAX;
+		playbackChannelCount = count;
+	}
+}
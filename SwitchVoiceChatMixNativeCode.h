@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <cstdlib>
+#include <atomic>
+#include <nn/audio.h>
+#include <nn/mem.h>
+#include <nn/os.h>
+#include <nn/nn_Log.h>
+
+
+
+namespace SwitchVoiceChatMixNativeCode {
+	const int MIX_SAMPLE_RATE = 48000; // the rate of the decoders
+	const int BUFFER_LENGTH_MILIS = 10; // of one AudioOut buffer
+	const int MAX_MIXER_SPEAKER_COUNT = 16;
+	const int AUDIO_OUT_CHANNEL_COUNT_MAX = 6;
+	const int AUDIO_OUT_SAMPLE_RATE_MAX = 48000; // the mixer region is sized for it, faster devices fail to start
+
+	struct MixerSpeaker
+	{
+		intptr_t speakerHandle; // 0 if the slot is free
+		float gain;
+		float azimuth; // degrees clockwise from the front of the listener (90 is right)
+		float distance;
+	};
+
+	size_t GetMixerMemorySize();
+	bool AllocateBuffers();
+	void FreeBuffers();
+	float GetDistanceAttenuation(float distance);
+	void ComputeSpeakerChannelGains(const MixerSpeaker& speaker, float* gains);
+	void MixSpeakers();
+	void MixFrame(int16_t* out);
+	void PlaybackThreadFunction(void* arg);
+	bool OpenPlayback();
+	void ClosePlayback();
+	extern "C" bool wntgd_StartVoicePlayback();
+	extern "C" void wntgd_StopVoicePlayback();
+	extern "C" bool wntgd_AddMixerSpeaker(intptr_t speakerHandle, float gain);
+	extern "C" void wntgd_RemoveMixerSpeaker(intptr_t speakerHandle);
+	extern "C" bool wntgd_SetMixerSpeakerGain(intptr_t speakerHandle, float gain);
+	extern "C" bool wntgd_SetMixerSpeakerPosition(intptr_t speakerHandle, float azimuth, float distance);
+	extern "C" void wntgd_SetPlaybackChannelCount(int count);
+}
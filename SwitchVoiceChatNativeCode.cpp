@@ -3,266 +3,1334 @@
 namespace SwitchVoiceChatNativeCode {
 	using namespace nn::audio;
 	using namespace nn::codec;
-	const int BUFFER_LENGTH_MILIS = 50;
-	const int ENCODER_BIT_RATE = 24000;
-	const int MIN_TOTAL_BUFFER_SIZE = 32 * 16384;
-	const int ENCODER_FRAME_DURATION = 10000; // only 5000, 10000, and 20000 are valids values
-	const int MAX_OPUS_ENCODER_OUTPUT_SIZE = OpusPacketSizeMaximum;
-
-	AudioIn audioIn;
-	AudioInBuffer audioInBuffer;
-	nn::mem::StandardAllocator allocator;
-	unsigned char* totalBuffer;
-	void* audioBuffer;
-
-	// remainToEncodeBuffer is a circular array
-	int16_t* remainToEncodeBuffer;
-	size_t remainToEncodeBufferSize;
-	size_t remainToEncodeBufferStart;
-	size_t remainToEncodeBufferEnd;
-	int16_t* tempInputEncoderBuffer;
-
-	size_t opusWorkBufferSize;
-	unsigned char* opusWorkBuffer;
-	OpusEncoder* encoder;
-	int encodeSampleCountMaximum;
-
-	int channelCount = 0;
-	int sampleRate = 48000;
-
-	bool AllocateBuffers()
-	{
-		channelCount = GetAudioInChannelCount(&audioIn);
-		sampleRate = GetAudioInSampleRate(&audioIn);
-		SampleFormat sampleFormat = GetAudioInSampleFormat(&audioIn);
+	using namespace SwitchVoiceChatPacketFormat;
+	using namespace SwitchVoiceChatResampler;
+	using namespace SwitchVoiceChatStatsNativeCode;
+	using namespace SwitchVoiceChatMemoryNativeCode;
+	const int ENCODER_FRAME_DURATION_MAX = 20000; // the encoder buffers are sized for it, no frameDurationMax of a profile goes over it
+	const int ENCODER_SAMPLE_RATE_MAX = 48000; // the highest Opus rate
+	const size_t OPUS_WORK_BUFFER_ALIGNMENT = 64;
+	const int AUDIO_IN_BUFFER_COUNT_DEFAULT = 4;
+	const int AUDIO_IN_BUFFER_COUNT_MAX = 8;
+	const size_t CAPTURE_THREAD_STACK_SIZE = 16 * 1024;
+	const size_t ENCODER_THREAD_STACK_SIZE = 64 * 1024;
+	const int ENCODER_SAMPLE_RATE_DEFAULT = 48000; // when the microphone rate is not one Opus accepts
+	const ResamplerQuality CAPTURE_RESAMPLER_QUALITY = ResamplerQuality_High;
+	const int VAD_HANGOVER_MILIS = 200; // keep sending after the last voice frame, so word endings are not cut
+	const float VAD_ENERGY_MARGIN = 9; // dB above the noise floor for a frame to be voice
+	const float VAD_SILENCE_LEVEL = 70; // frames under -70 dBov are never voice
+	const float VAD_ZERO_CROSSING_RATE_MAX = 0.4f; // quiet frames crossing zero more often than this are hiss, not voice
+	const float VAD_NOISE_FLOOR_RISE_PER_SECOND = 5; // dB
+
+	const int ENCODER_BIT_RATE_MIN = 6000; // lowest bit rate Opus supports
+
+	const int ENCODER_CPU_BUDGET_FRAME_PERCENT = 10; // default budget of one encode, in percent of the frame duration
+	const float ENCODE_TIME_SMOOTHING = 0.1f;
+	const int ENCODER_COMPLEXITY_HOLD_FRAME_COUNT = 50; // frames between two steps, so every level gets measured
+
+	// frame duration (only 5000, 10000, and 20000 are valids values), bit rate and coding mode of each EncoderProfile.
+	// SILK cannot code 5 ms frames, so the low latency profile uses CELT. Its frames are never lengthened under load:
+	// the latency is what the profile is for.
+	const EncoderProfileSettings ENCODER_PROFILES[EncoderProfile_Count] = {
+		{ 5000, 32000, OpusCodingMode_Celt, 5000 }, // EncoderProfile_LowLatency
+		{ 10000, 24000, OpusCodingMode_Auto, 20000 }, // EncoderProfile_Balanced
+		{ 20000, 16000, OpusCodingMode_Silk, 20000 }, // EncoderProfile_BandwidthSaver
+	};
+
+	// From the most expensive level (0) to the cheapest. nn::codec has no complexity setting, and the bit rate barely changes
+	// the CPU time of Opus, so longer frames are traded for it: every frame pays the analysis and the mode decision once,
+	// so the CPU time per second of audio drops while the quality stays, at the cost of the frame duration in latency.
+	// Only the levels that fit in the frameDurationMax of the profile are used.
+	const EncoderComplexitySettings ENCODER_COMPLEXITY_LEVELS[] = {
+		{ 1 },
+		{ 2 },
+		{ 4 },
+	};
+	const int ENCODER_COMPLEXITY_LEVEL_COUNT = sizeof(ENCODER_COMPLEXITY_LEVELS) / sizeof(ENCODER_COMPLEXITY_LEVELS[0]);
+
+	// Everything one microphone needs, from the AudioIn to the packets handed out by wntgd_GetVoiceBuffer.
+	// Sessions share no mutable state, so each one captures and encodes on its own threads in parallel with the others.
+	struct CaptureSession
+	{
+		AudioIn audioIn;
+		AudioInInfo audioInInfo; // the device to open, an empty name opens the default AudioIn
+		nn::os::SystemEvent audioInEvent;
+		AudioInBuffer audioInBuffers[AUDIO_IN_BUFFER_COUNT_MAX];
+		void* audioBuffers[AUDIO_IN_BUFFER_COUNT_MAX];
+		int audioInBufferCount = AUDIO_IN_BUFFER_COUNT_DEFAULT;
+		VoiceArenaRegion* encoderRegion; // every buffer below comes from it, nullptr while not recording
+		int payloadSizeMaximum; // of the memory budget
+
+		// the capture thread keeps audioInBuffers queued and moves every released one to remainToEncodeBuffer
+		nn::os::ThreadType captureThread;
+		void* captureThreadStack;
+		std::atomic<bool> isCapturing;
+
+		// push-to-talk: while paused the device keeps capturing and the encoder only keeps the newest frame,
+		// so a resume sends it at once instead of stale audio or waiting for the next AudioIn buffer
+		std::atomic<bool> isPaused;
+		std::atomic<bool> resumePending;
+		std::atomic<size_t> resumeWritePosition; // of remainToEncodeBuffer when wntgd_ResumeRecordVoice was called
+
+		// the encoder thread is woken up by the capture thread and publishes packets to encodedPacketQueue
+		nn::os::ThreadType encoderThread;
+		void* encoderThreadStack;
+		nn::os::Event encodeEvent{ nn::os::EventClearMode_AutoClear };
+		EncodedPacketQueue* encodedPacketQueue;
+
+		// packets handed to the caller by wntgd_GetVoiceBuffer. isReadingVoiceBuffer is set while a caller reads the queue,
+		// FreeBuffers waits for it instead of the caller waiting for recordMutex
+		unsigned char* voiceOutBuffer;
+		size_t voiceOutBufferSize;
+		std::atomic<bool> isReadingVoiceBuffer;
+
+		// mono samples waiting to be encoded
+		SampleRingBuffer remainToEncodeBuffer;
+		int16_t* remainToEncodeBufferStorage;
+		int16_t* tempInputEncoderBuffer;
+		int16_t* captureMonoBuffer;
+		CaptureConvertFunction captureConvertFunction; // picked for the format and the channels of the device
+		size_t captureFrameByteSize;
+
+		// microphone samples are converted to sampleRate if the device runs at a rate Opus does not accept
+		int captureSampleRate;
+		ResamplerFilter* captureResamplerFilter;
+		ResamplerState* captureResamplerState;
+		int16_t* captureResampledBuffer;
+		int captureResampledBufferSize;
+
+		// when the last AudioIn buffer was written to remainToEncodeBuffer, to measure the capture to packet delay
+		std::atomic<int64_t> lastCaptureTick;
+
+		size_t opusWorkBufferSize;
+		unsigned char* opusWorkBuffer;
+		OpusEncoder encoder;
+		int encodeSampleCountMaximum;
+		std::atomic<int> requestedEncoderProfile{ EncoderProfile_Balanced };
+		int encoderProfile; // profile in use, only touched by the encoder thread
+		std::atomic<int> encoderBitRate;
+
+		// each EncodeInterleaved is timed: over the CPU budget the complexity level steps down, with headroom it steps back up
+		std::atomic<int> encoderCpuBudgetMicroSeconds; // per frame of the profile, 0: ENCODER_CPU_BUDGET_FRAME_PERCENT of its duration
+		std::atomic<int> encodeTimeMicroSeconds; // smoothed
+		std::atomic<int> encoderComplexityLevel;
+		float smoothedEncodeTime;
+		int complexityHoldFrameCount;
+
+		// rate controller fed by wntgd_ReportReceiverFeedback (see UpdateRateControl), rateControlBitRate is 0 until the first report
+		nn::os::Mutex rateControlMutex{ false };
+		std::atomic<int> rateControlBitRate;
+		std::atomic<int> bitRateMin{ RATE_CONTROL_BIT_RATE_MIN_DEFAULT };
+		std::atomic<int> bitRateMax; // 0: the bit rate of the profile
+		RateControlState rateControl;
+		uint16_t sequenceNumber;
+
+		// nn::codec does not expose Opus in-band FEC, so frames carry a copy of the previous payload instead.
+		// The expected loss decides how many frames carry one. fecRequested is the choice of the caller: the receiver
+		// feedback only adapts the expected loss while it is set.
+		std::atomic<bool> fecRequested;
+		std::atomic<bool> fecEnabled;
+		std::atomic<int> fecExpectedLossPercent;
+		int redundancyCredit;
+		unsigned char* previousPayload;
+		int previousPayloadSize;
+
+		// voice activity detection: silent frames are not encoded, only a comfort noise frame every COMFORT_NOISE_INTERVAL_MILIS
+		std::atomic<bool> vadEnabled{ true };
+		std::atomic<bool> isSpeaking;
+		float noiseFloorLevel; // in -dBov like the audio level, negative until the first frame
+		int vadHangoverSampleCount;
+		int comfortNoiseSampleCount; // samples since the last comfort noise frame
+
+		int channelCount = 0;
+		int sampleRate = 48000;
+
+		uint32_t generation;
+		bool allocated; // the default session (index 0) always is
+
+		// held while starting, stopping, pausing or destroying the session (the capture and encoder threads and
+		// wntgd_GetSessionVoiceBuffer never take it)
+		nn::os::Mutex recordMutex{ false };
+	};
+
+	// the existing wntgd_ functions work on captureSessions[0], the others are created per local player
+	CaptureSession captureSessions[MAX_CAPTURE_SESSION_COUNT];
+	nn::os::Mutex captureSessionMutex(false);
+
+	// The ring holds at least two AudioIn buffers, so a full frame can always build up
+	size_t GetCaptureRingCapacity(int ringMilis, int rate)
+	{
+		if (ringMilis < 2 * BUFFER_LENGTH_MILIS) ringMilis = 2 * BUFFER_LENGTH_MILIS;
+		return RoundUpToPowerOfTwo(static_cast<size_t>(rate) * ringMilis / 1000);
+	}
+
+	// Upper bound of what AllocateBuffers and InitializeEncoder take from the encoder region, for any microphone within the budget.
+	// The allocations are added in the same order as they are made, so the alignment padding is bounded too.
+	size_t GetEncoderMemorySize(const VoiceMemoryBudget& budget)
+	{
+		size_t size = 0;
+		size_t audioBufferSize = nn::util::align_up(budget.maxCaptureBufferSize, AudioInBuffer::SizeGranularity);
+		for (int i = 0; i < AUDIO_IN_BUFFER_COUNT_MAX; i++)
+		{
+			AddRegionAllocation(&size, audioBufferSize, AudioInBuffer::AddressAlignment);
+		}
+		AddRegionAllocation(&size, CAPTURE_THREAD_STACK_SIZE, nn::os::ThreadStackAlignment);
+		AddRegionAllocation(&size, ENCODER_THREAD_STACK_SIZE, nn::os::ThreadStackAlignment);
+		size_t packetQueueDataSize = ENCODED_PACKET_QUEUE_CAPACITY * GetEncodedPacketSizeMaximum(budget.maxPayloadSize);
+		AddRegionAllocation(&size, sizeof(EncodedPacketQueue), alignof(EncodedPacketQueue));
+		AddRegionAllocation(&size, packetQueueDataSize, 1);
+		AddRegionAllocation(&size, packetQueueDataSize, 1); // voiceOutBuffer
+		AddRegionAllocation(&size, GetCaptureRingCapacity(budget.captureRingMilis, ENCODER_SAMPLE_RATE_MAX) * sizeof(int16_t), sizeof(int16_t));
+		AddRegionAllocation(&size, budget.maxCaptureBufferSize * sizeof(int16_t), sizeof(int16_t)); // an int8 mono microphone has the most samples per byte
+		AddRegionAllocation(&size, sizeof(ResamplerFilter), alignof(ResamplerFilter));
+		AddRegionAllocation(&size, sizeof(ResamplerState), alignof(ResamplerState));
+		AddRegionAllocation(&size, (ENCODER_SAMPLE_RATE_DEFAULT * BUFFER_LENGTH_MILIS / 1000 + 4) * sizeof(int16_t), sizeof(int16_t));
+
+		OpusEncoder sizingEncoder;
+		AddRegionAllocation(&size, sizingEncoder.GetWorkBufferSize(ENCODER_SAMPLE_RATE_MAX, 1), OPUS_WORK_BUFFER_ALIGNMENT);
+		AddRegionAllocation(&size, budget.maxPayloadSize, 1);
+		AddRegionAllocation(&size, ENCODER_SAMPLE_RATE_MAX / 1000 * ENCODER_FRAME_DURATION_MAX / 1000 * sizeof(int16_t), sizeof(int16_t));
+		return size;
+	}
+
+	bool AllocateBuffers(CaptureSession* session)
+	{
+		session->channelCount = GetAudioInChannelCount(&session->audioIn);
+		session->captureSampleRate = GetAudioInSampleRate(&session->audioIn);
+		session->sampleRate = IsOpusSampleRate(session->captureSampleRate) ? session->captureSampleRate : ENCODER_SAMPLE_RATE_DEFAULT;
+		SampleFormat sampleFormat = GetAudioInSampleFormat(&session->audioIn);
 		size_t sampleByteSize = GetSampleByteSize(sampleFormat);
+		session->captureConvertFunction = GetCaptureConvertFunction(sampleFormat, session->channelCount);
+		if (!session->captureConvertFunction)
+		{
+			NN_LOG("Unsupported microphone format %d with %d channels\n", sampleFormat, session->channelCount);
+			return false;
+		}
+		session->captureFrameByteSize = sampleByteSize * session->channelCount;
 
 		int frameRate = 1000 / BUFFER_LENGTH_MILIS;
-		int frameSampleCount = sampleRate / frameRate;
-		size_t dataSize = frameSampleCount * channelCount * sampleByteSize;
-		size_t audioBufferSize = nn::util::align_up(dataSize, AudioOutBuffer::SizeGranularity);
+		int frameSampleCount = session->captureSampleRate / frameRate;
+		size_t dataSize = frameSampleCount * session->channelCount * sampleByteSize;
+		size_t audioBufferSize = nn::util::align_up(dataSize, AudioInBuffer::SizeGranularity);
 
-		size_t totalBufferSize = audioBufferSize;
-		if (totalBufferSize < MIN_TOTAL_BUFFER_SIZE) totalBufferSize = MIN_TOTAL_BUFFER_SIZE;
-		totalBuffer = new unsigned char[totalBufferSize]();
-		allocator.Initialize(totalBuffer, totalBufferSize);
+		session->encoderRegion = AcquireEncoderRegion();
+		if (!session->encoderRegion) return false;
+		const VoiceMemoryBudget& budget = GetVoiceMemoryBudget();
+		if (dataSize > static_cast<size_t>(budget.maxCaptureBufferSize))
+		{
+			NN_LOG("The microphone buffers (%d bytes) exceed the memory budget\n", static_cast<int>(dataSize));
+			ReleaseRegion(session->encoderRegion);
+			session->encoderRegion = nullptr;
+			return false;
+		}
+		session->payloadSizeMaximum = budget.maxPayloadSize;
+		session->voiceOutBufferSize = ENCODED_PACKET_QUEUE_CAPACITY * GetEncodedPacketSizeMaximum(session->payloadSizeMaximum);
 
-		remainToEncodeBufferSize = totalBufferSize;
-		remainToEncodeBuffer = new int16_t[remainToEncodeBufferSize];
-		remainToEncodeBufferStart = 0;
-		remainToEncodeBufferEnd = 0;
+		// same order as GetEncoderMemorySize
+		bool result = true;
+		for (int i = 0; i < session->audioInBufferCount; i++)
+		{
+			session->audioBuffers[i] = AllocateFromRegion(session->encoderRegion, audioBufferSize, AudioInBuffer::AddressAlignment);
+			if (session->audioBuffers[i])
+			{
+				SetAudioInBufferInfo(&session->audioInBuffers[i], session->audioBuffers[i], audioBufferSize, dataSize);
+			}
+			else result = false;
+		}
+		session->captureThreadStack = AllocateFromRegion(session->encoderRegion, CAPTURE_THREAD_STACK_SIZE, nn::os::ThreadStackAlignment);
+		session->encoderThreadStack = AllocateFromRegion(session->encoderRegion, ENCODER_THREAD_STACK_SIZE, nn::os::ThreadStackAlignment);
+		session->encodedPacketQueue = reinterpret_cast<EncodedPacketQueue*>(AllocateFromRegion(session->encoderRegion, sizeof(EncodedPacketQueue), alignof(EncodedPacketQueue)));
+		unsigned char* packetData = reinterpret_cast<unsigned char*>(AllocateFromRegion(session->encoderRegion, session->voiceOutBufferSize, 1));
+		session->voiceOutBuffer = reinterpret_cast<unsigned char*>(AllocateFromRegion(session->encoderRegion, session->voiceOutBufferSize, 1));
+		if (!session->captureThreadStack || !session->encoderThreadStack || !session->encodedPacketQueue || !packetData || !session->voiceOutBuffer) result = false;
+		else InitializeEncodedPacketQueue(session->encodedPacketQueue, packetData, GetEncodedPacketSizeMaximum(session->payloadSizeMaximum));
 
-		audioBuffer = allocator.Allocate(audioBufferSize, AudioInBuffer::AddressAlignment);
-		if (audioBuffer)
+		size_t remainToEncodeBufferCapacity = GetCaptureRingCapacity(budget.captureRingMilis, session->sampleRate);
+		session->remainToEncodeBufferStorage = reinterpret_cast<int16_t*>(AllocateFromRegion(session->encoderRegion, remainToEncodeBufferCapacity * sizeof(int16_t), sizeof(int16_t)));
+		if (session->remainToEncodeBufferStorage) InitializeSampleRingBuffer(&session->remainToEncodeBuffer, session->remainToEncodeBufferStorage, remainToEncodeBufferCapacity);
+		session->captureMonoBuffer = reinterpret_cast<int16_t*>(AllocateFromRegion(session->encoderRegion, frameSampleCount * sizeof(int16_t), sizeof(int16_t)));
+		if (!session->remainToEncodeBufferStorage || !session->captureMonoBuffer) result = false;
+		if (result && session->sampleRate != session->captureSampleRate)
 		{
-			SetAudioInBufferInfo(&audioInBuffer, audioBuffer, audioBufferSize, dataSize);
-			return true;
+			session->captureResamplerFilter = reinterpret_cast<ResamplerFilter*>(AllocateFromRegion(session->encoderRegion, sizeof(ResamplerFilter), alignof(ResamplerFilter)));
+			session->captureResamplerState = reinterpret_cast<ResamplerState*>(AllocateFromRegion(session->encoderRegion, sizeof(ResamplerState), alignof(ResamplerState)));
+			if (session->captureResamplerFilter && session->captureResamplerState)
+			{
+				InitializeResamplerFilter(session->captureResamplerFilter, session->captureSampleRate, session->sampleRate, CAPTURE_RESAMPLER_QUALITY);
+				ClearResamplerState(session->captureResamplerState);
+				session->captureResampledBufferSize = GetResamplerOutputCapacity(session->captureResamplerFilter, frameSampleCount);
+				session->captureResampledBuffer = reinterpret_cast<int16_t*>(AllocateFromRegion(session->encoderRegion, session->captureResampledBufferSize * sizeof(int16_t), sizeof(int16_t)));
+			}
+			if (!session->captureResampledBuffer) result = false;
 		}
-		else
+
+		if (!result)
 		{
-			allocator.Finalize();
-			delete totalBuffer;
-			return false;
+			NN_LOG("The encoder buffers exceed the memory budget\n");
+			FreeBuffers(session);
+		}
+		return result;
+	}
+
+	// Everything comes from encoderRegion, so it is given back at once. isCapturing is already false: a
+	// wntgd_GetSessionVoiceBuffer that saw it true before is waited for, a later one leaves without reading.
+	void FreeBuffers(CaptureSession* session)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		while (session->isReadingVoiceBuffer.load(std::memory_order_seq_cst))
+		{
+			nn::os::SleepThread(nn::TimeSpan::FromMicroSeconds(100));
+		}
+
+		for (int i = 0; i < AUDIO_IN_BUFFER_COUNT_MAX; i++)
+		{
+			session->audioBuffers[i] = nullptr;
+		}
+		session->captureThreadStack = nullptr;
+		session->encoderThreadStack = nullptr;
+		session->encodedPacketQueue = nullptr;
+		session->voiceOutBuffer = nullptr;
+		session->remainToEncodeBufferStorage = nullptr;
+		session->captureMonoBuffer = nullptr;
+		session->captureResamplerFilter = nullptr;
+		session->captureResamplerState = nullptr;
+		session->captureResampledBuffer = nullptr;
+		session->opusWorkBuffer = nullptr;
+		session->previousPayload = nullptr;
+		session->tempInputEncoderBuffer = nullptr;
+		if (session->encoderRegion) ReleaseRegion(session->encoderRegion);
+		session->encoderRegion = nullptr;
+	}
+
+	bool IsOpusSampleRate(int rate)
+	{
+		return rate == 8000 || rate == 12000 || rate == 16000 || rate == 24000 || rate == 48000;
+	}
+
+	template <typename Sample, int ChannelCount>
+	void ConvertCapture(int16_t* out, const void* in, int count)
+	{
+		SwitchVoiceChatSimd::DownmixToInt16<Sample, ChannelCount>(out, reinterpret_cast<const Sample*>(in), count);
+	}
+
+	template <typename Sample>
+	CaptureConvertFunction GetCaptureConvertFunction(int channelCount)
+	{
+		switch (channelCount)
+		{
+		case 1: return ConvertCapture<Sample, 1>;
+		case 2: return ConvertCapture<Sample, 2>;
+		case 4: return ConvertCapture<Sample, 4>;
+		case 6: return ConvertCapture<Sample, 6>;
+		default: return nullptr;
 		}
 	}
 
-	bool InitializeEncoder()
+	// Returns nullptr if the layout is not supported (PcmInt24, or an unusual channel count)
+	CaptureConvertFunction GetCaptureConvertFunction(SampleFormat sampleFormat, int channelCount)
 	{
-		encoder = new OpusEncoder();
-		opusWorkBufferSize = encoder->GetWorkBufferSize(sampleRate, 1); // channelCount = 1, because we use mono
-		opusWorkBuffer = new unsigned char[opusWorkBufferSize];
-		OpusResult result = encoder->Initialize(sampleRate, 1, opusWorkBuffer, opusWorkBufferSize);
+		switch (sampleFormat)
+		{
+		case SampleFormat_PcmInt8: return GetCaptureConvertFunction<int8_t>(channelCount);
+		case SampleFormat_PcmInt16: return GetCaptureConvertFunction<int16_t>(channelCount);
+		case SampleFormat_PcmInt32: return GetCaptureConvertFunction<int32_t>(channelCount);
+		case SampleFormat_PcmFloat: return GetCaptureConvertFunction<float>(channelCount);
+		default: return nullptr;
+		}
+	}
+
+	bool InitializeEncoder(CaptureSession* session, bool enableFec, int expectedLossPercent)
+	{
+		session->opusWorkBufferSize = session->encoder.GetWorkBufferSize(session->sampleRate, 1); // channelCount = 1, because we use mono
+		session->opusWorkBuffer = reinterpret_cast<unsigned char*>(AllocateFromRegion(session->encoderRegion, session->opusWorkBufferSize, OPUS_WORK_BUFFER_ALIGNMENT));
+		session->previousPayload = reinterpret_cast<unsigned char*>(AllocateFromRegion(session->encoderRegion, session->payloadSizeMaximum, 1));
+		// sized for the longest frame of all profiles, so switching profile never allocates
+		session->tempInputEncoderBuffer = reinterpret_cast<int16_t*>(AllocateFromRegion(session->encoderRegion,
+			session->encoder.CalculateFrameSampleCount(ENCODER_FRAME_DURATION_MAX) * sizeof(int16_t), sizeof(int16_t)));
+		if (!session->opusWorkBuffer || !session->previousPayload || !session->tempInputEncoderBuffer) return false;
+		OpusResult result = session->encoder.Initialize(session->sampleRate, 1, session->opusWorkBuffer, session->opusWorkBufferSize);
 		if (result != OpusResult_Success) return false;
 
-		encoder->SetBitRate(ENCODER_BIT_RATE);
-		encoder->BindCodingMode(OpusCodingMode_Auto);
+		session->rateControlMutex.Lock();
+		session->rateControlBitRate.store(0, std::memory_order_relaxed);
+		ResetRateControl(&session->rateControl);
+		session->rateControlMutex.Unlock();
+		session->encoderBitRate.store(0, std::memory_order_relaxed);
+		session->encoderComplexityLevel.store(0, std::memory_order_relaxed);
+		session->encodeTimeMicroSeconds.store(0, std::memory_order_relaxed);
+		session->smoothedEncodeTime = 0;
+		session->complexityHoldFrameCount = ENCODER_COMPLEXITY_HOLD_FRAME_COUNT;
+		ApplyEncoderProfile(session, session->requestedEncoderProfile.load(std::memory_order_relaxed));
+		session->sequenceNumber = 0;
 
-		encodeSampleCountMaximum = encoder->CalculateFrameSampleCount(ENCODER_FRAME_DURATION);
-		tempInputEncoderBuffer = new int16_t[encodeSampleCountMaximum];
+		SetVoiceFec(session, enableFec, expectedLossPercent);
+		session->redundancyCredit = 0;
+		session->previousPayloadSize = 0;
+		session->isSpeaking.store(false, std::memory_order_relaxed);
+		session->noiseFloorLevel = -1;
+		session->vadHangoverSampleCount = 0;
+		session->comfortNoiseSampleCount = session->sampleRate;
 		return true;
 	}
 
-	void FinalizeEncoder()
+	// Frames already in remainToEncodeBuffer are not lost: the next frame simply uses the new duration
+	int GetEncoderFrameDuration(int profile, int level)
+	{
+		const EncoderProfileSettings& settings = ENCODER_PROFILES[profile];
+		int frameDuration = settings.frameDuration * ENCODER_COMPLEXITY_LEVELS[level].frameDurationFactor;
+		return frameDuration < settings.frameDurationMax ? frameDuration : settings.frameDurationMax;
+	}
+
+	// Highest level that still lengthens the frames of the profile, 0 if the profile cannot trade latency for CPU time
+	int GetEncoderComplexityLevelMax(int profile)
+	{
+		int level = 0;
+		while (level < ENCODER_COMPLEXITY_LEVEL_COUNT - 1 && GetEncoderFrameDuration(profile, level + 1) > GetEncoderFrameDuration(profile, level))
+		{
+			level++;
+		}
+		return level;
+	}
+
+	void ApplyEncoderProfile(CaptureSession* session, int profile)
 	{
-		encoder->Finalize();
-		delete tempInputEncoderBuffer;
-		delete opusWorkBuffer;
+		session->encoder.BindCodingMode(ENCODER_PROFILES[profile].codingMode);
+		session->encoderProfile = profile;
+		int level = session->encoderComplexityLevel.load(std::memory_order_relaxed);
+		int levelMax = GetEncoderComplexityLevelMax(profile);
+		ApplyEncoderComplexity(session, level < levelMax ? level : levelMax);
 	}
 
-	inline bool IsEmptyRemainToEncodeBuffer()
+	// Like a profile change, it applies from the next frame
+	void ApplyEncoderComplexity(CaptureSession* session, int level)
 	{
-		return remainToEncodeBufferStart == remainToEncodeBufferEnd;
+		session->encodeSampleCountMaximum = session->encoder.CalculateFrameSampleCount(GetEncoderFrameDuration(session->encoderProfile, level));
+		session->encoderComplexityLevel.store(level, std::memory_order_relaxed);
+		ApplyEncoderBitRate(session);
 	}
 
-	inline size_t SizeRemainToEncodeBuffer()
+	// Time of one EncodeInterleaved call against the CPU budget (runs on the encoder thread)
+	void UpdateEncoderComplexity(CaptureSession* session, int64_t encodeTime)
 	{
-		if (remainToEncodeBufferStart <= remainToEncodeBufferEnd)
+		session->smoothedEncodeTime += (encodeTime - session->smoothedEncodeTime) * ENCODE_TIME_SMOOTHING;
+		session->encodeTimeMicroSeconds.store(static_cast<int>(session->smoothedEncodeTime), std::memory_order_relaxed);
+		if (session->complexityHoldFrameCount > 0)
 		{
-			return remainToEncodeBufferEnd - remainToEncodeBufferStart;
+			session->complexityHoldFrameCount--;
+			return;
 		}
-		else
+
+		// the budget is for a frame of the profile, the encode time is scaled to that duration
+		int profile = session->encoderProfile;
+		int budget = session->encoderCpuBudgetMicroSeconds.load(std::memory_order_relaxed);
+		if (budget <= 0) budget = ENCODER_PROFILES[profile].frameDuration * ENCODER_CPU_BUDGET_FRAME_PERCENT / 100;
+		int level = session->encoderComplexityLevel.load(std::memory_order_relaxed);
+		float profileEncodeTime = session->smoothedEncodeTime * ENCODER_PROFILES[profile].frameDuration / GetEncoderFrameDuration(profile, level);
+		if (profileEncodeTime > budget && level < GetEncoderComplexityLevelMax(profile)) level++;
+		else if (profileEncodeTime < budget / 2 && level > 0) level--;
+		else return;
+
+		ApplyEncoderComplexity(session, level);
+		session->complexityHoldFrameCount = ENCODER_COMPLEXITY_HOLD_FRAME_COUNT;
+	}
+
+	void ResetRateControl(RateControlState* state)
+	{
+		state->smoothedLossPercent = 0;
+		state->budget = 0;
+		state->bitRate = 0;
+		state->expectedLossPercent = 0;
+	}
+
+	// One receiver report: additive increase while the path is clean, multiplicative decrease on loss, delay or jitter.
+	// The budget stays within minimum and ceiling. With redundancy the payloads shrink to leave room for the copies, and
+	// once they would go under minimum fewer copies are sent instead, so payloads and copies always fit in the budget.
+	void UpdateRateControl(RateControlState* state, float lossPercent, int roundTripMilis, int jitterMilis, int minimum, int ceiling, bool redundancy)
+	{
+		if (lossPercent < 0) lossPercent = 0;
+		if (lossPercent > 100) lossPercent = 100;
+		state->smoothedLossPercent += (lossPercent - state->smoothedLossPercent) * RATE_CONTROL_SMOOTHING;
+
+		int budget = state->budget > 0 ? state->budget : ceiling;
+		bool congested = state->smoothedLossPercent > RATE_CONTROL_LOSS_HIGH
+			|| roundTripMilis > RATE_CONTROL_ROUND_TRIP_HIGH_MILIS || jitterMilis > RATE_CONTROL_JITTER_HIGH_MILIS;
+		if (congested) budget = static_cast<int>(budget * RATE_CONTROL_DECREASE_FACTOR);
+		else if (state->smoothedLossPercent < RATE_CONTROL_LOSS_LOW) budget += RATE_CONTROL_INCREASE_STEP;
+		if (budget > ceiling) budget = ceiling;
+		if (budget < minimum) budget = minimum;
+		state->budget = budget;
+
+		// the loss left is covered by redundant copies, as far as the budget allows them over payloads of minimum
+		state->expectedLossPercent = redundancy ? static_cast<int>(state->smoothedLossPercent + 0.5f) : 0;
+		int redundancyPercent = state->expectedLossPercent * FEC_REDUNDANCY_SCALE;
+		if (redundancyPercent > 100) redundancyPercent = 100;
+		if (minimum > 0 && budget * 100 / (100 + redundancyPercent) < minimum)
 		{
-			return remainToEncodeBufferSize + remainToEncodeBufferEnd - remainToEncodeBufferStart;
+			state->expectedLossPercent = (budget - minimum) * 100 / minimum / FEC_REDUNDANCY_SCALE;
+			redundancyPercent = state->expectedLossPercent * FEC_REDUNDANCY_SCALE;
 		}
+		state->bitRate = budget * 100 / (100 + redundancyPercent);
+	}
+
+	int GetBitRateCeiling(CaptureSession* session, int profile)
+	{
+		int maximum = session->bitRateMax.load(std::memory_order_relaxed);
+		return maximum > 0 ? maximum : ENCODER_PROFILES[profile].bitRate;
+	}
+
+	// Bit rate of the profile, lowered by the rate controller (runs on the encoder thread)
+	void ApplyEncoderBitRate(CaptureSession* session)
+	{
+		int bitRate = GetBitRateCeiling(session, session->encoderProfile);
+		int target = session->rateControlBitRate.load(std::memory_order_relaxed);
+		if (target > 0 && target < bitRate) bitRate = target;
+		if (bitRate < ENCODER_BIT_RATE_MIN) bitRate = ENCODER_BIT_RATE_MIN;
+		if (bitRate == session->encoderBitRate.load(std::memory_order_relaxed)) return;
+		session->encoder.SetBitRate(bitRate);
+		session->encoderBitRate.store(bitRate, std::memory_order_relaxed);
+	}
+
+	void FinalizeEncoder(CaptureSession* session)
+	{
+		session->encoder.Finalize(); // the buffers go back with the encoder region
+	}
+
+	size_t RoundUpToPowerOfTwo(size_t value)
+	{
+		size_t result = 1;
+		while (result < value) result <<= 1;
+		return result;
+	}
+
+	// capacity must be a power of two
+	void InitializeSampleRingBuffer(SampleRingBuffer* ring, int16_t* buffer, size_t capacity)
+	{
+		ring->buffer = buffer;
+		ring->capacity = capacity;
+		ring->mask = capacity - 1;
+		ring->readPosition.store(0, std::memory_order_relaxed);
+		ring->writePosition.store(0, std::memory_order_relaxed);
+		ring->overflowCount.store(0, std::memory_order_relaxed);
+	}
+
+	// Discard everything (only call this function from the consumer)
+	void ClearSampleRingBuffer(SampleRingBuffer* ring)
+	{
+		ring->readPosition.store(ring->writePosition.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+	size_t GetSampleRingBufferSize(const SampleRingBuffer* ring)
+	{
+		return ring->writePosition.load(std::memory_order_acquire) - ring->readPosition.load(std::memory_order_acquire);
 	}
 
-	// Push elements to the remainToEncodeBuffer
-	void PushRemainToEncodeBuffer(int16_t value)
+	// Append up to count samples with at most two memcpy. Samples that do not fit are dropped and counted in overflowCount.
+	size_t WriteSampleRingBuffer(SampleRingBuffer* ring, const int16_t* source, size_t count)
 	{
-		remainToEncodeBuffer[remainToEncodeBufferEnd] = value;
-		remainToEncodeBufferEnd = (remainToEncodeBufferEnd + 1) % remainToEncodeBufferSize;
-		if (remainToEncodeBufferStart == remainToEncodeBufferEnd)
+		size_t writePosition = ring->writePosition.load(std::memory_order_relaxed);
+		size_t freeCount = ring->capacity - (writePosition - ring->readPosition.load(std::memory_order_acquire));
+		if (count > freeCount)
 		{
-			remainToEncodeBufferStart = (remainToEncodeBufferStart + 1) % remainToEncodeBufferSize;
+			ring->overflowCount.fetch_add(static_cast<uint32_t>(count - freeCount), std::memory_order_relaxed);
+			count = freeCount;
 		}
+
+		size_t start = writePosition & ring->mask;
+		size_t firstCount = ring->capacity - start;
+		if (firstCount > count) firstCount = count;
+		memcpy(ring->buffer + start, source, firstCount * sizeof(int16_t));
+		memcpy(ring->buffer, source + firstCount, (count - firstCount) * sizeof(int16_t));
+
+		ring->writePosition.store(writePosition + count, std::memory_order_release);
+		return count;
+	}
+
+	// Copy and remove up to count samples with at most two memcpy
+	size_t ReadSampleRingBuffer(SampleRingBuffer* ring, int16_t* dest, size_t count)
+	{
+		size_t readPosition = ring->readPosition.load(std::memory_order_relaxed);
+		size_t size = ring->writePosition.load(std::memory_order_acquire) - readPosition;
+		if (count > size) count = size;
+
+		size_t start = readPosition & ring->mask;
+		size_t firstCount = ring->capacity - start;
+		if (firstCount > count) firstCount = count;
+		memcpy(dest, ring->buffer + start, firstCount * sizeof(int16_t));
+		memcpy(dest + firstCount, ring->buffer, (count - firstCount) * sizeof(int16_t));
+
+		ring->readPosition.store(readPosition + count, std::memory_order_release);
+		return count;
+	}
+
+	// Zero copy access to the next count samples. Returns nullptr if there are not enough samples or they wrap around the end.
+	const int16_t* PeekSampleRingBuffer(const SampleRingBuffer* ring, size_t count)
+	{
+		size_t readPosition = ring->readPosition.load(std::memory_order_relaxed);
+		if (ring->writePosition.load(std::memory_order_acquire) - readPosition < count) return nullptr;
+
+		size_t start = readPosition & ring->mask;
+		if (start + count > ring->capacity) return nullptr;
+		return ring->buffer + start;
 	}
 
-	// Pop (adn discards) elements from the remainToEncodeBuffer
-	void PopRemainToEncodeBuffer(size_t quantity)
+	void DiscardSampleRingBuffer(SampleRingBuffer* ring, size_t count)
 	{
-		if (quantity > SizeRemainToEncodeBuffer()) quantity = SizeRemainToEncodeBuffer();
-		remainToEncodeBufferStart = (remainToEncodeBufferStart + quantity) % remainToEncodeBufferSize;
+		size_t readPosition = ring->readPosition.load(std::memory_order_relaxed);
+		size_t size = ring->writePosition.load(std::memory_order_acquire) - readPosition;
+		if (count > size) count = size;
+		ring->readPosition.store(readPosition + count, std::memory_order_release);
 	}
 
-	// Copy remainToEncodeBuffer to dest buffer (only call this function if count <= SizeRemainToEncodeBuffer)
-	void CopyRemainToEncodeBuffer(int16_t* dest, size_t count)
+	void InitializeEncodedPacketQueue(EncodedPacketQueue* queue, unsigned char* packetData, int packetSizeMaximum)
 	{
-		if (remainToEncodeBufferStart <= remainToEncodeBufferEnd)
+		for (int i = 0; i < ENCODED_PACKET_QUEUE_CAPACITY; i++)
 		{
-			int16_t* source = &remainToEncodeBuffer[remainToEncodeBufferStart];
-			memcpy(dest, source, count);
+			queue->packets[i].size = 0;
+			queue->packets[i].data = packetData + i * packetSizeMaximum;
 		}
-		else
+		queue->readPosition.store(0, std::memory_order_relaxed);
+		queue->writePosition.store(0, std::memory_order_relaxed);
+		queue->overflowCount.store(0, std::memory_order_relaxed);
+	}
+
+	// Get the slot to write the next packet in (nullptr if the queue is full). Only the producer calls this.
+	EncodedPacket* BeginPushEncodedPacket(EncodedPacketQueue* queue)
+	{
+		uint32_t writePosition = queue->writePosition.load(std::memory_order_relaxed);
+		if (writePosition - queue->readPosition.load(std::memory_order_acquire) == ENCODED_PACKET_QUEUE_CAPACITY) return nullptr;
+		return &queue->packets[writePosition & (ENCODED_PACKET_QUEUE_CAPACITY - 1)];
+	}
+
+	// Publish the slot returned by BeginPushEncodedPacket
+	void EndPushEncodedPacket(EncodedPacketQueue* queue)
+	{
+		queue->writePosition.store(queue->writePosition.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Oldest packet (nullptr if the queue is empty). Only the consumer calls this.
+	const EncodedPacket* FrontEncodedPacket(EncodedPacketQueue* queue)
+	{
+		uint32_t readPosition = queue->readPosition.load(std::memory_order_relaxed);
+		if (queue->writePosition.load(std::memory_order_acquire) == readPosition) return nullptr;
+		return &queue->packets[readPosition & (ENCODED_PACKET_QUEUE_CAPACITY - 1)];
+	}
+
+	void PopEncodedPacket(EncodedPacketQueue* queue)
+	{
+		queue->readPosition.store(queue->readPosition.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Move every released buffer to remainToEncodeBuffer and queue it again, returns the number of buffers moved
+	int GetMicrophoneInput(CaptureSession* session)
+	{
+		int bufferCount = 0;
+		AudioInBuffer* releasedBuffer = GetReleasedAudioInBuffer(&session->audioIn);
+		while (releasedBuffer)
 		{
-			if (remainToEncodeBufferStart + count <= remainToEncodeBufferSize)
-			{
-				int16_t* source = &remainToEncodeBuffer[remainToEncodeBufferStart];
-				memcpy(dest, source, count);
-			}
-			else
+			// every channel is mixed down to mono int16
+			size_t audioBufferMonoSize = GetAudioInBufferDataSize(releasedBuffer) / session->captureFrameByteSize;
+			session->captureConvertFunction(session->captureMonoBuffer, GetAudioInBufferDataPointer(releasedBuffer), static_cast<int>(audioBufferMonoSize));
+			const int16_t* mono = session->captureMonoBuffer;
+			if (session->captureResamplerFilter)
 			{
-				int16_t* source = &remainToEncodeBuffer[remainToEncodeBufferStart];
-				size_t sourceCount = remainToEncodeBufferSize - remainToEncodeBufferStart;
-				memcpy(dest, source, sourceCount);
-				sourceCount = count - sourceCount;
-				memcpy(dest, remainToEncodeBuffer, sourceCount);
+				int resampledCount = Resample(session->captureResamplerFilter, session->captureResamplerState, mono, static_cast<int>(audioBufferMonoSize),
+					session->captureResampledBuffer, session->captureResampledBufferSize);
+				// cannot fail with a buffer sized for one AudioIn buffer, the samples are dropped like a ring overflow otherwise
+				if (resampledCount < 0) CountVoiceEvent(VoiceCounter_CaptureRingOverflowSamples, static_cast<uint32_t>(audioBufferMonoSize));
+				audioBufferMonoSize = resampledCount > 0 ? resampledCount : 0;
+				mono = session->captureResampledBuffer;
 			}
+			// the tick is stored before the samples are published, so the encoder never pairs them with an older one
+			session->lastCaptureTick.store(nn::os::GetSystemTick().GetInt64Value(), std::memory_order_relaxed);
+			size_t writtenCount = WriteSampleRingBuffer(&session->remainToEncodeBuffer, mono, audioBufferMonoSize);
+			if (writtenCount < audioBufferMonoSize) CountVoiceEvent(VoiceCounter_CaptureRingOverflowSamples, static_cast<uint32_t>(audioBufferMonoSize - writtenCount));
+			RecordVoiceValue(VoiceHistogram_CaptureRingFillMicroSeconds, static_cast<int64_t>(GetSampleRingBufferSize(&session->remainToEncodeBuffer)) * 1000000 / session->sampleRate);
+			AppendAudioInBuffer(&session->audioIn, releasedBuffer);
+			releasedBuffer = GetReleasedAudioInBuffer(&session->audioIn);
+			session->encodeEvent.Signal();
+			bufferCount++;
 		}
+		if (bufferCount > 0) CountVoiceEvent(VoiceCounter_CapturedBuffers, bufferCount);
+		if (bufferCount >= session->audioInBufferCount) CountVoiceEvent(VoiceCounter_AudioInStarvations);
+		return bufferCount;
 	}
 
-	void GetMicrophoneInput()
+	void CaptureThreadFunction(void* arg)
 	{
-		AudioInBuffer* releasedBuffer = GetReleasedAudioInBuffer(&audioIn);
-		if (releasedBuffer)
+		CaptureSession* session = reinterpret_cast<CaptureSession*>(arg);
+		while (session->isCapturing.load(std::memory_order_acquire))
 		{
-			size_t releasedBufferSize = GetAudioInBufferDataSize(releasedBuffer) / 2;
-			int16_t* releasedBufferPointer = reinterpret_cast<int16_t*>(GetAudioInBufferDataPointer(releasedBuffer));
+			// wake up at least once per buffer, so a stop request is never missed
+			session->audioInEvent.TimedWait(nn::TimeSpan::FromMilliSeconds(BUFFER_LENGTH_MILIS));
+			GetMicrophoneInput(session);
+		}
+	}
 
-			// only get one channel
-			size_t audioBufferMonoSize = releasedBufferSize / channelCount;
-			for (int i = 0; i < audioBufferMonoSize; i++)
-			{
-				PushRemainToEncodeBuffer(releasedBufferPointer[i * channelCount]);
-			}
-			AppendAudioInBuffer(&audioIn, &audioInBuffer);
+	// Spread the redundant copies evenly: expectedLossPercent * FEC_REDUNDANCY_SCALE percent of the frames carry one
+	bool ShouldSendRedundancy(CaptureSession* session)
+	{
+		if (!session->fecEnabled.load(std::memory_order_relaxed) || session->previousPayloadSize == 0) return false;
+		session->redundancyCredit += session->fecExpectedLossPercent.load(std::memory_order_relaxed) * FEC_REDUNDANCY_SCALE;
+		if (session->redundancyCredit < 100) return false;
+		session->redundancyCredit -= 100;
+		if (session->redundancyCredit > 100) session->redundancyCredit = 100;
+		return true;
+	}
+
+	// Energy / zero crossing voice activity detector with hangover (runs on the encoder thread).
+	// Returns true if the frame must be sent.
+	bool DetectVoiceActivity(CaptureSession* session, const int16_t* frame, int sampleCount, uint8_t audioLevel)
+	{
+		int zeroCrossingCount = 0;
+		for (int i = 1; i < sampleCount; i++)
+		{
+			zeroCrossingCount += (frame[i - 1] ^ frame[i]) < 0;
 		}
+		float zeroCrossingRate = static_cast<float>(zeroCrossingCount) / sampleCount;
+
+		// levels are in -dBov: smaller is louder
+		float level = audioLevel;
+		if (session->noiseFloorLevel < 0) session->noiseFloorLevel = level;
+		bool isVoice = level < VAD_SILENCE_LEVEL && level + VAD_ENERGY_MARGIN < session->noiseFloorLevel;
+		if (isVoice && zeroCrossingRate > VAD_ZERO_CROSSING_RATE_MAX && level + 2 * VAD_ENERGY_MARGIN >= session->noiseFloorLevel) isVoice = false;
+
+		// the noise floor follows quieter frames at once and louder ones slowly, so speech barely moves it
+		if (level > session->noiseFloorLevel) session->noiseFloorLevel = level;
+		else session->noiseFloorLevel -= VAD_NOISE_FLOOR_RISE_PER_SECOND * sampleCount / session->sampleRate;
+
+		if (isVoice) session->vadHangoverSampleCount = session->sampleRate * VAD_HANGOVER_MILIS / 1000;
+		else if (session->vadHangoverSampleCount > 0) session->vadHangoverSampleCount -= sampleCount;
+		bool isTalking = isVoice || session->vadHangoverSampleCount > 0;
+		session->isSpeaking.store(isTalking, std::memory_order_relaxed);
+		return isTalking || !session->vadEnabled.load(std::memory_order_relaxed);
+	}
+
+	// Drop the samples of remainToEncodeBuffer older than the frame that ends at position (runs on the encoder thread)
+	void DiscardStaleSamples(CaptureSession* session, size_t position)
+	{
+		size_t readPosition = session->remainToEncodeBuffer.readPosition.load(std::memory_order_relaxed);
+		if (position <= readPosition + session->encodeSampleCountMaximum) return;
+		DiscardSampleRingBuffer(&session->remainToEncodeBuffer, position - session->encodeSampleCountMaximum - readPosition);
 	}
 
-	bool Encode(intptr_t* handler, unsigned char** bufferOut, int* count)
+	// Encode the next frame of remainToEncodeBuffer into encodedPacketQueue (runs on the encoder thread).
+	// Returns false if there is no full frame yet.
+	bool EncodeFrame(CaptureSession* session)
 	{
-		size_t partialEncodedOutSize = 0;
-		size_t totalEncodedOutSize = 0;
-		auto outVector = new std::vector<unsigned char>(0);
+		// a profile change applies between two frames
+		int profile = session->requestedEncoderProfile.load(std::memory_order_relaxed);
+		if (profile != session->encoderProfile) ApplyEncoderProfile(session, profile);
+		else ApplyEncoderBitRate(session);
 
-		int iteration = 0;
-		size_t inSize = SizeRemainToEncodeBuffer();
+		if (session->isPaused.load(std::memory_order_acquire))
+		{
+			DiscardStaleSamples(session, session->remainToEncodeBuffer.writePosition.load(std::memory_order_acquire));
+			return false;
+		}
+		if (session->resumePending.exchange(false, std::memory_order_acquire))
+		{
+			DiscardStaleSamples(session, session->resumeWritePosition.load(std::memory_order_relaxed));
+			session->previousPayloadSize = 0; // never send a redundant copy of the frame before the pause
+		}
+		if (GetSampleRingBufferSize(&session->remainToEncodeBuffer) < static_cast<size_t>(session->encodeSampleCountMaximum)) return false;
+
+		EncodedPacket* packet = BeginPushEncodedPacket(session->encodedPacketQueue);
+		if (!packet)
+		{
+			// nobody is reading: drop the frame instead of spending time encoding it
+			DiscardSampleRingBuffer(&session->remainToEncodeBuffer, session->encodeSampleCountMaximum);
+			session->encodedPacketQueue->overflowCount.fetch_add(1, std::memory_order_relaxed);
+			CountVoiceEvent(VoiceCounter_PacketQueueOverflows);
+			return true;
+		}
+
+		// the timestamp of a frame is the position of its first sample in the capture stream
+		size_t framePosition = session->remainToEncodeBuffer.readPosition.load(std::memory_order_relaxed);
+
+		// encode in place when the frame does not wrap around the end of the ring
+		const int16_t* frame = PeekSampleRingBuffer(&session->remainToEncodeBuffer, session->encodeSampleCountMaximum);
+		bool inPlace = frame != nullptr;
+		if (!inPlace)
+		{
+			ReadSampleRingBuffer(&session->remainToEncodeBuffer, session->tempInputEncoderBuffer, session->encodeSampleCountMaximum);
+			frame = session->tempInputEncoderBuffer;
+		}
+
+		FrameHeader header;
+		header.flags = FRAME_FLAG_AUDIO_LEVEL;
+		header.sequence = session->sequenceNumber;
+		header.timestamp = static_cast<uint32_t>(framePosition * (FRAME_TIMESTAMP_SAMPLE_RATE / session->sampleRate));
+		header.audioLevel = CalculateAudioLevel(frame, session->encodeSampleCountMaximum);
+		header.redundantPayloadSize = 0;
 
-		while (SizeRemainToEncodeBuffer() >= encodeSampleCountMaximum)
+		if (!DetectVoiceActivity(session, frame, session->encodeSampleCountMaximum, header.audioLevel))
 		{
-			CopyRemainToEncodeBuffer(tempInputEncoderBuffer, encodeSampleCountMaximum);
-			outVector->resize(totalEncodedOutSize + MAX_OPUS_ENCODER_OUTPUT_SIZE);
-			OpusResult result = encoder->EncodeInterleaved(
-				&partialEncodedOutSize, outVector->data() + totalEncodedOutSize, MAX_OPUS_ENCODER_OUTPUT_SIZE,
-				tempInputEncoderBuffer, encodeSampleCountMaximum);
+			if (inPlace) DiscardSampleRingBuffer(&session->remainToEncodeBuffer, session->encodeSampleCountMaximum);
+			CountVoiceEvent(VoiceCounter_SilentFrames);
 
-			if (result != OpusResult_Success)
+			// the first silent frame and then one every COMFORT_NOISE_INTERVAL_MILIS tell the receivers the noise level
+			session->comfortNoiseSampleCount += session->encodeSampleCountMaximum;
+			if (session->comfortNoiseSampleCount > session->sampleRate * COMFORT_NOISE_INTERVAL_MILIS / 1000)
 			{
-				NN_LOG("Opus Encoding Error: %s", result);
-				return false;
+				header.flags |= FRAME_FLAG_COMFORT_NOISE;
+				header.audioLevel = static_cast<uint8_t>(session->noiseFloorLevel);
+				header.payloadSize = 0;
+				packet->size = WriteFrameHeader(packet->data, header);
+				EndPushEncodedPacket(session->encodedPacketQueue);
+				session->sequenceNumber++;
+				session->comfortNoiseSampleCount = 0;
+				session->previousPayloadSize = 0; // the previous sequence number is no longer a voice frame
 			}
-
-			totalEncodedOutSize += partialEncodedOutSize;
-			PopRemainToEncodeBuffer(encodeSampleCountMaximum);
-			iteration++;
+			return true;
 		}
+		session->comfortNoiseSampleCount = session->sampleRate; // send comfort noise as soon as the voice stops
 
-		outVector->resize(totalEncodedOutSize);
+		if (ShouldSendRedundancy(session))
+		{
+			header.flags |= FRAME_FLAG_REDUNDANCY;
+			header.redundantPayloadSize = session->previousPayloadSize;
+		}
+		int headerSize = GetFrameHeaderSize(header.flags);
+		unsigned char* payload = packet->data + headerSize + header.redundantPayloadSize;
 
-		*handler = reinterpret_cast<intptr_t>(outVector);
-		*bufferOut = outVector->data();
-		*count = outVector->size();
+		size_t encodedOutSize = 0;
+		nn::os::Tick encodeStart = nn::os::GetSystemTick();
+		OpusResult result = session->encoder.EncodeInterleaved(
+			&encodedOutSize, payload, session->payloadSizeMaximum, // Opus lowers the bit rate of a frame that would not fit
+			frame, session->encodeSampleCountMaximum);
+		int64_t encodeTime = GetMicroSecondsSince(encodeStart);
+		RecordVoiceValue(VoiceHistogram_EncodeMicroSeconds, encodeTime);
+		if (inPlace) DiscardSampleRingBuffer(&session->remainToEncodeBuffer, session->encodeSampleCountMaximum);
+		UpdateEncoderComplexity(session, encodeTime); // may change the frame duration, so only once this frame is consumed
 
-		if (*count > 0)
+		if (result != OpusResult_Success)
 		{
+			NN_LOG("Opus Encoding Error: %d\n", result);
+			CountVoiceEvent(VoiceCounter_EncodeErrors);
 			return true;
 		}
-		else return false;
+
+		header.payloadSize = static_cast<int>(encodedOutSize);
+		WriteFrameHeader(packet->data, header);
+		memcpy(packet->data + headerSize, session->previousPayload, header.redundantPayloadSize);
+		memcpy(session->previousPayload, payload, encodedOutSize);
+		session->previousPayloadSize = header.payloadSize;
+		packet->size = headerSize + header.redundantPayloadSize + header.payloadSize;
+		EndPushEncodedPacket(session->encodedPacketQueue);
+		session->sequenceNumber++;
+		CountVoiceEvent(VoiceCounter_EncodedFrames);
+
+		// the first sample of the frame was captured (writePosition - framePosition) samples before the last buffer arrived
+		size_t writePosition = session->remainToEncodeBuffer.writePosition.load(std::memory_order_acquire);
+		nn::os::Tick captureTick(session->lastCaptureTick.load(std::memory_order_relaxed));
+		RecordVoiceValue(VoiceHistogram_CaptureToPacketMicroSeconds,
+			GetMicroSecondsSince(captureTick) + static_cast<int64_t>(writePosition - framePosition) * 1000000 / session->sampleRate);
+		return true;
 	}
 
-	extern "C" void wntgd_StopRecordVoice()
+	// Encode every full frame of remainToEncodeBuffer
+	void Encode(CaptureSession* session)
 	{
-		// encoder cleanup
-		FinalizeEncoder();
-		delete remainToEncodeBuffer;
+		while (EncodeFrame(session))
+		{
+		}
+	}
 
-		// audioIn cleanup
-		StopAudioIn(&audioIn);
-		CloseAudioIn(&audioIn);
-		allocator.Free(audioBuffer);
-		allocator.Finalize();
-		delete totalBuffer;
+	void EncoderThreadFunction(void* arg)
+	{
+		CaptureSession* session = reinterpret_cast<CaptureSession*>(arg);
+		while (session->isCapturing.load(std::memory_order_acquire))
+		{
+			session->encodeEvent.TimedWait(nn::TimeSpan::FromMilliSeconds(BUFFER_LENGTH_MILIS));
+			Encode(session);
+		}
 	}
 
-	extern "C" bool wntgd_StartRecordVoice()
+	// Open the microphone and get the encoder ready. Nothing runs until GetMicrophoneInput and Encode are called
+	// (by the capture and encoder threads, or directly by a benchmark).
+	bool OpenRecording(CaptureSession* session, bool enableFec, int expectedLossPercent)
 	{
 		AudioInParameter param;
 		InitializeAudioInParameter(&param);
 
-		if (!OpenDefaultAudioIn(&audioIn, param).IsSuccess()) return false;
+		nn::Result openResult = session->audioInInfo.name[0] ? OpenAudioIn(&session->audioIn, &session->audioInEvent, session->audioInInfo.name, param)
+			: OpenDefaultAudioIn(&session->audioIn, &session->audioInEvent, param);
+		if (!openResult.IsSuccess()) return false;
+
+		if (!AllocateBuffers(session))
+		{
+			CloseAudioIn(&session->audioIn);
+			nn::os::DestroySystemEvent(session->audioInEvent.GetBase());
+			return false;
+		}
+
+		if (!InitializeEncoder(session, enableFec, expectedLossPercent))
+		{
+			CloseAudioIn(&session->audioIn);
+			nn::os::DestroySystemEvent(session->audioInEvent.GetBase());
+			FreeBuffers(session);
+			return false;
+		}
 
-		if (!StartAudioIn(&audioIn).IsSuccess())
+		// every buffer is queued before starting, so the device never runs dry
+		for (int i = 0; i < session->audioInBufferCount; i++)
 		{
-			CloseAudioIn(&audioIn);
+			AppendAudioInBuffer(&session->audioIn, &session->audioInBuffers[i]);
+		}
+
+		if (!StartAudioIn(&session->audioIn).IsSuccess())
+		{
+			FinalizeEncoder(session);
+			CloseAudioIn(&session->audioIn);
+			nn::os::DestroySystemEvent(session->audioInEvent.GetBase());
+			FreeBuffers(session);
 			return false;
 		}
+		return true;
+	}
+
+	// Undo OpenRecording (the capture and encoder threads must be stopped)
+	void CloseRecording(CaptureSession* session)
+	{
+		FinalizeEncoder(session);
+		StopAudioIn(&session->audioIn);
+		CloseAudioIn(&session->audioIn);
+		nn::os::DestroySystemEvent(session->audioInEvent.GetBase());
+		FreeBuffers(session);
+	}
+
+	intptr_t MakeCaptureSessionHandle(int index)
+	{
+		return (static_cast<intptr_t>(captureSessions[index].generation) << 8) | (index + 1);
+	}
+
+	// Returns nullptr if the handle is stale
+	CaptureSession* FindCaptureSession(intptr_t sessionHandle)
+	{
+		int index = static_cast<int>(sessionHandle & 0xff) - 1;
+		if (index < 0 || index >= MAX_CAPTURE_SESSION_COUNT) return nullptr;
+
+		captureSessionMutex.Lock();
+		CaptureSession* session = &captureSessions[index];
+		if (index > 0 && (!session->allocated || MakeCaptureSessionHandle(index) != sessionHandle)) session = nullptr;
+		captureSessionMutex.Unlock();
+		return session;
+	}
+
+	// FindCaptureSession with the recordMutex of the session locked. The handle is checked again once the mutex is held,
+	// since the session may have been destroyed while waiting for it.
+	CaptureSession* LockCaptureSession(intptr_t sessionHandle)
+	{
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		if (!session) return nullptr;
+		session->recordMutex.Lock();
+		if (FindCaptureSession(sessionHandle) != session)
+		{
+			session->recordMutex.Unlock();
+			return nullptr;
+		}
+		return session;
+	}
+
+	// The session of the wntgd_ functions without a session handle
+	CaptureSession* GetDefaultCaptureSession()
+	{
+		return &captureSessions[0];
+	}
+
+	// Settings of a new session, like the ones the default session starts with
+	void ResetCaptureSessionSettings(CaptureSession* session)
+	{
+		session->audioInBufferCount = AUDIO_IN_BUFFER_COUNT_DEFAULT;
+		session->requestedEncoderProfile.store(EncoderProfile_Balanced, std::memory_order_relaxed);
+		session->encoderCpuBudgetMicroSeconds.store(0, std::memory_order_relaxed);
+		session->bitRateMin.store(RATE_CONTROL_BIT_RATE_MIN_DEFAULT, std::memory_order_relaxed);
+		session->bitRateMax.store(0, std::memory_order_relaxed);
+		session->vadEnabled.store(true, std::memory_order_relaxed);
+		session->isSpeaking.store(false, std::memory_order_relaxed);
+		session->encoderBitRate.store(0, std::memory_order_relaxed);
+		SetVoiceFec(session, false, 0);
+	}
+
+	void SetVoiceFec(CaptureSession* session, bool enableFec, int expectedLossPercent)
+	{
+		if (expectedLossPercent < 0) expectedLossPercent = 0;
+		if (expectedLossPercent > 100) expectedLossPercent = 100;
+		session->fecExpectedLossPercent.store(expectedLossPercent, std::memory_order_relaxed);
+		session->fecRequested.store(enableFec, std::memory_order_relaxed);
+		session->fecEnabled.store(enableFec && expectedLossPercent > 0, std::memory_order_relaxed);
+	}
 
-		if (!AllocateBuffers())
+	// Number of microphones a session can be created for
+	extern "C" int wntgd_GetCaptureDeviceCount()
+	{
+		AudioInInfo audioInInfos[AudioInCountMax];
+		return ListAudioIns(audioInInfos, AudioInCountMax);
+	}
+
+	// A capture session for the microphone deviceIndex of ListAudioIns (-1: the default one), e.g. for one local player.
+	// It records with its own threads and encoder; the settings of the wntgd_Session functions can be changed before starting it.
+	extern "C" bool wntgd_CreateCaptureSession(int deviceIndex, intptr_t * sessionHandle)
+	{
+		*sessionHandle = 0;
+		AudioInInfo audioInInfos[AudioInCountMax];
+		int deviceCount = ListAudioIns(audioInInfos, AudioInCountMax);
+		if (deviceIndex >= deviceCount) return false;
+
+		captureSessionMutex.Lock();
+		int index = -1;
+		for (int i = 1; i < MAX_CAPTURE_SESSION_COUNT; i++)
 		{
-			StopAudioIn(&audioIn);
-			CloseAudioIn(&audioIn);
+			if (!captureSessions[i].allocated)
+			{
+				index = i;
+				break;
+			}
+		}
+		if (index < 0)
+		{
+			captureSessionMutex.Unlock();
 			return false;
 		}
 
-		if (!InitializeEncoder())
+		CaptureSession* session = &captureSessions[index];
+		if (deviceIndex >= 0) session->audioInInfo = audioInInfos[deviceIndex];
+		else session->audioInInfo.name[0] = '\0';
+		ResetCaptureSessionSettings(session);
+		session->generation = (session->generation + 1) & 0xffffff; // invalidates the handle of the previous session
+		session->allocated = true;
+		*sessionHandle = MakeCaptureSessionHandle(index);
+		captureSessionMutex.Unlock();
+		return true;
+	}
+
+	// Stops the session if it still records. The default session cannot be destroyed.
+	extern "C" void wntgd_DestroyCaptureSession(intptr_t sessionHandle)
+	{
+		CaptureSession* session = LockCaptureSession(sessionHandle);
+		if (!session) return;
+		if (session != GetDefaultCaptureSession())
+		{
+			StopRecording(session);
+			captureSessionMutex.Lock();
+			session->allocated = false;
+			captureSessionMutex.Unlock();
+		}
+		session->recordMutex.Unlock();
+	}
+
+	// Start the capture and encoder threads (call this function with the recordMutex of the session locked)
+	bool StartRecording(CaptureSession* session, bool enableFec, int expectedLossPercent)
+	{
+		if (session->isCapturing.load(std::memory_order_acquire)) return false;
+		if (!OpenRecording(session, enableFec, expectedLossPercent)) return false;
+
+		session->isPaused.store(false, std::memory_order_relaxed);
+		session->resumePending.store(false, std::memory_order_relaxed);
+		session->isCapturing.store(true, std::memory_order_release);
+		if (!nn::os::CreateThread(&session->captureThread, CaptureThreadFunction, session,
+			session->captureThreadStack, CAPTURE_THREAD_STACK_SIZE, nn::os::HighestThreadPriority).IsSuccess())
+		{
+			session->isCapturing.store(false, std::memory_order_release);
+			CloseRecording(session);
+			return false;
+		}
+		if (!nn::os::CreateThread(&session->encoderThread, EncoderThreadFunction, session,
+			session->encoderThreadStack, ENCODER_THREAD_STACK_SIZE, nn::os::DefaultThreadPriority).IsSuccess())
 		{
-			wntgd_StopRecordVoice();
+			session->isCapturing.store(false, std::memory_order_release);
+			nn::os::DestroyThread(&session->captureThread);
+			CloseRecording(session);
 			return false;
 		}
+		nn::os::SetThreadName(&session->captureThread, "wntgd_Capture");
+		nn::os::SetThreadName(&session->encoderThread, "wntgd_Encoder");
+		nn::os::StartThread(&session->captureThread);
+		nn::os::StartThread(&session->encoderThread);
+		return true;
+	}
+
+	// Undo StartRecording if the session records (call this function with the recordMutex of the session locked)
+	void StopRecording(CaptureSession* session)
+	{
+		if (!session->isCapturing.load(std::memory_order_acquire)) return;
+
+		// capture and encoder threads cleanup
+		session->isCapturing.store(false, std::memory_order_release);
+		session->encodeEvent.Signal();
+		nn::os::WaitThread(&session->captureThread);
+		nn::os::DestroyThread(&session->captureThread);
+		nn::os::WaitThread(&session->encoderThread);
+		nn::os::DestroyThread(&session->encoderThread);
+
+		CloseRecording(session);
+	}
+
+	// Start recording with loss protection for the receivers: redundant copies of the previous payload, not Opus in-band FEC
+	// (see ShouldSendRedundancy)
+	extern "C" bool wntgd_StartSessionRecordVoice(intptr_t sessionHandle, bool enableFec, int expectedLossPercent)
+	{
+		CaptureSession* session = LockCaptureSession(sessionHandle);
+		if (!session) return false;
+		bool result = StartRecording(session, enableFec, expectedLossPercent);
+		session->recordMutex.Unlock();
+		return result;
+	}
+
+	extern "C" void wntgd_StopSessionRecordVoice(intptr_t sessionHandle)
+	{
+		CaptureSession* session = LockCaptureSession(sessionHandle);
+		if (!session) return;
+		StopRecording(session);
+		session->recordMutex.Unlock();
+	}
+
+	// Stop sending without closing anything: AudioIn, the threads and the encoder keep running, so wntgd_ResumeSessionRecordVoice
+	// is immediate. Packets already encoded can still be read with wntgd_GetSessionVoiceBuffer.
+	extern "C" bool wntgd_PauseSessionRecordVoice(intptr_t sessionHandle)
+	{
+		CaptureSession* session = LockCaptureSession(sessionHandle);
+		if (!session) return false;
+		bool result = session->isCapturing.load(std::memory_order_acquire);
+		if (result)
+		{
+			session->isPaused.store(true, std::memory_order_release);
+			session->isSpeaking.store(false, std::memory_order_relaxed);
+		}
+		session->recordMutex.Unlock();
+		return result;
+	}
+
+	// Send again from the last frame captured before this call: the first packet is encoded as soon as the encoder thread wakes up
+	extern "C" bool wntgd_ResumeSessionRecordVoice(intptr_t sessionHandle)
+	{
+		CaptureSession* session = LockCaptureSession(sessionHandle);
+		if (!session) return false;
+		bool result = session->isCapturing.load(std::memory_order_acquire);
+		if (result)
+		{
+			session->resumeWritePosition.store(session->remainToEncodeBuffer.writePosition.load(std::memory_order_acquire), std::memory_order_relaxed);
+			session->resumePending.store(true, std::memory_order_release);
+			session->isPaused.store(false, std::memory_order_release);
+			session->encodeEvent.Signal();
+		}
+		session->recordMutex.Unlock();
+		return result;
+	}
 
-		AppendAudioInBuffer(&audioIn, &audioInBuffer);
+	// Select one of the EncoderProfile. Can be changed while recording, it applies from the next frame.
+	extern "C" bool wntgd_ConfigureSessionEncoder(intptr_t sessionHandle, int profile)
+	{
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		if (!session || profile < 0 || profile >= EncoderProfile_Count) return false;
+		session->requestedEncoderProfile.store(profile, std::memory_order_relaxed);
 		return true;
 	}
 
+	// Loss (percent), round trip time and jitter seen by the receivers of this voice, e.g. from their periodic reports.
+	// Drives the bit rate, and the redundancy level if the caller enabled it (wntgd_SetSessionVoiceFec or the start functions):
+	// the expected loss given there is replaced by the one measured. The encoder follows from its next frame.
+	extern "C" void wntgd_ReportSessionReceiverFeedback(intptr_t sessionHandle, float lossPercent, int roundTripMilis, int jitterMilis)
+	{
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		if (!session) return;
+
+		session->rateControlMutex.Lock();
+		int ceiling = GetBitRateCeiling(session, session->requestedEncoderProfile.load(std::memory_order_relaxed));
+		bool fecRequested = session->fecRequested.load(std::memory_order_relaxed);
+		UpdateRateControl(&session->rateControl, lossPercent, roundTripMilis, jitterMilis, session->bitRateMin.load(std::memory_order_relaxed), ceiling, fecRequested);
+		if (fecRequested) SetVoiceFec(session, true, session->rateControl.expectedLossPercent);
+		session->rateControlBitRate.store(session->rateControl.bitRate, std::memory_order_relaxed);
+		session->rateControlMutex.Unlock();
+	}
+
+	// Limits of the rate controller (maximum 0: the bit rate of the encoder profile)
+	extern "C" void wntgd_SetSessionBitRateBounds(intptr_t sessionHandle, int minimum, int maximum)
+	{
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		if (!session) return;
+		if (maximum > 0 && minimum > maximum) minimum = maximum;
+		session->bitRateMin.store(minimum, std::memory_order_relaxed);
+		session->bitRateMax.store(maximum, std::memory_order_relaxed);
+	}
+
+	// Bit rate the encoder currently uses
+	extern "C" int wntgd_GetSessionEncoderBitRate(intptr_t sessionHandle)
+	{
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		return session ? session->encoderBitRate.load(std::memory_order_relaxed) : 0;
+	}
+
+	// CPU time allowed for encoding one frame of the encoder profile (0: a share of its duration). Over it the encoder lengthens
+	// its frames, if the profile allows it (see wntgd_GetSessionEncoderLoad).
+	extern "C" void wntgd_SetSessionEncoderCpuBudget(intptr_t sessionHandle, int microSeconds)
+	{
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		if (session) session->encoderCpuBudgetMicroSeconds.store(microSeconds, std::memory_order_relaxed);
+	}
+
+	// Smoothed CPU time of one encode and the complexity level chosen for it (0: the frame duration of the profile, then longer frames).
+	// complexityLevelMax is the highest level of the requested profile: 0 for the low latency profile and the 20 ms one, which
+	// cannot lengthen their frames, so a session over its budget there has to pick another profile.
+	extern "C" void wntgd_GetSessionEncoderLoad(intptr_t sessionHandle, int* encodeMicroSeconds, int* complexityLevel, int* complexityLevelMax)
+	{
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		*encodeMicroSeconds = session ? session->encodeTimeMicroSeconds.load(std::memory_order_relaxed) : 0;
+		*complexityLevel = session ? session->encoderComplexityLevel.load(std::memory_order_relaxed) : 0;
+		*complexityLevelMax = session ? GetEncoderComplexityLevelMax(session->requestedEncoderProfile.load(std::memory_order_relaxed)) : 0;
+	}
+
+	// Enabled by default. Can be changed while recording, it applies from the next frame.
+	extern "C" void wntgd_SetSessionVoiceActivityDetection(intptr_t sessionHandle, bool enable)
+	{
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		if (session) session->vadEnabled.store(enable, std::memory_order_relaxed);
+	}
+
+	// Whether the player of the session is talking (with the hangover), also when voice activity detection is disabled
+	extern "C" bool wntgd_IsSessionSpeaking(intptr_t sessionHandle)
+	{
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		return session && session->isSpeaking.load(std::memory_order_relaxed);
+	}
+
+	// Share of the frames carrying a redundant copy of the previous payload (not Opus in-band FEC).
+	// Can be changed while recording, it applies from the next frame.
+	extern "C" void wntgd_SetSessionVoiceFec(intptr_t sessionHandle, bool enableFec, int expectedLossPercent)
+	{
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		if (session) SetVoiceFec(session, enableFec, expectedLossPercent);
+	}
+
+	// Number of capture buffers kept in flight (used by the next wntgd_StartSessionRecordVoice)
+	extern "C" void wntgd_SetSessionCaptureBufferCount(intptr_t sessionHandle, int count)
+	{
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		if (!session) return;
+		if (count < 2) count = 2;
+		if (count > AUDIO_IN_BUFFER_COUNT_MAX) count = AUDIO_IN_BUFFER_COUNT_MAX;
+		session->audioInBufferCount = count;
+	}
+
+	// Hand out the packets the encoder thread already produced. Never encodes or waits, not even for a stop in progress.
+	// The buffer stays valid until the next wntgd_GetSessionVoiceBuffer or wntgd_StopSessionRecordVoice call for the same session.
+	// A call made while another one reads the same session returns no packets.
+	extern "C" bool wntgd_GetSessionVoiceBuffer(intptr_t sessionHandle, intptr_t * handler, unsigned char** bufferOut, int* count)
+	{
+		*count = 0;
+		CaptureSession* session = FindCaptureSession(sessionHandle);
+		if (!session || session->isReadingVoiceBuffer.exchange(true, std::memory_order_seq_cst)) return false;
+		// checked once the flag is set, so FreeBuffers either waits for this call or this call sees the stop
+		if (!session->isCapturing.load(std::memory_order_seq_cst) || FindCaptureSession(sessionHandle) != session)
+		{
+			session->isReadingVoiceBuffer.store(false, std::memory_order_release);
+			return false;
+		}
+
+		size_t totalSize = 0;
+		for (int i = 0; i < ENCODED_PACKET_QUEUE_CAPACITY; i++)
+		{
+			const EncodedPacket* packet = FrontEncodedPacket(session->encodedPacketQueue);
+			if (!packet) break;
+			memcpy(session->voiceOutBuffer + totalSize, packet->data, packet->size);
+			totalSize += packet->size;
+			PopEncodedPacket(session->encodedPacketQueue);
+		}
+
+		*handler = reinterpret_cast<intptr_t>(session->voiceOutBuffer);
+		*bufferOut = session->voiceOutBuffer;
+		*count = static_cast<int>(totalSize);
+		session->isReadingVoiceBuffer.store(false, std::memory_order_release);
+		return *count > 0;
+	}
+
+	// The functions below work on the default session, which records from the default AudioIn
+
+	extern "C" void wntgd_StopRecordVoice()
+	{
+		wntgd_StopSessionRecordVoice(MakeCaptureSessionHandle(0));
+	}
+
+	extern "C" bool wntgd_PauseRecordVoice()
+	{
+		return wntgd_PauseSessionRecordVoice(MakeCaptureSessionHandle(0));
+	}
+
+	extern "C" bool wntgd_ResumeRecordVoice()
+	{
+		return wntgd_ResumeSessionRecordVoice(MakeCaptureSessionHandle(0));
+	}
+
+	extern "C" bool wntgd_StartRecordVoice()
+	{
+		return wntgd_StartRecordVoiceWithFec(false, 0);
+	}
+
+	extern "C" bool wntgd_StartRecordVoiceWithFec(bool enableFec, int expectedLossPercent)
+	{
+		return wntgd_StartSessionRecordVoice(MakeCaptureSessionHandle(0), enableFec, expectedLossPercent);
+	}
+
+	extern "C" bool wntgd_ConfigureEncoder(int profile)
+	{
+		return wntgd_ConfigureSessionEncoder(MakeCaptureSessionHandle(0), profile);
+	}
+
+	extern "C" void wntgd_ReportReceiverFeedback(float lossPercent, int roundTripMilis, int jitterMilis)
+	{
+		wntgd_ReportSessionReceiverFeedback(MakeCaptureSessionHandle(0), lossPercent, roundTripMilis, jitterMilis);
+	}
+
+	extern "C" void wntgd_SetBitRateBounds(int minimum, int maximum)
+	{
+		wntgd_SetSessionBitRateBounds(MakeCaptureSessionHandle(0), minimum, maximum);
+	}
+
+	extern "C" int wntgd_GetEncoderBitRate()
+	{
+		return wntgd_GetSessionEncoderBitRate(MakeCaptureSessionHandle(0));
+	}
+
+	extern "C" void wntgd_SetEncoderCpuBudget(int microSeconds)
+	{
+		wntgd_SetSessionEncoderCpuBudget(MakeCaptureSessionHandle(0), microSeconds);
+	}
+
+	extern "C" void wntgd_GetEncoderLoad(int* encodeMicroSeconds, int* complexityLevel, int* complexityLevelMax)
+	{
+		wntgd_GetSessionEncoderLoad(MakeCaptureSessionHandle(0), encodeMicroSeconds, complexityLevel, complexityLevelMax);
+	}
+
+	extern "C" void wntgd_SetVoiceActivityDetection(bool enable)
+	{
+		wntgd_SetSessionVoiceActivityDetection(MakeCaptureSessionHandle(0), enable);
+	}
+
+	// Whether the local user is talking (with the hangover), also when voice activity detection is disabled
+	extern "C" bool wntgd_IsSpeaking()
+	{
+		return wntgd_IsSessionSpeaking(MakeCaptureSessionHandle(0));
+	}
+
+	extern "C" void wntgd_SetVoiceFec(bool enableFec, int expectedLossPercent)
+	{
+		wntgd_SetSessionVoiceFec(MakeCaptureSessionHandle(0), enableFec, expectedLossPercent);
+	}
+
+	extern "C" void wntgd_SetCaptureBufferCount(int count)
+	{
+		wntgd_SetSessionCaptureBufferCount(MakeCaptureSessionHandle(0), count);
+	}
+
 	extern "C" bool wntgd_GetVoiceBuffer(intptr_t * handler, unsigned char** bufferOut, int* count)
 	{
-		GetMicrophoneInput();
-		return Encode(handler, bufferOut, count);
+		return wntgd_GetSessionVoiceBuffer(MakeCaptureSessionHandle(0), handler, bufferOut, count);
 	}
 
+	// Kept for compatibility: the buffer of wntgd_GetVoiceBuffer is owned by the library
 	extern "C" bool wntgd_ReleaseVoiceBuffer(intptr_t * handler)
 	{
-		auto outVector = reinterpret_cast<std::vector<unsigned char>*>(handler);
-		delete outVector;
+		NN_UNUSED(handler);
 		return true;
 	}
 }
@@ -2,27 +2,191 @@
 #include <stdint.h>
 #include <vector>
 #include <cstdlib>
+#include <atomic>
 #include <nn/audio.h>
 #include <nn/codec.h>
 #include <nn/mem.h>
 #include <nn/os.h>
 #include <nn/nn_Log.h>
+#include "SwitchVoiceChatPacketFormat.h"
+#include "SwitchVoiceChatResampler.h"
+#include "SwitchVoiceChatSimd.h"
+#include "SwitchVoiceChatStatsNativeCode.h"
+#include "SwitchVoiceChatMemoryNativeCode.h"
 
 
 
 namespace SwitchVoiceChatNativeCode {
-	bool AllocateBuffers();
-	bool InitializeEncoder();
-	void FinalizeEncoder();
-	inline bool IsEmptyRemainToEncodeBuffer();
-	inline size_t SizeRemainToEncodeBuffer();
-	void PushRemainToEncodeBuffer(int16_t value);
-	void PopRemainToEncodeBuffer(size_t quantity);
-	void CopyRemainToEncodeBuffer(int16_t* dest, size_t count);
-	void GetMicrophoneInput();
-	bool Encode(intptr_t* handler, unsigned char** bufferOut, int* count);
+	// Single producer / single consumer ring of samples. The capacity is a power of two,
+	// so the positions are free running counters and indexing is a mask.
+	struct SampleRingBuffer
+	{
+		int16_t* buffer;
+		size_t capacity;
+		size_t mask;
+		std::atomic<size_t> readPosition;
+		std::atomic<size_t> writePosition;
+		std::atomic<uint32_t> overflowCount; // samples dropped because the ring was full
+	};
+
+	const int BUFFER_LENGTH_MILIS = 50; // of one AudioIn buffer
+	const int ENCODED_PACKET_QUEUE_CAPACITY = 64; // must be a power of two
+	const int MAX_CAPTURE_SESSION_COUNT = 8; // nn::audio::AudioInCountMax microphones, the default session included
+	const int FEC_REDUNDANCY_SCALE = 4; // at 25% expected loss every frame carries a copy of the previous one
+
+	const int RATE_CONTROL_BIT_RATE_MIN_DEFAULT = 8000;
+	const float RATE_CONTROL_SMOOTHING = 0.25f; // weight of the newest loss report
+	const float RATE_CONTROL_LOSS_LOW = 2; // percent: below this the bit rate increases
+	const float RATE_CONTROL_LOSS_HIGH = 10; // percent: above this the bit rate decreases
+	const int RATE_CONTROL_ROUND_TRIP_HIGH_MILIS = 400;
+	const int RATE_CONTROL_JITTER_HIGH_MILIS = 60;
+	const int RATE_CONTROL_INCREASE_STEP = 1000; // bps per report
+	const float RATE_CONTROL_DECREASE_FACTOR = 0.85f;
+
+	// A frame carries its payload and at most one redundant copy of the previous one
+	inline int GetEncodedPacketSizeMaximum(int payloadSizeMaximum)
+	{
+		return SwitchVoiceChatPacketFormat::FRAME_HEADER_SIZE + SwitchVoiceChatPacketFormat::FRAME_AUDIO_LEVEL_SIZE
+			+ SwitchVoiceChatPacketFormat::FRAME_REDUNDANCY_SIZE + 2 * payloadSizeMaximum;
+	}
+
+	struct EncodedPacket
+	{
+		int size;
+		unsigned char* data; // GetEncodedPacketSizeMaximum bytes
+	};
+
+	// Single producer (encoder thread) / single consumer (wntgd_GetVoiceBuffer) queue of encoded packets
+	struct EncodedPacketQueue
+	{
+		EncodedPacket packets[ENCODED_PACKET_QUEUE_CAPACITY];
+		std::atomic<uint32_t> readPosition;
+		std::atomic<uint32_t> writePosition;
+		std::atomic<uint32_t> overflowCount; // frames dropped because the queue was full
+	};
+
+	enum EncoderProfile
+	{
+		EncoderProfile_LowLatency = 0, // 5 ms frames
+		EncoderProfile_Balanced = 1, // 10 ms frames (default)
+		EncoderProfile_BandwidthSaver = 2, // 20 ms frames at a lower bit rate
+		EncoderProfile_Count
+	};
+
+	struct EncoderProfileSettings
+	{
+		int frameDuration; // microseconds
+		int bitRate;
+		nn::codec::OpusCodingMode codingMode;
+		int frameDurationMax; // longest frame the complexity levels may lengthen to, frameDuration: no lengthening
+	};
+
+	struct EncoderComplexitySettings
+	{
+		int frameDurationFactor; // of the frame duration of the profile, up to the longest Opus frame the encoder buffers hold
+	};
+
+	// Rate controller of one session, fed by wntgd_ReportSessionReceiverFeedback
+	struct RateControlState
+	{
+		float smoothedLossPercent;
+		int budget; // bit rate for the payloads and their redundant copies, 0 until the first report
+		int bitRate; // of the payloads
+		int expectedLossPercent; // covered by redundant copies
+	};
+
+	// Converts count interleaved frames of the microphone buffer in to mono int16
+	typedef void (*CaptureConvertFunction)(int16_t* out, const void* in, int count);
+
+	// One microphone recorded and encoded by its own threads (defined in SwitchVoiceChatNativeCode.cpp)
+	struct CaptureSession;
+
+	size_t RoundUpToPowerOfTwo(size_t value);
+	void InitializeSampleRingBuffer(SampleRingBuffer* ring, int16_t* buffer, size_t capacity);
+	void ClearSampleRingBuffer(SampleRingBuffer* ring);
+	size_t GetSampleRingBufferSize(const SampleRingBuffer* ring);
+	size_t WriteSampleRingBuffer(SampleRingBuffer* ring, const int16_t* source, size_t count);
+	size_t ReadSampleRingBuffer(SampleRingBuffer* ring, int16_t* dest, size_t count);
+	const int16_t* PeekSampleRingBuffer(const SampleRingBuffer* ring, size_t count);
+	void DiscardSampleRingBuffer(SampleRingBuffer* ring, size_t count);
+	void InitializeEncodedPacketQueue(EncodedPacketQueue* queue, unsigned char* packetData, int packetSizeMaximum);
+	EncodedPacket* BeginPushEncodedPacket(EncodedPacketQueue* queue);
+	void EndPushEncodedPacket(EncodedPacketQueue* queue);
+	const EncodedPacket* FrontEncodedPacket(EncodedPacketQueue* queue);
+	void PopEncodedPacket(EncodedPacketQueue* queue);
+
+	size_t GetCaptureRingCapacity(int ringMilis, int rate);
+	size_t GetEncoderMemorySize(const SwitchVoiceChatMemoryNativeCode::VoiceMemoryBudget& budget);
+	bool AllocateBuffers(CaptureSession* session);
+	void FreeBuffers(CaptureSession* session);
+	bool IsOpusSampleRate(int rate);
+	CaptureConvertFunction GetCaptureConvertFunction(nn::audio::SampleFormat sampleFormat, int channelCount);
+	bool InitializeEncoder(CaptureSession* session, bool enableFec, int expectedLossPercent);
+	void FinalizeEncoder(CaptureSession* session);
+	int GetEncoderFrameDuration(int profile, int level);
+	int GetEncoderComplexityLevelMax(int profile);
+	void ApplyEncoderProfile(CaptureSession* session, int profile);
+	void ResetRateControl(RateControlState* state);
+	void UpdateRateControl(RateControlState* state, float lossPercent, int roundTripMilis, int jitterMilis, int minimum, int ceiling, bool redundancy);
+	int GetBitRateCeiling(CaptureSession* session, int profile);
+	void ApplyEncoderBitRate(CaptureSession* session);
+	void ApplyEncoderComplexity(CaptureSession* session, int level);
+	void UpdateEncoderComplexity(CaptureSession* session, int64_t encodeTime);
+	int GetMicrophoneInput(CaptureSession* session);
+	void CaptureThreadFunction(void* arg);
+	bool ShouldSendRedundancy(CaptureSession* session);
+	bool DetectVoiceActivity(CaptureSession* session, const int16_t* frame, int sampleCount, uint8_t audioLevel);
+	void DiscardStaleSamples(CaptureSession* session, size_t position);
+	bool EncodeFrame(CaptureSession* session);
+	void Encode(CaptureSession* session);
+	void EncoderThreadFunction(void* arg);
+	bool OpenRecording(CaptureSession* session, bool enableFec, int expectedLossPercent);
+	void CloseRecording(CaptureSession* session);
+	intptr_t MakeCaptureSessionHandle(int index);
+	CaptureSession* FindCaptureSession(intptr_t sessionHandle);
+	CaptureSession* LockCaptureSession(intptr_t sessionHandle);
+	CaptureSession* GetDefaultCaptureSession();
+	void ResetCaptureSessionSettings(CaptureSession* session);
+	void SetVoiceFec(CaptureSession* session, bool enableFec, int expectedLossPercent);
+	bool StartRecording(CaptureSession* session, bool enableFec, int expectedLossPercent);
+	void StopRecording(CaptureSession* session);
+	extern "C" int wntgd_GetCaptureDeviceCount();
+	extern "C" bool wntgd_CreateCaptureSession(int deviceIndex, intptr_t * sessionHandle);
+	extern "C" void wntgd_DestroyCaptureSession(intptr_t sessionHandle);
+	// "Fec" in the functions below is not Opus in-band FEC (LBRR), which nn::codec does not expose: it is a redundancy scheme
+	// where a share of the frames, set by expectedLossPercent, also carry a copy of the previous Opus payload (like RTP RED),
+	// so the receiver rebuilds one lost frame from the next one. The copies cost bit rate, see wntgd_ReportReceiverFeedback:
+	// with enableFec set the feedback replaces expectedLossPercent by the loss measured, without it no copies are ever sent.
+	extern "C" bool wntgd_StartSessionRecordVoice(intptr_t sessionHandle, bool enableFec, int expectedLossPercent);
+	extern "C" void wntgd_StopSessionRecordVoice(intptr_t sessionHandle);
+	extern "C" bool wntgd_PauseSessionRecordVoice(intptr_t sessionHandle);
+	extern "C" bool wntgd_ResumeSessionRecordVoice(intptr_t sessionHandle);
+	extern "C" bool wntgd_ConfigureSessionEncoder(intptr_t sessionHandle, int profile);
+	extern "C" void wntgd_ReportSessionReceiverFeedback(intptr_t sessionHandle, float lossPercent, int roundTripMilis, int jitterMilis);
+	extern "C" void wntgd_SetSessionBitRateBounds(intptr_t sessionHandle, int minimum, int maximum);
+	extern "C" int wntgd_GetSessionEncoderBitRate(intptr_t sessionHandle);
+	extern "C" void wntgd_SetSessionEncoderCpuBudget(intptr_t sessionHandle, int microSeconds);
+	extern "C" void wntgd_GetSessionEncoderLoad(intptr_t sessionHandle, int* encodeMicroSeconds, int* complexityLevel, int* complexityLevelMax);
+	extern "C" void wntgd_SetSessionVoiceActivityDetection(intptr_t sessionHandle, bool enable);
+	extern "C" bool wntgd_IsSessionSpeaking(intptr_t sessionHandle);
+	extern "C" void wntgd_SetSessionVoiceFec(intptr_t sessionHandle, bool enableFec, int expectedLossPercent);
+	extern "C" void wntgd_SetSessionCaptureBufferCount(intptr_t sessionHandle, int count);
+	extern "C" bool wntgd_GetSessionVoiceBuffer(intptr_t sessionHandle, intptr_t * handler, unsigned char** bufferOut, int* count);
 	extern "C" void wntgd_StopRecordVoice();
+	extern "C" bool wntgd_PauseRecordVoice();
+	extern "C" bool wntgd_ResumeRecordVoice();
 	extern "C" bool wntgd_StartRecordVoice();
+	extern "C" bool wntgd_StartRecordVoiceWithFec(bool enableFec, int expectedLossPercent);
+	extern "C" bool wntgd_ConfigureEncoder(int profile);
+	extern "C" void wntgd_ReportReceiverFeedback(float lossPercent, int roundTripMilis, int jitterMilis);
+	extern "C" void wntgd_SetBitRateBounds(int minimum, int maximum);
+	extern "C" int wntgd_GetEncoderBitRate();
+	extern "C" void wntgd_SetEncoderCpuBudget(int microSeconds);
+	extern "C" void wntgd_GetEncoderLoad(int* encodeMicroSeconds, int* complexityLevel, int* complexityLevelMax);
+	extern "C" void wntgd_SetVoiceActivityDetection(bool enable);
+	extern "C" bool wntgd_IsSpeaking();
+	extern "C" void wntgd_SetVoiceFec(bool enableFec, int expectedLossPercent);
+	extern "C" void wntgd_SetCaptureBufferCount(int count);
 	extern "C" bool wntgd_GetVoiceBuffer(intptr_t * handler, unsigned char** bufferOut, int* count);
 	extern "C" bool wntgd_ReleaseVoiceBuffer(intptr_t * handler);
 }
@@ -0,0 +1,107 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+
+// Wire format of the voice data exchanged by SwitchVoiceChatNativeCode and SwitchVoiceChatDecodeNativeCode.
+// A voice buffer is a sequence of frames, each one made of (all fields big endian):
+//   uint16 flags (bits 11-15) and payload size in bytes (bits 0-10)
+//   uint16 sequence number, incremented for every frame sent (wraps)
+//   uint32 capture timestamp of the first sample, counted in 48 kHz samples (wraps)
+//   uint8  audio level in -dBov (0 is the loudest, 127 is silence), only if FRAME_FLAG_AUDIO_LEVEL is set
+//   uint16 redundant payload size, then the redundant payload, only if FRAME_FLAG_REDUNDANCY is set:
+//          a copy of the payload of the previous sequence number, used to rebuild it when it is lost
+//   payload: one nn::codec Opus packet
+// While the speaker is silent no frame is sent, except a comfort noise frame (FRAME_FLAG_COMFORT_NOISE) at least every
+// COMFORT_NOISE_INTERVAL_MILIS: it has an empty payload and its audio level is the level of the background noise.
+namespace SwitchVoiceChatPacketFormat {
+	const int FRAME_HEADER_SIZE = 8;
+	const int FRAME_AUDIO_LEVEL_SIZE = 1;
+	const int FRAME_TIMESTAMP_SAMPLE_RATE = 48000;
+	const int FRAME_PAYLOAD_SIZE_MAX = 0x07ff;
+	const uint16_t FRAME_FLAG_AUDIO_LEVEL = 0x8000;
+	const uint16_t FRAME_FLAG_REDUNDANCY = 0x4000;
+	const uint16_t FRAME_FLAG_COMFORT_NOISE = 0x2000;
+	const int FRAME_REDUNDANCY_SIZE = 2;
+	const uint8_t AUDIO_LEVEL_SILENCE = 127;
+	const int COMFORT_NOISE_INTERVAL_MILIS = 200;
+
+	struct FrameHeader
+	{
+		uint16_t flags;
+		int payloadSize;
+		uint16_t sequence;
+		uint32_t timestamp;
+		uint8_t audioLevel;
+		int redundantPayloadSize;
+	};
+
+	// Size of the fixed fields of a frame (without the redundant payload)
+	inline int GetFrameHeaderSize(uint16_t flags)
+	{
+		return FRAME_HEADER_SIZE + ((flags & FRAME_FLAG_AUDIO_LEVEL) ? FRAME_AUDIO_LEVEL_SIZE : 0)
+			+ ((flags & FRAME_FLAG_REDUNDANCY) ? FRAME_REDUNDANCY_SIZE : 0);
+	}
+
+	// Returns the number of bytes written. The redundant payload (if any) goes right after them, then the payload.
+	inline int WriteFrameHeader(unsigned char* out, const FrameHeader& header)
+	{
+		uint16_t flagsAndSize = static_cast<uint16_t>(header.flags | (header.payloadSize & FRAME_PAYLOAD_SIZE_MAX));
+		out[0] = static_cast<unsigned char>(flagsAndSize >> 8);
+		out[1] = static_cast<unsigned char>(flagsAndSize);
+		out[2] = static_cast<unsigned char>(header.sequence >> 8);
+		out[3] = static_cast<unsigned char>(header.sequence);
+		out[4] = static_cast<unsigned char>(header.timestamp >> 24);
+		out[5] = static_cast<unsigned char>(header.timestamp >> 16);
+		out[6] = static_cast<unsigned char>(header.timestamp >> 8);
+		out[7] = static_cast<unsigned char>(header.timestamp);
+		int offset = FRAME_HEADER_SIZE;
+		if (header.flags & FRAME_FLAG_AUDIO_LEVEL) out[offset++] = header.audioLevel;
+		if (header.flags & FRAME_FLAG_REDUNDANCY)
+		{
+			out[offset++] = static_cast<unsigned char>(header.redundantPayloadSize >> 8);
+			out[offset++] = static_cast<unsigned char>(header.redundantPayloadSize);
+		}
+		return offset;
+	}
+
+	// Returns the offset of the payload, or -1 if the frame is truncated.
+	// The redundant payload (redundantPayloadSize bytes, possibly 0) ends where the payload starts.
+	inline int ReadFrameHeader(const unsigned char* in, int count, FrameHeader* header)
+	{
+		if (count < FRAME_HEADER_SIZE) return -1;
+		uint16_t flagsAndSize = static_cast<uint16_t>((in[0] << 8) | in[1]);
+		header->flags = flagsAndSize & ~FRAME_PAYLOAD_SIZE_MAX;
+		header->payloadSize = flagsAndSize & FRAME_PAYLOAD_SIZE_MAX;
+		header->sequence = static_cast<uint16_t>((in[2] << 8) | in[3]);
+		header->timestamp = (static_cast<uint32_t>(in[4]) << 24) | (in[5] << 16) | (in[6] << 8) | in[7];
+		header->audioLevel = AUDIO_LEVEL_SILENCE;
+		header->redundantPayloadSize = 0;
+
+		int offset = GetFrameHeaderSize(header->flags);
+		if (count < offset) return -1;
+		if (header->flags & FRAME_FLAG_AUDIO_LEVEL) header->audioLevel = in[FRAME_HEADER_SIZE];
+		if (header->flags & FRAME_FLAG_REDUNDANCY) header->redundantPayloadSize = (in[offset - 2] << 8) | in[offset - 1];
+
+		offset += header->redundantPayloadSize;
+		if (count < offset + header->payloadSize) return -1;
+		return offset;
+	}
+
+	// Audio level of a frame as defined by RFC 6464 (-dBov of the RMS)
+	inline uint8_t CalculateAudioLevel(const int16_t* samples, int count)
+	{
+		if (count <= 0) return AUDIO_LEVEL_SILENCE;
+		int64_t energy = 0;
+		for (int i = 0; i < count; i++)
+		{
+			energy += samples[i] * samples[i];
+		}
+		if (energy == 0) return AUDIO_LEVEL_SILENCE;
+
+		float rms = sqrtf(static_cast<float>(energy) / count) / 32767;
+		float level = -20 * log10f(rms);
+		if (level < 0) level = 0;
+		if (level > AUDIO_LEVEL_SILENCE) level = AUDIO_LEVEL_SILENCE;
+		return static_cast<uint8_t>(level);
+	}
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "SwitchVoiceChatSimd.h"
+
+// Polyphase sample rate converter of mono int16 audio, used between the microphone and the encoder
+// when the device rate is not an Opus rate, and between the mixer and AudioOut when the device is not at 48 kHz.
+// The filter is a windowed sinc sampled at phaseCount + 1 fractional positions; an output sample is
+// interpolated between the two phases around its position. The tables have a fixed (maximum) size, nothing is allocated.
+namespace SwitchVoiceChatResampler {
+	enum ResamplerQuality
+	{
+		ResamplerQuality_Fast,
+		ResamplerQuality_High
+	};
+
+	const int RESAMPLER_FAST_TAP_COUNT = 16;
+	const int RESAMPLER_FAST_PHASE_COUNT = 64;
+	const float RESAMPLER_FAST_BANDWIDTH = 0.85f; // of the lower Nyquist frequency
+	const int RESAMPLER_HIGH_TAP_COUNT = 32;
+	const int RESAMPLER_HIGH_PHASE_COUNT = 256;
+	const float RESAMPLER_HIGH_BANDWIDTH = 0.92f;
+	const int RESAMPLER_TAP_COUNT_MAX = RESAMPLER_HIGH_TAP_COUNT;
+	const int RESAMPLER_PHASE_COUNT_MAX = RESAMPLER_HIGH_PHASE_COUNT;
+	const int RESAMPLER_BLOCK_SAMPLE_COUNT = 1024; // input processed per pass
+	const double RESAMPLER_PI = 3.14159265358979323846;
+
+	// Coefficients for one conversion, they can be shared by several channels
+	struct ResamplerFilter
+	{
+		float coefficients[(RESAMPLER_PHASE_COUNT_MAX + 1) * RESAMPLER_TAP_COUNT_MAX];
+		int tapCount;
+		int phaseCount;
+		uint64_t step; // input samples per output sample, 32.32 fixed point
+		bool bypass; // same rate in and out
+	};
+
+	// Streaming state of one channel
+	struct ResamplerState
+	{
+		int16_t input[RESAMPLER_TAP_COUNT_MAX + RESAMPLER_BLOCK_SAMPLE_COUNT];
+		int inputCount;
+		uint64_t position; // of the first tap of the next output sample in input, 32.32 fixed point
+	};
+
+	inline void InitializeResamplerFilter(ResamplerFilter* filter, int inputRate, int outputRate, ResamplerQuality quality)
+	{
+		filter->tapCount = quality == ResamplerQuality_High ? RESAMPLER_HIGH_TAP_COUNT : RESAMPLER_FAST_TAP_COUNT;
+		filter->phaseCount = quality == ResamplerQuality_High ? RESAMPLER_HIGH_PHASE_COUNT : RESAMPLER_FAST_PHASE_COUNT;
+		filter->step = (static_cast<uint64_t>(inputRate) << 32) / outputRate;
+		filter->bypass = inputRate == outputRate;
+
+		// when downsampling the cutoff moves down to the output Nyquist frequency
+		double bandwidth = quality == ResamplerQuality_High ? RESAMPLER_HIGH_BANDWIDTH : RESAMPLER_FAST_BANDWIDTH;
+		double cutoff = bandwidth * (outputRate < inputRate ? static_cast<double>(outputRate) / inputRate : 1.0);
+		int halfTapCount = filter->tapCount / 2;
+		for (int phase = 0; phase <= filter->phaseCount; phase++)
+		{
+			float* row = filter->coefficients + phase * filter->tapCount;
+			double fraction = static_cast<double>(phase) / filter->phaseCount;
+			double sum = 0;
+			for (int tap = 0; tap < filter->tapCount; tap++)
+			{
+				// distance from the output position, which lies fraction after the center tap
+				double x = tap - (halfTapCount - 1) - fraction;
+				double sinc = x == 0 ? 1 : sin(RESAMPLER_PI * cutoff * x) / (RESAMPLER_PI * cutoff * x);
+				double window = 0.42 + 0.5 * cos(RESAMPLER_PI * x / halfTapCount) + 0.08 * cos(2 * RESAMPLER_PI * x / halfTapCount); // Blackman
+				if (x <= -halfTapCount || x >= halfTapCount) window = 0;
+				row[tap] = static_cast<float>(sinc * window);
+				sum += row[tap];
+			}
+			// unity gain at DC for every phase, so no ripple follows the phase
+			for (int tap = 0; tap < filter->tapCount; tap++)
+			{
+				row[tap] = static_cast<float>(row[tap] / sum);
+			}
+		}
+	}
+
+	inline void ClearResamplerState(ResamplerState* state)
+	{
+		state->inputCount = 0;
+		state->position = 0;
+	}
+
+	// Most output samples inputCount input samples can give
+	inline int GetResamplerOutputCapacity(const ResamplerFilter* filter, int inputCount)
+	{
+		if (filter->bypass) return inputCount;
+		return static_cast<int>((static_cast<uint64_t>(inputCount) << 32) / filter->step) + 2;
+	}
+
+	// Convert count samples of in, returns the number of samples written to out.
+	// The output lags the input by about tapCount / 2 input samples. outCapacity must be at least
+	// GetResamplerOutputCapacity(filter, count): otherwise nothing is converted and -1 is returned,
+	// since the input that does not fit in out could not be kept for the next call.
+	inline int Resample(const ResamplerFilter* filter, ResamplerState* state, const int16_t* in, int count, int16_t* out, int outCapacity)
+	{
+		if (outCapacity < GetResamplerOutputCapacity(filter, count)) return -1;
+		if (filter->bypass)
+		{
+			if (count > 0) memcpy(out, in, static_cast<size_t>(count) * sizeof(int16_t));
+			return count;
+		}
+
+		int outCount = 0;
+		while (count > 0 && outCount < outCapacity)
+		{
+			int blockCount = count < RESAMPLER_BLOCK_SAMPLE_COUNT ? count : RESAMPLER_BLOCK_SAMPLE_COUNT;
+			memcpy(state->input + state->inputCount, in, blockCount * sizeof(int16_t));
+			state->inputCount += blockCount;
+			in += blockCount;
+			count -= blockCount;
+
+			while (outCount < outCapacity && static_cast<int>(state->position >> 32) + filter->tapCount <= state->inputCount)
+			{
+				const int16_t* taps = state->input + (state->position >> 32);
+				uint64_t phasePosition = (state->position & 0xffffffff) * filter->phaseCount;
+				int phase = static_cast<int>(phasePosition >> 32);
+				float weight = static_cast<float>(phasePosition & 0xffffffff) * (1.0f / 4294967296.0f);
+				const float* row = filter->coefficients + phase * filter->tapCount;
+
+				float first = SwitchVoiceChatSimd::DotProductInt16(taps, row, filter->tapCount);
+				float second = SwitchVoiceChatSimd::DotProductInt16(taps, row + filter->tapCount, filter->tapCount);
+				out[outCount++] = SwitchVoiceChatSimd::SaturateToInt16(first + (second - first) * weight);
+				state->position += filter->step;
+			}
+
+			// keep only the samples the next outputs still need
+			int consumed = static_cast<int>(state->position >> 32);
+			if (consumed > state->inputCount) consumed = state->inputCount;
+			memmove(state->input, state->input + consumed, (state->inputCount - consumed) * sizeof(int16_t));
+			state->inputCount -= consumed;
+			state->position -= static_cast<uint64_t>(consumed) << 32;
+		}
+		return outCount;
+	}
+}
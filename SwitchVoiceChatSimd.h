@@ -0,0 +1,499 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define WNTGD_SIMD_NEON
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define WNTGD_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WNTGD_SIMD_SSE2
+#endif
+
+// Sample conversion kernels shared by the encoder, the decoder and the mixer.
+// Every vectorized kernel has a scalar reference that it must match bit for bit:
+// both only do exact int -> float conversions and one multiply per sample (no divides, no fused operations).
+namespace SwitchVoiceChatSimd {
+	const float INT16_TO_FLOAT_SCALE = 1.0f / 32767;
+
+	inline void ConvertInt16ToFloatReference(float* out, const int16_t* in, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			out[i] = static_cast<float>(in[i]) * INT16_TO_FLOAT_SCALE;
+		}
+	}
+
+	inline void ConvertInt16ToFloat(float* out, const int16_t* in, int count)
+	{
+		int i = 0;
+#if defined(WNTGD_SIMD_NEON)
+		float32x4_t scale = vdupq_n_f32(INT16_TO_FLOAT_SCALE);
+		for (; i + 8 <= count; i += 8)
+		{
+			int16x8_t samples = vld1q_s16(in + i);
+			float32x4_t low = vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples)));
+			float32x4_t high = vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples)));
+			vst1q_f32(out + i, vmulq_f32(low, scale));
+			vst1q_f32(out + i + 4, vmulq_f32(high, scale));
+		}
+#elif defined(WNTGD_SIMD_AVX2)
+		__m256 scale = _mm256_set1_ps(INT16_TO_FLOAT_SCALE);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			__m256 values = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(samples));
+			_mm256_storeu_ps(out + i, _mm256_mul_ps(values, scale));
+		}
+#elif defined(WNTGD_SIMD_SSE2)
+		__m128 scale = _mm_set1_ps(INT16_TO_FLOAT_SCALE);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			// sign extend by placing each sample in the high half of a 32 bit lane and shifting it back down
+			__m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+			__m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+			_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+			_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+		}
+#endif
+		ConvertInt16ToFloatReference(out + i, in + i, count - i);
+	}
+
+	// accumulator += in * gain, in the int16 scale
+	inline void MultiplyAccumulateInt16Reference(float* accumulator, const int16_t* in, float gain, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			float product = static_cast<float>(in[i]) * gain;
+			accumulator[i] = accumulator[i] + product;
+		}
+	}
+
+	inline void MultiplyAccumulateInt16(float* accumulator, const int16_t* in, float gain, int count)
+	{
+		int i = 0;
+#if defined(WNTGD_SIMD_NEON)
+		float32x4_t gains = vdupq_n_f32(gain);
+		for (; i + 8 <= count; i += 8)
+		{
+			int16x8_t samples = vld1q_s16(in + i);
+			float32x4_t low = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), gains);
+			float32x4_t high = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), gains);
+			vst1q_f32(accumulator + i, vaddq_f32(vld1q_f32(accumulator + i), low));
+			vst1q_f32(accumulator + i + 4, vaddq_f32(vld1q_f32(accumulator + i + 4), high));
+		}
+#elif defined(WNTGD_SIMD_AVX2)
+		__m256 gains = _mm256_set1_ps(gain);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			__m256 products = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(samples)), gains);
+			_mm256_storeu_ps(accumulator + i, _mm256_add_ps(_mm256_loadu_ps(accumulator + i), products));
+		}
+#elif defined(WNTGD_SIMD_SSE2)
+		__m128 gains = _mm_set1_ps(gain);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			__m128 low = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16)), gains);
+			__m128 high = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16)), gains);
+			_mm_storeu_ps(accumulator + i, _mm_add_ps(_mm_loadu_ps(accumulator + i), low));
+			_mm_storeu_ps(accumulator + i + 4, _mm_add_ps(_mm_loadu_ps(accumulator + i + 4), high));
+		}
+#endif
+		MultiplyAccumulateInt16Reference(accumulator + i, in + i, gain, count - i);
+	}
+
+	// accumulator += in * gain, the gain going linearly from startGain by gainStep per sample (no zipper noise on changes).
+	// The gain of every sample is computed from its index, not accumulated, so the vectorized kernel gets the same values.
+	inline void MultiplyAccumulateInt16RampReference(float* accumulator, const int16_t* in, float startGain, float gainStep, int count, int first = 0)
+	{
+		for (int i = first; i < count; i++)
+		{
+			float gain = startGain + gainStep * static_cast<float>(i);
+			float product = static_cast<float>(in[i]) * gain;
+			accumulator[i] = accumulator[i] + product;
+		}
+	}
+
+	inline void MultiplyAccumulateInt16Ramp(float* accumulator, const int16_t* in, float startGain, float gainStep, int count)
+	{
+		int i = 0;
+#if defined(WNTGD_SIMD_NEON)
+		const float firstIndices[4] = { 0, 1, 2, 3 };
+		float32x4_t indices = vld1q_f32(firstIndices);
+		float32x4_t four = vdupq_n_f32(4);
+		float32x4_t starts = vdupq_n_f32(startGain);
+		float32x4_t steps = vdupq_n_f32(gainStep);
+		for (; i + 4 <= count; i += 4)
+		{
+			float32x4_t gains = vaddq_f32(starts, vmulq_f32(steps, indices));
+			float32x4_t samples = vcvtq_f32_s32(vmovl_s16(vld1_s16(in + i)));
+			vst1q_f32(accumulator + i, vaddq_f32(vld1q_f32(accumulator + i), vmulq_f32(samples, gains)));
+			indices = vaddq_f32(indices, four);
+		}
+#elif defined(WNTGD_SIMD_AVX2) || defined(WNTGD_SIMD_SSE2)
+		__m128 indices = _mm_set_ps(3, 2, 1, 0);
+		__m128 four = _mm_set1_ps(4);
+		__m128 starts = _mm_set1_ps(startGain);
+		__m128 steps = _mm_set1_ps(gainStep);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 gains = _mm_add_ps(starts, _mm_mul_ps(steps, indices));
+			__m128i samples = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i));
+			__m128 values = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+			_mm_storeu_ps(accumulator + i, _mm_add_ps(_mm_loadu_ps(accumulator + i), _mm_mul_ps(values, gains)));
+			indices = _mm_add_ps(indices, four);
+		}
+#endif
+		MultiplyAccumulateInt16RampReference(accumulator, in, startGain, gainStep, count, i);
+	}
+
+	// Sum of in * coefficients (count is a multiple of 8). The products are added in 8 lanes (lane i % 8),
+	// then the lanes are reduced in a fixed order, so every vectorized kernel gets the same sum.
+	inline float DotProductInt16Reference(const int16_t* in, const float* coefficients, int count)
+	{
+		float lanes[8] = { 0 };
+		for (int i = 0; i < count; i++)
+		{
+			float product = static_cast<float>(in[i]) * coefficients[i];
+			lanes[i & 7] = lanes[i & 7] + product;
+		}
+		float low[4];
+		for (int lane = 0; lane < 4; lane++)
+		{
+			low[lane] = lanes[lane] + lanes[lane + 4];
+		}
+		return (low[0] + low[2]) + (low[1] + low[3]);
+	}
+
+	inline float DotProductInt16(const int16_t* in, const float* coefficients, int count)
+	{
+#if defined(WNTGD_SIMD_NEON)
+		float32x4_t low = vdupq_n_f32(0);
+		float32x4_t high = vdupq_n_f32(0);
+		for (int i = 0; i < count; i += 8)
+		{
+			int16x8_t samples = vld1q_s16(in + i);
+			low = vaddq_f32(low, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), vld1q_f32(coefficients + i)));
+			high = vaddq_f32(high, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), vld1q_f32(coefficients + i + 4)));
+		}
+		float32x4_t sums = vaddq_f32(low, high);
+		float32x2_t pairs = vadd_f32(vget_low_f32(sums), vget_high_f32(sums)); // (0 + 2) (1 + 3)
+		return vget_lane_f32(pairs, 0) + vget_lane_f32(pairs, 1);
+#elif defined(WNTGD_SIMD_AVX2)
+		__m256 lanes = _mm256_setzero_ps();
+		for (int i = 0; i < count; i += 8)
+		{
+			__m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			__m256 products = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(samples)), _mm256_loadu_ps(coefficients + i));
+			lanes = _mm256_add_ps(lanes, products);
+		}
+		__m128 sums = _mm_add_ps(_mm256_castps256_ps128(lanes), _mm256_extractf128_ps(lanes, 1));
+		__m128 pairs = _mm_add_ps(sums, _mm_movehl_ps(sums, sums)); // (0 + 2) (1 + 3)
+		return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+#elif defined(WNTGD_SIMD_SSE2)
+		__m128 low = _mm_setzero_ps();
+		__m128 high = _mm_setzero_ps();
+		for (int i = 0; i < count; i += 8)
+		{
+			__m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			__m128 lowValues = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+			__m128 highValues = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16));
+			low = _mm_add_ps(low, _mm_mul_ps(lowValues, _mm_loadu_ps(coefficients + i)));
+			high = _mm_add_ps(high, _mm_mul_ps(highValues, _mm_loadu_ps(coefficients + i + 4)));
+		}
+		__m128 sums = _mm_add_ps(low, high);
+		__m128 pairs = _mm_add_ps(sums, _mm_movehl_ps(sums, sums)); // (0 + 2) (1 + 3)
+		return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+#else
+		return DotProductInt16Reference(in, coefficients, count);
+#endif
+	}
+
+	// Clamp to the int16 range, then round to nearest even (the default rounding of the SIMD conversions)
+	inline int16_t SaturateToInt16(float value)
+	{
+		if (value > 32767.0f) value = 32767.0f;
+		if (value < -32768.0f) value = -32768.0f;
+		return static_cast<int16_t>(lrintf(value));
+	}
+
+	// Interleave planar int16 scale channels into out, saturating. Several channels may share the same plane.
+	inline void InterleaveSaturateToInt16Reference(int16_t* out, const float* const* planes, int channelCount, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			for (int channel = 0; channel < channelCount; channel++)
+			{
+				out[i * channelCount + channel] = SaturateToInt16(planes[channel][i]);
+			}
+		}
+	}
+
+	inline void InterleaveSaturateToInt16(int16_t* out, const float* const* planes, int channelCount, int count)
+	{
+		int i = 0;
+#if defined(WNTGD_SIMD_NEON)
+		float32x4_t maximum = vdupq_n_f32(32767.0f);
+		float32x4_t minimum = vdupq_n_f32(-32768.0f);
+		if (channelCount == 1)
+		{
+			for (; i + 4 <= count; i += 4)
+			{
+				float32x4_t values = vmaxq_f32(vminq_f32(vld1q_f32(planes[0] + i), maximum), minimum);
+				vst1_s16(out + i, vmovn_s32(vcvtnq_s32_f32(values)));
+			}
+		}
+		else if (channelCount == 2)
+		{
+			for (; i + 4 <= count; i += 4)
+			{
+				float32x4_t left = vmaxq_f32(vminq_f32(vld1q_f32(planes[0] + i), maximum), minimum);
+				float32x4_t right = vmaxq_f32(vminq_f32(vld1q_f32(planes[1] + i), maximum), minimum);
+				int16x4x2_t samples;
+				samples.val[0] = vmovn_s32(vcvtnq_s32_f32(left));
+				samples.val[1] = vmovn_s32(vcvtnq_s32_f32(right));
+				vst2_s16(out + i * 2, samples);
+			}
+		}
+#elif defined(WNTGD_SIMD_AVX2) || defined(WNTGD_SIMD_SSE2)
+		// the float clamp keeps out of range values away from the 0x80000000 result of the conversion
+		__m128 maximum = _mm_set1_ps(32767.0f);
+		__m128 minimum = _mm_set1_ps(-32768.0f);
+		if (channelCount == 1)
+		{
+			for (; i + 8 <= count; i += 8)
+			{
+				__m128i low = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(planes[0] + i), maximum), minimum));
+				__m128i high = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(planes[0] + i + 4), maximum), minimum));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(low, high));
+			}
+		}
+		else if (channelCount == 2)
+		{
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i left = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(planes[0] + i), maximum), minimum));
+				__m128i right = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(planes[1] + i), maximum), minimum));
+				__m128i samples = _mm_packs_epi32(left, right); // l0 l1 l2 l3 r0 r1 r2 r3
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 2), _mm_unpacklo_epi16(samples, _mm_srli_si128(samples, 8)));
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			for (int channel = 0; channel < channelCount; channel++)
+			{
+				out[i * channelCount + channel] = SaturateToInt16(planes[channel][i]);
+			}
+		}
+	}
+
+	// Factor from a capture sample to the int16 scale
+	template <typename Sample> struct SampleScale;
+	template <> struct SampleScale<int8_t> { static float Get() { return 256.0f; } };
+	template <> struct SampleScale<int16_t> { static float Get() { return 1.0f; } };
+	template <> struct SampleScale<int32_t> { static float Get() { return 1.0f / 65536; } };
+	template <> struct SampleScale<float> { static float Get() { return 32767.0f; } };
+
+	// Average the ChannelCount interleaved channels of every frame of in into one int16 sample:
+	// the channels are added in order, then the sum is multiplied once by the scale divided by ChannelCount.
+	template <typename Sample, int ChannelCount>
+	inline void DownmixToInt16Reference(int16_t* out, const Sample* in, int count, int first = 0)
+	{
+		const float scale = SampleScale<Sample>::Get() / ChannelCount;
+		for (int i = first; i < count; i++)
+		{
+			float sum = static_cast<float>(in[i * ChannelCount]);
+			for (int channel = 1; channel < ChannelCount; channel++)
+			{
+				sum = sum + static_cast<float>(in[i * ChannelCount + channel]);
+			}
+			out[i] = SaturateToInt16(sum * scale);
+		}
+	}
+
+	// Generic kernel, the common layouts of the microphones are specialized below
+	template <typename Sample, int ChannelCount>
+	inline void DownmixToInt16(int16_t* out, const Sample* in, int count)
+	{
+		DownmixToInt16Reference<Sample, ChannelCount>(out, in, count);
+	}
+
+	template <>
+	inline void DownmixToInt16<int16_t, 1>(int16_t* out, const int16_t* in, int count)
+	{
+		if (count > 0) memcpy(out, in, static_cast<size_t>(count) * sizeof(int16_t));
+	}
+
+#if defined(WNTGD_SIMD_NEON)
+	// Scale, clamp and round 4 sums to int16 (the same steps as SaturateToInt16)
+	inline int16x4_t SaturateToInt16x4(float32x4_t sums, float32x4_t scale)
+	{
+		float32x4_t values = vmaxq_f32(vminq_f32(vmulq_f32(sums, scale), vdupq_n_f32(32767.0f)), vdupq_n_f32(-32768.0f));
+		return vmovn_s32(vcvtnq_s32_f32(values));
+	}
+
+	template <>
+	inline void DownmixToInt16<int16_t, 2>(int16_t* out, const int16_t* in, int count)
+	{
+		float32x4_t scale = vdupq_n_f32(SampleScale<int16_t>::Get() / 2);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			int16x4x2_t samples = vld2_s16(in + i * 2);
+			float32x4_t sums = vaddq_f32(vcvtq_f32_s32(vmovl_s16(samples.val[0])), vcvtq_f32_s32(vmovl_s16(samples.val[1])));
+			vst1_s16(out + i, SaturateToInt16x4(sums, scale));
+		}
+		DownmixToInt16Reference<int16_t, 2>(out, in, count, i);
+	}
+
+	template <>
+	inline void DownmixToInt16<int32_t, 1>(int16_t* out, const int32_t* in, int count)
+	{
+		float32x4_t scale = vdupq_n_f32(SampleScale<int32_t>::Get());
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			vst1_s16(out + i, SaturateToInt16x4(vcvtq_f32_s32(vld1q_s32(in + i)), scale));
+		}
+		DownmixToInt16Reference<int32_t, 1>(out, in, count, i);
+	}
+
+	template <>
+	inline void DownmixToInt16<int32_t, 2>(int16_t* out, const int32_t* in, int count)
+	{
+		float32x4_t scale = vdupq_n_f32(SampleScale<int32_t>::Get() / 2);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			int32x4x2_t samples = vld2q_s32(in + i * 2);
+			float32x4_t sums = vaddq_f32(vcvtq_f32_s32(samples.val[0]), vcvtq_f32_s32(samples.val[1]));
+			vst1_s16(out + i, SaturateToInt16x4(sums, scale));
+		}
+		DownmixToInt16Reference<int32_t, 2>(out, in, count, i);
+	}
+
+	template <>
+	inline void DownmixToInt16<float, 1>(int16_t* out, const float* in, int count)
+	{
+		float32x4_t scale = vdupq_n_f32(SampleScale<float>::Get());
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			vst1_s16(out + i, SaturateToInt16x4(vld1q_f32(in + i), scale));
+		}
+		DownmixToInt16Reference<float, 1>(out, in, count, i);
+	}
+
+	template <>
+	inline void DownmixToInt16<float, 2>(int16_t* out, const float* in, int count)
+	{
+		float32x4_t scale = vdupq_n_f32(SampleScale<float>::Get() / 2);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			float32x4x2_t samples = vld2q_f32(in + i * 2);
+			vst1_s16(out + i, SaturateToInt16x4(vaddq_f32(samples.val[0], samples.val[1]), scale));
+		}
+		DownmixToInt16Reference<float, 2>(out, in, count, i);
+	}
+#elif defined(WNTGD_SIMD_AVX2) || defined(WNTGD_SIMD_SSE2)
+	// Scale, clamp and round 8 sums to int16 (the same steps as SaturateToInt16)
+	inline void StoreSaturatedInt16x8(int16_t* out, __m128 low, __m128 high, __m128 scale)
+	{
+		__m128 maximum = _mm_set1_ps(32767.0f);
+		__m128 minimum = _mm_set1_ps(-32768.0f);
+		__m128i lowSamples = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(low, scale), maximum), minimum));
+		__m128i highSamples = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(high, scale), maximum), minimum));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packs_epi32(lowSamples, highSamples));
+	}
+
+	// Sums of the two channels of 4 interleaved stereo frames
+	inline __m128 AddStereoFrames(__m128 first, __m128 second)
+	{
+		__m128 left = _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 right = _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+		return _mm_add_ps(left, right);
+	}
+
+	template <>
+	inline void DownmixToInt16<int16_t, 2>(int16_t* out, const int16_t* in, int count)
+	{
+		__m128 scale = _mm_set1_ps(SampleScale<int16_t>::Get() / 2);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			// a 32 bit lane holds one frame: the left sample in its low half, the right one in its high half
+			__m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 2));
+			__m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 2 + 8));
+			__m128 low = _mm_add_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(first, 16), 16)), _mm_cvtepi32_ps(_mm_srai_epi32(first, 16)));
+			__m128 high = _mm_add_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(second, 16), 16)), _mm_cvtepi32_ps(_mm_srai_epi32(second, 16)));
+			StoreSaturatedInt16x8(out + i, low, high, scale);
+		}
+		DownmixToInt16Reference<int16_t, 2>(out, in, count, i);
+	}
+
+	template <>
+	inline void DownmixToInt16<int32_t, 1>(int16_t* out, const int32_t* in, int count)
+	{
+		__m128 scale = _mm_set1_ps(SampleScale<int32_t>::Get());
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128 low = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+			__m128 high = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 4)));
+			StoreSaturatedInt16x8(out + i, low, high, scale);
+		}
+		DownmixToInt16Reference<int32_t, 1>(out, in, count, i);
+	}
+
+	template <>
+	inline void DownmixToInt16<int32_t, 2>(int16_t* out, const int32_t* in, int count)
+	{
+		__m128 scale = _mm_set1_ps(SampleScale<int32_t>::Get() / 2);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i* frames = reinterpret_cast<const __m128i*>(in + i * 2);
+			__m128 low = AddStereoFrames(_mm_cvtepi32_ps(_mm_loadu_si128(frames)), _mm_cvtepi32_ps(_mm_loadu_si128(frames + 1)));
+			__m128 high = AddStereoFrames(_mm_cvtepi32_ps(_mm_loadu_si128(frames + 2)), _mm_cvtepi32_ps(_mm_loadu_si128(frames + 3)));
+			StoreSaturatedInt16x8(out + i, low, high, scale);
+		}
+		DownmixToInt16Reference<int32_t, 2>(out, in, count, i);
+	}
+
+	template <>
+	inline void DownmixToInt16<float, 1>(int16_t* out, const float* in, int count)
+	{
+		__m128 scale = _mm_set1_ps(SampleScale<float>::Get());
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			StoreSaturatedInt16x8(out + i, _mm_loadu_ps(in + i), _mm_loadu_ps(in + i + 4), scale);
+		}
+		DownmixToInt16Reference<float, 1>(out, in, count, i);
+	}
+
+	template <>
+	inline void DownmixToInt16<float, 2>(int16_t* out, const float* in, int count)
+	{
+		__m128 scale = _mm_set1_ps(SampleScale<float>::Get() / 2);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const float* frames = in + i * 2;
+			__m128 low = AddStereoFrames(_mm_loadu_ps(frames), _mm_loadu_ps(frames + 4));
+			__m128 high = AddStereoFrames(_mm_loadu_ps(frames + 8), _mm_loadu_ps(frames + 12));
+			StoreSaturatedInt16x8(out + i, low, high, scale);
+		}
+		DownmixToInt16Reference<float, 2>(out, in, count, i);
+	}
+#endif
+}
@@ -0,0 +1,49 @@
+#include "SwitchVoiceChatStatsNativeCode.h"
+
+namespace SwitchVoiceChatStatsNativeCode {
+	AtomicVoiceStats voiceStats;
+
+	// Copy the statistics since the start (or the last wntgd_ResetVoiceStats). statsSize is sizeof(VoiceStats) of the caller,
+	// so a binding built against another layout gets false instead of a corrupted struct.
+	extern "C" bool wntgd_GetVoiceStats(VoiceStats* stats, int statsSize)
+	{
+		if (!stats || statsSize != static_cast<int>(sizeof(VoiceStats))) return false;
+		for (int i = 0; i < VoiceCounter_Count; i++)
+		{
+			stats->counters[i] = voiceStats.counters[i].load(std::memory_order_relaxed);
+		}
+		for (int i = 0; i < VoiceHistogram_Count; i++)
+		{
+			const AtomicHistogram& histogram = voiceStats.histograms[i];
+			VoiceHistogram* out = &stats->histograms[i];
+			for (int bucket = 0; bucket < STATS_HISTOGRAM_BUCKET_COUNT; bucket++)
+			{
+				out->buckets[bucket] = histogram.buckets[bucket].load(std::memory_order_relaxed);
+			}
+			out->count = histogram.count.load(std::memory_order_relaxed);
+			out->maximum = histogram.maximum.load(std::memory_order_relaxed);
+			out->sum = histogram.sum.load(std::memory_order_relaxed);
+		}
+		return true;
+	}
+
+	// Values recorded concurrently with the reset may survive it
+	extern "C" void wntgd_ResetVoiceStats()
+	{
+		for (int i = 0; i < VoiceCounter_Count; i++)
+		{
+			voiceStats.counters[i].store(0, std::memory_order_relaxed);
+		}
+		for (int i = 0; i < VoiceHistogram_Count; i++)
+		{
+			AtomicHistogram* histogram = &voiceStats.histograms[i];
+			for (int bucket = 0; bucket < STATS_HISTOGRAM_BUCKET_COUNT; bucket++)
+			{
+				histogram->buckets[bucket].store(0, std::memory_order_relaxed);
+			}
+			histogram->count.store(0, std::memory_order_relaxed);
+			histogram->maximum.store(0, std::memory_order_relaxed);
+			histogram->sum.store(0, std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <nn/os.h>
+
+
+
+// Runtime statistics of the voice library. The audio threads only do relaxed atomic adds on counters and fixed bucket
+// histograms (no lock, no allocation); wntgd_GetVoiceStats copies them from any thread.
+// A snapshot is not taken atomically as a whole: a counter may already include a frame another one does not yet.
+namespace SwitchVoiceChatStatsNativeCode {
+	const int STATS_HISTOGRAM_BUCKET_COUNT = 20;
+
+	enum VoiceCounter
+	{
+		VoiceCounter_CapturedBuffers,
+		VoiceCounter_AudioInStarvations, // every AudioIn buffer was released at once: the device may have had none to fill
+		VoiceCounter_CaptureRingOverflowSamples, // samples dropped because the encoder is behind
+		VoiceCounter_EncodedFrames,
+		VoiceCounter_SilentFrames, // not sent (voice activity detection)
+		VoiceCounter_EncodeErrors,
+		VoiceCounter_PacketQueueOverflows, // frames dropped because wntgd_GetVoiceBuffer is not called
+		VoiceCounter_DecodedFrames,
+		VoiceCounter_DecodeFailures,
+		VoiceCounter_ConcealedFrames,
+		VoiceCounter_JitterBufferUnderruns, // a speaker ran dry while playing
+		VoiceCounter_MixedBuffers,
+		VoiceCounter_AudioOutUnderruns, // every AudioOut buffer was released at once: the device may have played silence
+		VoiceCounter_Count
+	};
+
+	enum VoiceHistogramType
+	{
+		VoiceHistogram_EncodeMicroSeconds,
+		VoiceHistogram_DecodeMicroSeconds,
+		VoiceHistogram_CaptureToPacketMicroSeconds, // from the capture of the first sample of a frame to its packet
+		VoiceHistogram_CaptureRingFillMicroSeconds, // audio waiting to be encoded, after each AudioIn buffer
+		VoiceHistogram_JitterBufferFillMicroSeconds, // audio buffered for a speaker, at each pull
+		VoiceHistogram_Count
+	};
+
+	// Bucket 0 counts the values under 1, bucket i the values in [2^(i-1), 2^i), the last one everything above
+	struct VoiceHistogram
+	{
+		uint32_t buckets[STATS_HISTOGRAM_BUCKET_COUNT];
+		uint32_t count;
+		uint32_t maximum;
+		uint64_t sum;
+	};
+
+	// Snapshot returned by wntgd_GetVoiceStats (plain data, indexed by VoiceCounter and VoiceHistogramType)
+	struct VoiceStats
+	{
+		uint32_t counters[VoiceCounter_Count];
+		VoiceHistogram histograms[VoiceHistogram_Count];
+	};
+
+	struct AtomicHistogram
+	{
+		std::atomic<uint32_t> buckets[STATS_HISTOGRAM_BUCKET_COUNT];
+		std::atomic<uint32_t> count;
+		std::atomic<uint32_t> maximum;
+		std::atomic<uint64_t> sum;
+	};
+
+	struct AtomicVoiceStats
+	{
+		std::atomic<uint32_t> counters[VoiceCounter_Count];
+		AtomicHistogram histograms[VoiceHistogram_Count];
+	};
+
+	extern AtomicVoiceStats voiceStats;
+
+	inline void CountVoiceEvent(VoiceCounter counter, uint32_t count = 1)
+	{
+		voiceStats.counters[counter].fetch_add(count, std::memory_order_relaxed);
+	}
+
+	inline int GetHistogramBucket(uint32_t value)
+	{
+		if (value == 0) return 0;
+#if defined(__GNUC__) || defined(__clang__)
+		int bucket = 32 - __builtin_clz(value);
+#else
+		int bucket = 0;
+		for (uint32_t rest = value; rest > 0; rest >>= 1) bucket++;
+#endif
+		return bucket < STATS_HISTOGRAM_BUCKET_COUNT ? bucket : STATS_HISTOGRAM_BUCKET_COUNT - 1;
+	}
+
+	inline void RecordVoiceValue(VoiceHistogramType type, int64_t value)
+	{
+		AtomicHistogram* histogram = &voiceStats.histograms[type];
+		uint32_t clamped = value < 0 ? 0 : (value > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(value));
+		histogram->buckets[GetHistogramBucket(clamped)].fetch_add(1, std::memory_order_relaxed);
+		histogram->count.fetch_add(1, std::memory_order_relaxed);
+		histogram->sum.fetch_add(clamped, std::memory_order_relaxed);
+		uint32_t maximum = histogram->maximum.load(std::memory_order_relaxed);
+		while (clamped > maximum && !histogram->maximum.compare_exchange_weak(maximum, clamped, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	inline int64_t GetMicroSecondsSince(nn::os::Tick start)
+	{
+		return (nn::os::GetSystemTick() - start).ToTimeSpan().GetMicroSeconds();
+	}
+
+	extern "C" bool wntgd_GetVoiceStats(VoiceStats* stats, int statsSize);
+	extern "C" void wntgd_ResetVoiceStats();
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "../SwitchVoiceChatDecodeNativeCode.h"
+#include "../SwitchVoiceChatPacketFormat.h"
+
+// A speaker receives a tone with far more delay buffered than its jitter requires, so its jitter buffer catches up
+// while it plays. Checks the output stays continuous across the catch-ups and that the delay did shrink.
+//   JitterCatchUpTest (returns 1 if a check fails)
+namespace {
+	using namespace SwitchVoiceChatDecodeNativeCode;
+	using namespace SwitchVoiceChatPacketFormat;
+
+	const int TEST_SAMPLE_RATE = 48000;
+	const int TEST_FRAME_SAMPLE_COUNT = TEST_SAMPLE_RATE / 100;
+	const float TEST_TONE_FREQUENCY = 130; // not a multiple of 100 Hz, so a dropped frame jumps in phase
+	const float TEST_TONE_AMPLITUDE = 8000;
+	const int TEST_PREFILL_FRAME_COUNT = 12; // delay buffered before playout, several frames over the target
+	const int TEST_FRAME_COUNT = 100; // then one frame pushed per frame pulled
+	const int TEST_STEP_MAX = 2000; // largest sample to sample step of the decoded tone (codec error included)
+	const int TEST_PAYLOAD_SIZE_MAX = 1275;
+
+	struct ToneEncoder
+	{
+		nn::codec::OpusEncoder encoder;
+		void* workBuffer;
+		int frameIndex;
+	};
+
+	bool InitializeToneEncoder(ToneEncoder* toneEncoder)
+	{
+		size_t workBufferSize = toneEncoder->encoder.GetWorkBufferSize(TEST_SAMPLE_RATE, 1);
+		toneEncoder->workBuffer = malloc(workBufferSize);
+		toneEncoder->frameIndex = 0;
+		return toneEncoder->encoder.Initialize(TEST_SAMPLE_RATE, 1, toneEncoder->workBuffer, workBufferSize) == nn::codec::OpusResult_Success;
+	}
+
+	void FinalizeToneEncoder(ToneEncoder* toneEncoder)
+	{
+		toneEncoder->encoder.Finalize();
+		free(toneEncoder->workBuffer);
+	}
+
+	// The next 10 ms of the tone as one frame of the packet format
+	bool EncodeToneFrame(ToneEncoder* toneEncoder, std::vector<unsigned char>* frame)
+	{
+		int16_t samples[TEST_FRAME_SAMPLE_COUNT];
+		for (int i = 0; i < TEST_FRAME_SAMPLE_COUNT; i++)
+		{
+			double time = static_cast<double>(toneEncoder->frameIndex * TEST_FRAME_SAMPLE_COUNT + i) / TEST_SAMPLE_RATE;
+			samples[i] = static_cast<int16_t>(TEST_TONE_AMPLITUDE * sin(2 * 3.14159265358979 * TEST_TONE_FREQUENCY * time));
+		}
+
+		unsigned char payload[TEST_PAYLOAD_SIZE_MAX];
+		size_t payloadSize = 0;
+		if (toneEncoder->encoder.EncodeInterleaved(&payloadSize, payload, sizeof(payload), samples, TEST_FRAME_SAMPLE_COUNT) != nn::codec::OpusResult_Success)
+		{
+			return false;
+		}
+
+		FrameHeader header = {};
+		header.payloadSize = static_cast<int>(payloadSize);
+		header.sequence = static_cast<uint16_t>(toneEncoder->frameIndex);
+		header.timestamp = static_cast<uint32_t>(toneEncoder->frameIndex * TEST_FRAME_SAMPLE_COUNT);
+		frame->resize(FRAME_HEADER_SIZE + payloadSize);
+		int headerSize = WriteFrameHeader(frame->data(), header);
+		memcpy(frame->data() + headerSize, payload, payloadSize);
+		toneEncoder->frameIndex++;
+		return true;
+	}
+
+	bool PushToneFrame(ToneEncoder* toneEncoder, intptr_t speaker)
+	{
+		std::vector<unsigned char> frame;
+		if (!EncodeToneFrame(toneEncoder, &frame)) return false;
+		return wntgd_PushSpeakerVoiceData(speaker, frame.data(), static_cast<int>(frame.size()));
+	}
+}
+
+int main()
+{
+	ToneEncoder toneEncoder;
+	intptr_t speaker;
+	if (!InitializeToneEncoder(&toneEncoder) || !wntgd_InitializeDecoder() || !wntgd_CreateSpeakerDecoder(&speaker))
+	{
+		printf("JitterCatchUpTest: cannot start the encoder or the decoder\n");
+		return 1;
+	}
+
+	int failureCount = 0;
+	for (int i = 0; i < TEST_PREFILL_FRAME_COUNT; i++)
+	{
+		if (!PushToneFrame(&toneEncoder, speaker)) failureCount++;
+	}
+
+	// the tone starts at 0, so the step from the silence before playout is small too
+	std::vector<int16_t> output;
+	for (int i = 0; i < TEST_FRAME_COUNT; i++)
+	{
+		if (!PushToneFrame(&toneEncoder, speaker)) failureCount++;
+		int16_t samples[TEST_FRAME_SAMPLE_COUNT];
+		wntgd_PullSpeakerVoiceFramePcm16(speaker, samples, TEST_FRAME_SAMPLE_COUNT);
+		output.insert(output.end(), samples, samples + TEST_FRAME_SAMPLE_COUNT);
+	}
+	int stepMax = 0;
+	for (size_t i = 1; i < output.size(); i++)
+	{
+		int step = abs(output[i] - output[i - 1]);
+		if (step > stepMax) stepMax = step;
+	}
+	if (stepMax > TEST_STEP_MAX)
+	{
+		printf("FAIL discontinuity of %d in the output (at most %d expected)\n", stepMax, TEST_STEP_MAX);
+		failureCount++;
+	}
+
+	// the delay left is what plays once the sender stops
+	int drainedFrameCount = 0;
+	int16_t samples[TEST_FRAME_SAMPLE_COUNT];
+	while (drainedFrameCount <= TEST_PREFILL_FRAME_COUNT && wntgd_PullSpeakerVoiceFramePcm16(speaker, samples, TEST_FRAME_SAMPLE_COUNT))
+	{
+		drainedFrameCount++;
+	}
+	if (drainedFrameCount >= TEST_PREFILL_FRAME_COUNT - 2)
+	{
+		printf("FAIL %d frames still buffered, the jitter buffer did not catch up\n", drainedFrameCount);
+		failureCount++;
+	}
+
+	wntgd_DestroySpeakerDecoder(speaker);
+	wntgd_FinalizeDecoder();
+	FinalizeToneEncoder(&toneEncoder);
+	printf("JitterCatchUpTest: largest step %d, %d frames buffered at the end, %d failures\n", stepMax, drainedFrameCount, failureCount);
+	return failureCount > 0 ? 1 : 0;
+}
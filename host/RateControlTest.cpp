@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include "../SwitchVoiceChatNativeCode.h"
+
+// Replays receiver report traces through the rate controller of the encoder (UpdateRateControl) and compares its state with
+// values worked out by hand at chosen reports: back off on loss, delay or jitter, additive recovery on a clean path, fewer
+// redundant copies near the floor, and the bounds. Every report also checks that payloads and copies fit in the budget.
+//   RateControlTest (returns 1 if a check fails)
+namespace {
+	using namespace SwitchVoiceChatNativeCode;
+
+	const int TEST_BIT_RATE_CEILING = 24000; // EncoderProfile_Balanced
+	const int TEST_BIT_RATE_MIN = RATE_CONTROL_BIT_RATE_MIN_DEFAULT;
+
+	struct ReceiverReport
+	{
+		float lossPercent;
+		int roundTripMilis;
+		int jitterMilis;
+	};
+
+	// One report per entry, repeated count times
+	struct TraceSegment
+	{
+		ReceiverReport report;
+		int count;
+	};
+
+	// State expected right after the report reportIndex of a trace
+	struct TraceCheckpoint
+	{
+		int reportIndex;
+		int budget;
+		int bitRate;
+		int expectedLossPercent;
+	};
+
+	struct Trace
+	{
+		const char* name;
+		const TraceSegment* segments;
+		int segmentCount;
+		const TraceCheckpoint* checkpoints;
+		int checkpointCount;
+		int minimum;
+		int ceiling;
+		bool redundancy;
+	};
+
+	int failureCount = 0;
+
+	void Expect(bool condition, const char* trace, int reportIndex, const char* message)
+	{
+		if (condition) return;
+		failureCount++;
+		printf("FAIL %s report %d: %s\n", trace, reportIndex, message);
+	}
+
+	void ReplayTrace(const Trace& trace)
+	{
+		RateControlState state;
+		ResetRateControl(&state);
+		int reportIndex = 0;
+		int checkpoint = 0;
+		for (int segment = 0; segment < trace.segmentCount; segment++)
+		{
+			for (int i = 0; i < trace.segments[segment].count; i++, reportIndex++)
+			{
+				const ReceiverReport& report = trace.segments[segment].report;
+				UpdateRateControl(&state, report.lossPercent, report.roundTripMilis, report.jitterMilis, trace.minimum, trace.ceiling, trace.redundancy);
+
+				int redundancyPercent = state.expectedLossPercent * FEC_REDUNDANCY_SCALE;
+				if (redundancyPercent > 100) redundancyPercent = 100;
+				Expect(state.budget >= trace.minimum && state.budget <= trace.ceiling, trace.name, reportIndex, "budget out of its bounds");
+				Expect(state.bitRate >= trace.minimum, trace.name, reportIndex, "payload bit rate under the minimum");
+				Expect(state.bitRate * (100 + redundancyPercent) <= state.budget * 100, trace.name, reportIndex, "payloads and redundant copies exceed the budget");
+				Expect(trace.redundancy || state.expectedLossPercent == 0, trace.name, reportIndex, "redundant copies the caller did not enable");
+
+				if (checkpoint < trace.checkpointCount && trace.checkpoints[checkpoint].reportIndex == reportIndex)
+				{
+					const TraceCheckpoint& expected = trace.checkpoints[checkpoint++];
+					if (state.budget != expected.budget || state.bitRate != expected.bitRate || state.expectedLossPercent != expected.expectedLossPercent)
+					{
+						failureCount++;
+						printf("FAIL %s report %d: budget %d, bit rate %d, expected loss %d%% instead of %d, %d, %d%%\n", trace.name, reportIndex,
+							state.budget, state.bitRate, state.expectedLossPercent, expected.budget, expected.bitRate, expected.expectedLossPercent);
+					}
+				}
+			}
+		}
+		Expect(checkpoint == trace.checkpointCount, trace.name, reportIndex, "checkpoints past the end of the trace");
+	}
+
+	// A clean path stays at the ceiling
+	const TraceSegment CLEAN_SEGMENTS[] = { { { 0, 50, 5 }, 20 } };
+	const TraceCheckpoint CLEAN_CHECKPOINTS[] = { { 0, 24000, 24000, 0 }, { 19, 24000, 24000, 0 } };
+
+	// Sustained loss: the payloads first shrink for the copies, then near the floor the copies give way to the payloads
+	const TraceSegment LOSS_BURST_SEGMENTS[] = { { { 0, 50, 5 }, 5 }, { { 30, 80, 10 }, 20 } };
+	const TraceCheckpoint LOSS_BURST_CHECKPOINTS[] = {
+		{ 4, 24000, 24000, 0 }, // clean so far
+		{ 5, 24000, 18181, 8 }, // smoothed loss 7.5 is under the high threshold: same budget, 32% of copies
+		{ 6, 20400, 13421, 13 }, // 24000 * 0.85
+		{ 8, 14739, 8010, 21 }, // 84% of copies still fit over payloads of the minimum
+		{ 9, 12528, 8030, 14 }, // 23% expected would be 6525 bps payloads: only (12528 - 8000) / 8000 = 56% of copies fit
+		{ 11, 9050, 8080, 3 },
+		{ 12, 8000, 8000, 0 }, // at the floor there is no room left for copies
+		{ 24, 8000, 8000, 0 },
+	};
+
+	// The loss decays in the smoothing, the budget holds between the thresholds, then increases by one step per report
+	const TraceSegment RECOVERY_SEGMENTS[] = { { { 30, 80, 10 }, 20 }, { { 0, 50, 5 }, 60 } };
+	const TraceCheckpoint RECOVERY_CHECKPOINTS[] = {
+		{ 19, 8000, 8000, 0 },
+		{ 28, 8000, 8000, 0 }, // smoothed loss 2.2, not under the low threshold yet
+		{ 29, 9000, 8333, 2 },
+		{ 33, 13000, 12500, 1 },
+		{ 34, 14000, 14000, 0 },
+		{ 44, 24000, 24000, 0 }, // 16 steps of 1000 from the floor
+		{ 79, 24000, 24000, 0 },
+	};
+
+	// Loss between the thresholds neither backs off nor increases, copies cover it if the caller enabled them
+	const TraceSegment MODERATE_LOSS_SEGMENTS[] = { { { 5, 50, 5 }, 30 } };
+	const TraceCheckpoint MODERATE_LOSS_CHECKPOINTS[] = { { 0, 24000, 23076, 1 }, { 8, 24000, 20000, 5 }, { 29, 24000, 20000, 5 } };
+	const TraceCheckpoint MODERATE_LOSS_NO_FEC_CHECKPOINTS[] = { { 0, 24000, 24000, 0 }, { 29, 24000, 24000, 0 } };
+
+	// Delay or jitter back off without any loss
+	const TraceSegment DELAY_SEGMENTS[] = { { { 0, RATE_CONTROL_ROUND_TRIP_HIGH_MILIS + 100, 5 }, 3 } };
+	const TraceSegment JITTER_SEGMENTS[] = { { { 0, 50, RATE_CONTROL_JITTER_HIGH_MILIS + 20 }, 3 } };
+	const TraceCheckpoint BACK_OFF_CHECKPOINTS[] = { { 0, 20400, 20400, 0 }, { 1, 17340, 17340, 0 }, { 2, 14739, 14739, 0 } };
+
+	// wntgd_SetBitRateBounds: a raised floor and a lowered ceiling hold on both paths
+	const TraceSegment BOUNDS_SEGMENTS[] = { { { 0, 50, 5 }, 10 }, { { 50, 600, 100 }, 20 }, { { 0, 50, 5 }, 40 } };
+	const TraceCheckpoint BOUNDS_CHECKPOINTS[] = {
+		{ 9, 16000, 16000, 0 },
+		{ 10, 13600, 12142, 3 }, // 13% expected does not fit over payloads of 12000: (13600 - 12000) / 12000 = 13% of copies
+		{ 11, 12000, 12000, 0 },
+		{ 40, 12000, 12000, 0 },
+		{ 41, 13000, 12037, 2 },
+		{ 69, 16000, 16000, 0 },
+	};
+
+#define TEST_TRACE(name, segments, checkpoints, minimum, ceiling, redundancy) \
+	{ name, segments, sizeof(segments) / sizeof(segments[0]), checkpoints, sizeof(checkpoints) / sizeof(checkpoints[0]), minimum, ceiling, redundancy }
+
+	const Trace TEST_TRACES[] = {
+		TEST_TRACE("clean", CLEAN_SEGMENTS, CLEAN_CHECKPOINTS, TEST_BIT_RATE_MIN, TEST_BIT_RATE_CEILING, true),
+		TEST_TRACE("loss burst", LOSS_BURST_SEGMENTS, LOSS_BURST_CHECKPOINTS, TEST_BIT_RATE_MIN, TEST_BIT_RATE_CEILING, true),
+		TEST_TRACE("recovery", RECOVERY_SEGMENTS, RECOVERY_CHECKPOINTS, TEST_BIT_RATE_MIN, TEST_BIT_RATE_CEILING, true),
+		TEST_TRACE("moderate loss", MODERATE_LOSS_SEGMENTS, MODERATE_LOSS_CHECKPOINTS, TEST_BIT_RATE_MIN, TEST_BIT_RATE_CEILING, true),
+		TEST_TRACE("moderate loss without fec", MODERATE_LOSS_SEGMENTS, MODERATE_LOSS_NO_FEC_CHECKPOINTS, TEST_BIT_RATE_MIN, TEST_BIT_RATE_CEILING, false),
+		TEST_TRACE("delay", DELAY_SEGMENTS, BACK_OFF_CHECKPOINTS, TEST_BIT_RATE_MIN, TEST_BIT_RATE_CEILING, true),
+		TEST_TRACE("jitter", JITTER_SEGMENTS, BACK_OFF_CHECKPOINTS, TEST_BIT_RATE_MIN, TEST_BIT_RATE_CEILING, true),
+		TEST_TRACE("bounds", BOUNDS_SEGMENTS, BOUNDS_CHECKPOINTS, 12000, 16000, true),
+	};
+}
+
+int main()
+{
+	for (const Trace& trace : TEST_TRACES)
+	{
+		ReplayTrace(trace);
+	}
+	printf("RateControlTest: %d failures\n", failureCount);
+	return failureCount > 0 ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "../SwitchVoiceChatResampler.h"
+
+// Checks the contract of Resample: an output buffer shorter than GetResamplerOutputCapacity is refused without
+// touching the state, and with a full size buffer every input sample is consumed, whatever the block sizes.
+//   ResamplerTest (returns 1 if a check fails)
+namespace {
+	using namespace SwitchVoiceChatResampler;
+
+	struct RatePair
+	{
+		int inputRate;
+		int outputRate;
+	};
+
+	const RatePair TEST_RATE_PAIRS[] = { { 44100, 48000 }, { 48000, 44100 }, { 16000, 48000 }, { 48000, 16000 }, { 32000, 48000 }, { 48000, 48000 } };
+	const ResamplerQuality TEST_QUALITIES[] = { ResamplerQuality_Fast, ResamplerQuality_High };
+	const int TEST_BLOCK_SAMPLE_COUNTS[] = { 1, 7, 480, 1023, 1024, 1025, 2205, 4800 };
+	const int TEST_INPUT_SAMPLE_COUNT = 48000;
+
+	int failureCount = 0;
+
+	void Expect(bool condition, const RatePair& rates, ResamplerQuality quality, int blockSampleCount, const char* message)
+	{
+		if (condition) return;
+		failureCount++;
+		printf("FAIL %d -> %d Hz, quality %d, blocks of %d: %s\n", rates.inputRate, rates.outputRate, quality, blockSampleCount, message);
+	}
+
+	// A short output buffer is refused and the state is left as it was
+	void TestShortOutput(ResamplerFilter* filter, ResamplerState* state, const RatePair& rates, ResamplerQuality quality, const std::vector<int16_t>& input)
+	{
+		for (int blockSampleCount : TEST_BLOCK_SAMPLE_COUNTS)
+		{
+			ClearResamplerState(state);
+			std::vector<int16_t> output(GetResamplerOutputCapacity(filter, blockSampleCount) + 1, 0x5555);
+			int capacity = GetResamplerOutputCapacity(filter, blockSampleCount) - 1;
+			int inputCount = state->inputCount;
+			uint64_t position = state->position;
+			int count = Resample(filter, state, input.data(), blockSampleCount, output.data(), capacity);
+			Expect(count == -1, rates, quality, blockSampleCount, "a short output buffer is not refused");
+			Expect(state->inputCount == inputCount && state->position == position, rates, quality, blockSampleCount, "a refused call changed the state");
+			Expect(output[0] == 0x5555, rates, quality, blockSampleCount, "a refused call wrote to the output");
+		}
+	}
+
+	// With full size buffers nothing is left over or dropped, and the output follows the rate ratio
+	void TestFullOutput(ResamplerFilter* filter, ResamplerState* state, const RatePair& rates, ResamplerQuality quality, const std::vector<int16_t>& input)
+	{
+		for (int blockSampleCount : TEST_BLOCK_SAMPLE_COUNTS)
+		{
+			ClearResamplerState(state);
+			int capacity = GetResamplerOutputCapacity(filter, blockSampleCount);
+			std::vector<int16_t> output(capacity + 1);
+			int64_t outputCount = 0;
+			bool consumed = true;
+			for (int i = 0; i + blockSampleCount <= TEST_INPUT_SAMPLE_COUNT; i += blockSampleCount)
+			{
+				output[capacity] = 0x5555;
+				int count = Resample(filter, state, input.data() + i, blockSampleCount, output.data(), capacity);
+				if (count < 0 || count > capacity || output[capacity] != 0x5555) consumed = false;
+				if (!filter->bypass && state->inputCount >= filter->tapCount) consumed = false;
+				outputCount += count;
+			}
+			Expect(consumed, rates, quality, blockSampleCount, "the input was not entirely consumed within the output capacity");
+
+			int inputCount = TEST_INPUT_SAMPLE_COUNT / blockSampleCount * blockSampleCount;
+			int64_t expectedCount = static_cast<int64_t>(inputCount) * rates.outputRate / rates.inputRate;
+			// the output of the last taps of input is still pending
+			int64_t lag = filter->bypass ? 0 : static_cast<int64_t>(filter->tapCount + 1) * rates.outputRate / rates.inputRate + 1;
+			Expect(outputCount <= expectedCount + 1 && outputCount >= expectedCount - lag, rates, quality, blockSampleCount, "the output does not follow the rate ratio");
+		}
+	}
+}
+
+int main()
+{
+	std::vector<int16_t> input(TEST_INPUT_SAMPLE_COUNT);
+	uint32_t seed = 12345;
+	for (int i = 0; i < TEST_INPUT_SAMPLE_COUNT; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		input[i] = static_cast<int16_t>(seed >> 16);
+	}
+
+	// the filter tables do not fit every stack
+	ResamplerFilter* filter = new ResamplerFilter;
+	ResamplerState* state = new ResamplerState;
+	for (const RatePair& rates : TEST_RATE_PAIRS)
+	{
+		for (ResamplerQuality quality : TEST_QUALITIES)
+		{
+			InitializeResamplerFilter(filter, rates.inputRate, rates.outputRate, quality);
+			TestShortOutput(filter, state, rates, quality, input);
+			TestFullOutput(filter, state, rates, quality, input);
+		}
+	}
+	delete state;
+	delete filter;
+	printf("ResamplerTest: %d failures\n", failureCount);
+	return failureCount > 0 ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "../SwitchVoiceChatSimd.h"
+
+// Checks every kernel of SwitchVoiceChatSimd.h against its scalar reference, bit for bit, for the instruction set
+// the test is built for (see CMakeLists.txt). Lengths cover the vector tails, inputs cover the saturation of int16.
+//   SimdTest (returns 1 if a kernel differs from its reference)
+namespace {
+	const int TEST_LENGTHS[] = { 0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 33, 1001 };
+	const int TEST_LENGTH_MAX = 1001;
+
+	int failureCount = 0;
+
+	// Fixed sequence, so a failure can be reproduced
+	uint32_t randomState = 12345;
+	uint32_t NextRandom()
+	{
+		randomState = randomState * 1664525 + 1013904223;
+		return randomState;
+	}
+
+	// Every tenth value is one of the extremes of the type
+	template <typename Sample> Sample MakeSample();
+	template <> int8_t MakeSample<int8_t>()
+	{
+		uint32_t value = NextRandom();
+		if (value % 10 == 0) return (value & 0x100) ? INT8_MAX : INT8_MIN;
+		return static_cast<int8_t>(value >> 24);
+	}
+	template <> int16_t MakeSample<int16_t>()
+	{
+		uint32_t value = NextRandom();
+		if (value % 10 == 0) return (value & 0x100) ? INT16_MAX : INT16_MIN;
+		return static_cast<int16_t>(value >> 16);
+	}
+	template <> int32_t MakeSample<int32_t>()
+	{
+		uint32_t value = NextRandom();
+		if (value % 10 == 0) return (value & 0x100) ? INT32_MAX : INT32_MIN;
+		return static_cast<int32_t>(value);
+	}
+	// Up to 1.5 times full scale, with exact ties of the rounding
+	template <> float MakeSample<float>()
+	{
+		uint32_t value = NextRandom();
+		if (value % 10 == 0) return (value & 0x100) ? 1.0f : -1.0f;
+		if (value % 10 == 1) return static_cast<float>(static_cast<int>(value >> 20) - 2048) * 0.5f / 32767;
+		return (static_cast<float>(value >> 8) / (1 << 24) - 0.5f) * 3.0f;
+	}
+
+	// int16 scale values beyond the int16 range, and exact ties of the rounding
+	float MakeInt16ScaleValue()
+	{
+		uint32_t value = NextRandom();
+		if (value % 10 == 0) return (value & 0x100) ? 40000.0f : -40000.0f;
+		if (value % 10 == 1) return static_cast<float>(static_cast<int>(value >> 16) - 32768) + 0.5f;
+		return (static_cast<float>(value >> 8) / (1 << 24) - 0.5f) * 80000.0f;
+	}
+
+	template <typename Sample>
+	std::vector<Sample> MakeSamples(size_t count)
+	{
+		std::vector<Sample> samples(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			samples[i] = MakeSample<Sample>();
+		}
+		return samples;
+	}
+
+	std::vector<float> MakeInt16ScaleValues(size_t count)
+	{
+		std::vector<float> values(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			values[i] = MakeInt16ScaleValue();
+		}
+		return values;
+	}
+
+	// The buffers hold one element more than count, so a kernel that writes past count is caught
+	template <typename Sample>
+	void Check(const char* kernel, int channelCount, int count, const std::vector<Sample>& expected, const std::vector<Sample>& actual)
+	{
+		if (memcmp(expected.data(), actual.data(), expected.size() * sizeof(Sample)) == 0) return;
+		failureCount++;
+		printf("FAIL %s channels %d count %d\n", kernel, channelCount, count);
+	}
+
+	void TestConvertInt16ToFloat()
+	{
+		for (int count : TEST_LENGTHS)
+		{
+			std::vector<int16_t> in = MakeSamples<int16_t>(count);
+			std::vector<float> expected(count + 1, -7.0f);
+			std::vector<float> actual(count + 1, -7.0f);
+			SwitchVoiceChatSimd::ConvertInt16ToFloatReference(expected.data(), in.data(), count);
+			SwitchVoiceChatSimd::ConvertInt16ToFloat(actual.data(), in.data(), count);
+			Check("ConvertInt16ToFloat", 1, count, expected, actual);
+		}
+	}
+
+	void TestMultiplyAccumulateInt16()
+	{
+		const float gains[] = { 0.0f, 0.25f, 1.0f, 1.7f };
+		for (int count : TEST_LENGTHS)
+		{
+			for (float gain : gains)
+			{
+				std::vector<int16_t> in = MakeSamples<int16_t>(count);
+				std::vector<float> expected = MakeInt16ScaleValues(count + 1);
+				std::vector<float> actual = expected;
+				SwitchVoiceChatSimd::MultiplyAccumulateInt16Reference(expected.data(), in.data(), gain, count);
+				SwitchVoiceChatSimd::MultiplyAccumulateInt16(actual.data(), in.data(), gain, count);
+				Check("MultiplyAccumulateInt16", 1, count, expected, actual);
+			}
+		}
+	}
+
+	void TestMultiplyAccumulateInt16Ramp()
+	{
+		for (int count : TEST_LENGTHS)
+		{
+			std::vector<int16_t> in = MakeSamples<int16_t>(count);
+			std::vector<float> expected = MakeInt16ScaleValues(count + 1);
+			std::vector<float> actual = expected;
+			float gainStep = count > 0 ? -0.9f / count : 0.0f;
+			SwitchVoiceChatSimd::MultiplyAccumulateInt16RampReference(expected.data(), in.data(), 1.0f, gainStep, count);
+			SwitchVoiceChatSimd::MultiplyAccumulateInt16Ramp(actual.data(), in.data(), 1.0f, gainStep, count);
+			Check("MultiplyAccumulateInt16Ramp", 1, count, expected, actual);
+		}
+	}
+
+	// count is a multiple of 8 for this kernel
+	void TestDotProductInt16()
+	{
+		const int lengths[] = { 0, 8, 16, 24, 64, 1000 };
+		for (int count : lengths)
+		{
+			std::vector<int16_t> in = MakeSamples<int16_t>(count);
+			std::vector<float> coefficients = MakeSamples<float>(count);
+			std::vector<float> expected(1, SwitchVoiceChatSimd::DotProductInt16Reference(in.data(), coefficients.data(), count));
+			std::vector<float> actual(1, SwitchVoiceChatSimd::DotProductInt16(in.data(), coefficients.data(), count));
+			Check("DotProductInt16", 1, count, expected, actual);
+		}
+	}
+
+	void TestInterleaveSaturateToInt16()
+	{
+		const int channelCounts[] = { 1, 2, 3, 6 };
+		for (int channelCount : channelCounts)
+		{
+			for (int count : TEST_LENGTHS)
+			{
+				std::vector<float> planeData = MakeInt16ScaleValues(TEST_LENGTH_MAX * channelCount);
+				const float* planes[6];
+				for (int channel = 0; channel < channelCount; channel++)
+				{
+					planes[channel] = planeData.data() + channel * TEST_LENGTH_MAX;
+				}
+				std::vector<int16_t> expected(count * channelCount + 1, 0x5555);
+				std::vector<int16_t> actual(count * channelCount + 1, 0x5555);
+				SwitchVoiceChatSimd::InterleaveSaturateToInt16Reference(expected.data(), planes, channelCount, count);
+				SwitchVoiceChatSimd::InterleaveSaturateToInt16(actual.data(), planes, channelCount, count);
+				Check("InterleaveSaturateToInt16", channelCount, count, expected, actual);
+			}
+		}
+	}
+
+	template <typename Sample, int ChannelCount>
+	void TestDownmixToInt16(const char* kernel)
+	{
+		for (int count : TEST_LENGTHS)
+		{
+			std::vector<Sample> in = MakeSamples<Sample>(count * ChannelCount);
+			std::vector<int16_t> expected(count + 1, 0x5555);
+			std::vector<int16_t> actual(count + 1, 0x5555);
+			SwitchVoiceChatSimd::DownmixToInt16Reference<Sample, ChannelCount>(expected.data(), in.data(), count);
+			SwitchVoiceChatSimd::DownmixToInt16<Sample, ChannelCount>(actual.data(), in.data(), count);
+			Check(kernel, ChannelCount, count, expected, actual);
+		}
+	}
+
+	// The layouts of GetCaptureConvertFunction
+	template <typename Sample>
+	void TestDownmixToInt16Layouts(const char* kernel)
+	{
+		TestDownmixToInt16<Sample, 1>(kernel);
+		TestDownmixToInt16<Sample, 2>(kernel);
+		TestDownmixToInt16<Sample, 4>(kernel);
+		TestDownmixToInt16<Sample, 6>(kernel);
+	}
+
+	const char* GetInstructionSetName()
+	{
+#if defined(WNTGD_SIMD_NEON)
+		return "NEON";
+#elif defined(WNTGD_SIMD_AVX2)
+		return "AVX2";
+#elif defined(WNTGD_SIMD_SSE2)
+		return "SSE2";
+#else
+		return "scalar";
+#endif
+	}
+}
+
+int main()
+{
+#if defined(WNTGD_SIMD_AVX2) && (defined(__GNUC__) || defined(__clang__))
+	if (!__builtin_cpu_supports("avx2"))
+	{
+		printf("SimdTest: this CPU has no AVX2, skipped\n");
+		return 0;
+	}
+#endif
+	TestConvertInt16ToFloat();
+	TestMultiplyAccumulateInt16();
+	TestMultiplyAccumulateInt16Ramp();
+	TestDotProductInt16();
+	TestInterleaveSaturateToInt16();
+	TestDownmixToInt16Layouts<int8_t>("DownmixToInt16<int8_t>");
+	TestDownmixToInt16Layouts<int16_t>("DownmixToInt16<int16_t>");
+	TestDownmixToInt16Layouts<int32_t>("DownmixToInt16<int32_t>");
+	TestDownmixToInt16Layouts<float>("DownmixToInt16<float>");
+	printf("SimdTest (%s): %d failures\n", GetInstructionSetName(), failureCount);
+	return failureCount > 0 ? 1 : 0;
+}
@@ -0,0 +1,668 @@
+#include <nn/nn_Log.h>
+#include <nn/os.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "HostAudioDevice.h"
+#include "../SwitchVoiceChatNativeCode.h"
+#include "../SwitchVoiceChatDecodeNativeCode.h"
+#include "../SwitchVoiceChatBatchDecodeNativeCode.h"
+#include "../SwitchVoiceChatMixNativeCode.h"
+#include "../SwitchVoiceChatMemoryNativeCode.h"
+
+// Measures each stage of the voice path and the whole chain with recorded speech and synthetic signals,
+// at 1 to 64 concurrent streams, and writes the report as JSON.
+//   VoiceBenchmark [speech <wav>] [frames <n>] [streams <n,n,...>] [threads <n>] [json <path>]
+// The stages are called directly (no library thread runs) and only the voice code is timed. The devices run much faster
+// than real time but not at speed 0, where AudioIn would refill buffers as fast as GetMicrophoneInput queues them.
+// A frame is what one call handles, frameMicroSeconds is its duration of audio:
+//   capture     GetMicrophoneInput, one AudioIn buffer
+//   encode      EncodeFrame, one Opus frame (voice activity detection is off, so every frame is encoded)
+//   decompress  wntgd_DecompressVoiceData and wntgd_ReleaseDecompressBuffer, one frame of the default speaker
+//   decode      wntgd_DecompressSpeakerVoiceDataPcm16Into, one frame of one of the speakers
+//   batch       wntgd_DecompressVoiceBatchPcm16, one frame of every speaker per call on the calling thread and threads workers
+//   mix         MixFrame, one AudioOut buffer of all the speakers (decoded from their jitter buffers)
+//   resample    Resample, one AudioOut buffer of the decoded voice from the mixer rate to RESAMPLE_OUTPUT_RATE,
+//               once per ResamplerQuality (resample-fast, resample-high), also reported as samplesPerSecond of input
+//   chain       one AudioIn buffer captured, encoded, pushed to all the speakers and mixed
+// framesPerSecond counts the time spent in the measured calls only. The memory budget declares MAX_SPEAKER_COUNT speakers;
+// stream counts the mixer cannot hold are reported as skipped.
+namespace {
+	using namespace SwitchVoiceChatNativeCode;
+	using namespace SwitchVoiceChatDecodeNativeCode;
+	using namespace SwitchVoiceChatBatchDecodeNativeCode;
+	using namespace SwitchVoiceChatMixNativeCode;
+	using namespace SwitchVoiceChatMemoryNativeCode;
+
+	const float DEVICE_SPEED = 100; // one AudioIn buffer every 0.5 ms
+	const int SIGNAL_SAMPLE_RATE = 48000;
+	const int SIGNAL_LENGTH_SECONDS = 4; // the synthetic signals loop after this
+	const float SIGNAL_PI = 3.14159265f;
+	const int SPEAKER_DISTANCE = 2;
+	const int MAX_SPEAKER_COUNT = 64;
+	const int MAX_CAPTURE_BUFFER_SIZE = 48000 * SwitchVoiceChatNativeCode::BUFFER_LENGTH_MILIS / 1000 * 6 * sizeof(float); // any speech WAV up to 5.1 float
+	const int MAX_MIXED_SPEAKER_COUNT = MAX_SPEAKER_COUNT < MAX_MIXER_SPEAKER_COUNT ? MAX_SPEAKER_COUNT : MAX_MIXER_SPEAKER_COUNT;
+	const int MAX_DECODED_SAMPLE_COUNT = SIGNAL_SAMPLE_RATE * 120 / 1000;
+	const int CAPTURE_FRAME_MICRO_SECONDS = SwitchVoiceChatNativeCode::BUFFER_LENGTH_MILIS * 1000;
+	const int MIX_FRAME_MICRO_SECONDS = SwitchVoiceChatMixNativeCode::BUFFER_LENGTH_MILIS * 1000;
+	const int MIX_FRAME_SAMPLE_COUNT = MIX_SAMPLE_RATE * SwitchVoiceChatMixNativeCode::BUFFER_LENGTH_MILIS / 1000;
+	const int RESAMPLE_OUTPUT_RATE = 44100; // an AudioOut device that is not at the mixer rate
+	const SwitchVoiceChatResampler::ResamplerQuality RESAMPLER_QUALITIES[] = { SwitchVoiceChatResampler::ResamplerQuality_Fast, SwitchVoiceChatResampler::ResamplerQuality_High };
+	const char* RESAMPLER_STAGE_NAMES[] = { "resample-fast", "resample-high" };
+
+	thread_local uint64_t allocationCount; // operator new calls of this thread (the library allocates with new only)
+
+	enum SignalType
+	{
+		SignalType_Speech,
+		SignalType_Sine,
+		SignalType_Sweep,
+		SignalType_Noise,
+		SignalType_Count
+	};
+
+	const char* SIGNAL_NAMES[SignalType_Count] = { "speech", "sine", "sweep", "noise" };
+
+	// Time and heap allocations of the measured calls
+	struct Measurement
+	{
+		std::vector<int64_t> frameTimes; // nanoseconds
+		uint64_t allocationCount;
+		nn::os::Tick start;
+		uint64_t startAllocationCount;
+	};
+
+	struct Report
+	{
+		FILE* file;
+		bool hasResult;
+	};
+
+	const char* GetArgument(const char* name, const char* defaultValue)
+	{
+		char** argv = nn::os::GetHostArgv();
+		for (int i = 1; i + 1 < nn::os::GetHostArgc(); i++)
+		{
+			if (strcmp(argv[i], name) == 0) return argv[i + 1];
+		}
+		return defaultValue;
+	}
+
+	std::vector<int> ParseStreamCounts(const char* list)
+	{
+		std::vector<int> streamCounts;
+		while (*list)
+		{
+			char* end;
+			long count = strtol(list, &end, 10);
+			if (end == list) break;
+			if (count > 0) streamCounts.push_back(static_cast<int>(count));
+			list = *end == ',' ? end + 1 : end;
+		}
+		return streamCounts;
+	}
+
+	// Mono int16 at -12 dBFS: a 440 Hz sine, a logarithmic sweep from 100 Hz to 8 kHz or white noise
+	std::vector<int16_t> GenerateSignal(SignalType signalType)
+	{
+		std::vector<int16_t> samples(SIGNAL_SAMPLE_RATE * SIGNAL_LENGTH_SECONDS);
+		float amplitude = 32767 * powf(10, -12.0f / 20);
+		float phase = 0;
+		uint32_t seed = 12345;
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			float value = 0;
+			if (signalType == SignalType_Noise)
+			{
+				seed = seed * 1664525 + 1013904223;
+				value = static_cast<float>(static_cast<int32_t>(seed)) / 2147483648.0f;
+			}
+			else
+			{
+				float frequency = 440;
+				if (signalType == SignalType_Sweep) frequency = 100 * powf(80, static_cast<float>(i) / samples.size());
+				value = sinf(phase);
+				phase += 2 * SIGNAL_PI * frequency / SIGNAL_SAMPLE_RATE;
+				if (phase > 2 * SIGNAL_PI) phase -= 2 * SIGNAL_PI;
+			}
+			samples[i] = static_cast<int16_t>(value * amplitude);
+		}
+		return samples;
+	}
+
+	void InitializeMeasurement(Measurement* measurement, size_t frameCount)
+	{
+		measurement->frameTimes.clear();
+		measurement->frameTimes.reserve(frameCount);
+		measurement->allocationCount = 0;
+	}
+
+	void BeginFrame(Measurement* measurement)
+	{
+		measurement->startAllocationCount = allocationCount;
+		measurement->start = nn::os::GetSystemTick();
+	}
+
+	// The time is shared by the frameCount frames handled since BeginFrame
+	void EndFrame(Measurement* measurement, int frameCount)
+	{
+		nn::os::Tick end = nn::os::GetSystemTick();
+		measurement->allocationCount += allocationCount - measurement->startAllocationCount;
+		int64_t frameTime = (end - measurement->start).ToTimeSpan().GetNanoSeconds() / frameCount;
+		for (int i = 0; i < frameCount; i++)
+		{
+			measurement->frameTimes.push_back(frameTime);
+		}
+	}
+
+	void BeginResult(Report* report, const char* signal, const char* stage, int streamCount)
+	{
+		fprintf(report->file, "%s\n\t\t{ \"signal\": \"%s\", \"stage\": \"%s\", \"streams\": %d, ", report->hasResult ? "," : "", signal, stage, streamCount);
+		report->hasResult = true;
+	}
+
+	void WriteSkippedResult(Report* report, const char* signal, const char* stage, int streamCount, const char* reason)
+	{
+		BeginResult(report, signal, stage, streamCount);
+		fprintf(report->file, "\"skipped\": \"%s\" }", reason);
+	}
+
+	// Nearest rank percentile of sorted times, in microseconds
+	double GetPercentile(const std::vector<int64_t>& sortedTimes, double percent)
+	{
+		size_t rank = static_cast<size_t>(ceil(percent / 100 * sortedTimes.size()));
+		if (rank > 0) rank--;
+		return sortedTimes[rank] / 1000.0;
+	}
+
+	// frameSampleCount > 0 also reports the input samples handled per second
+	void WriteResult(Report* report, const char* signal, const char* stage, int streamCount, int64_t frameMicroSeconds, Measurement* measurement,
+		int frameSampleCount = 0)
+	{
+		std::vector<int64_t>& times = measurement->frameTimes;
+		if (times.empty())
+		{
+			WriteSkippedResult(report, signal, stage, streamCount, "no frame was produced");
+			return;
+		}
+		int64_t totalTime = 0;
+		for (size_t i = 0; i < times.size(); i++)
+		{
+			totalTime += times[i];
+		}
+		std::sort(times.begin(), times.end());
+
+		BeginResult(report, signal, stage, streamCount);
+		double framesPerSecond = totalTime > 0 ? times.size() * 1e9 / totalTime : 0.0;
+		fprintf(report->file, "\"frameMicroSeconds\": %lld, \"frames\": %zu, \"framesPerSecond\": %.1f, ",
+			static_cast<long long>(frameMicroSeconds), times.size(), framesPerSecond);
+		if (frameSampleCount > 0) fprintf(report->file, "\"samplesPerSecond\": %.0f, ", framesPerSecond * frameSampleCount);
+		fprintf(report->file, "\"latencyMicroSeconds\": { \"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f }, \"allocationsPerFrame\": %.3f }",
+			GetPercentile(times, 50), GetPercentile(times, 99), times.back() / 1000.0, static_cast<double>(measurement->allocationCount) / times.size());
+		if (frameSampleCount > 0)
+		{
+			NN_LOG("%-7s %-13s %2d streams: p50 %8.2f us, p99 %8.2f us, %.1f Msamples/s\n", signal, stage, streamCount,
+				GetPercentile(times, 50), GetPercentile(times, 99), framesPerSecond * frameSampleCount / 1e6);
+		}
+		else NN_LOG("%-7s %-13s %2d streams: p50 %8.2f us, p99 %8.2f us\n", signal, stage, streamCount, GetPercentile(times, 50), GetPercentile(times, 99));
+	}
+
+	// Duration of the audio of one voice frame
+	int64_t GetPacketMicroSeconds(const std::vector<unsigned char>& packet)
+	{
+		int sampleCount = 0;
+		if (!wntgd_GetDecompressedSampleCount(packet.data(), static_cast<int>(packet.size()), &sampleCount)) return 0;
+		return static_cast<int64_t>(sampleCount) * 1000000 / MIX_SAMPLE_RATE;
+	}
+
+	// Split the voice buffers of the encoder into one packet per frame
+	void CollectPackets(std::vector<std::vector<unsigned char>>* packets)
+	{
+		intptr_t handle;
+		unsigned char* buffer;
+		int count;
+		if (!wntgd_GetVoiceBuffer(&handle, &buffer, &count)) return;
+		while (count > 0)
+		{
+			SwitchVoiceChatPacketFormat::FrameHeader header;
+			int headerSize = SwitchVoiceChatPacketFormat::ReadFrameHeader(buffer, count, &header);
+			if (headerSize < 0) break;
+			int frameSize = headerSize + header.payloadSize;
+			packets->push_back(std::vector<unsigned char>(buffer, buffer + frameSize));
+			buffer += frameSize;
+			count -= frameSize;
+		}
+		wntgd_ReleaseVoiceBuffer(&handle);
+	}
+
+	// Capture and encode frameCount frames, the packets are kept for the decode stages
+	bool MeasureCaptureAndEncode(Report* report, const char* signal, int frameCount, std::vector<std::vector<unsigned char>>* packets)
+	{
+		CaptureSession* session = GetDefaultCaptureSession();
+		if (!OpenRecording(session, false, 0)) return false;
+		Measurement capture;
+		Measurement encode;
+		InitializeMeasurement(&capture, frameCount);
+		InitializeMeasurement(&encode, frameCount);
+		packets->clear();
+		packets->reserve(frameCount + ENCODED_PACKET_QUEUE_CAPACITY);
+		while (static_cast<int>(packets->size()) < frameCount)
+		{
+			BeginFrame(&capture);
+			int bufferCount = GetMicrophoneInput(session);
+			if (bufferCount == 0)
+			{
+				nn::os::SleepThread(nn::TimeSpan::FromMicroSeconds(0));
+				continue;
+			}
+			EndFrame(&capture, bufferCount);
+
+			while (true)
+			{
+				BeginFrame(&encode);
+				if (!EncodeFrame(session)) break;
+				EndFrame(&encode, 1);
+			}
+			CollectPackets(packets);
+		}
+		CloseRecording(session);
+
+		WriteResult(report, signal, "capture", 1, CAPTURE_FRAME_MICRO_SECONDS, &capture);
+		WriteResult(report, signal, "encode", 1, GetPacketMicroSeconds(packets->front()), &encode);
+		return true;
+	}
+
+	void MeasureDecompress(Report* report, const char* signal, std::vector<std::vector<unsigned char>>& packets)
+	{
+		Measurement decompress;
+		InitializeMeasurement(&decompress, packets.size());
+		for (size_t i = 0; i < packets.size(); i++)
+		{
+			intptr_t handle;
+			float* audioOut;
+			int sampleCount;
+			unsigned int sampleRate;
+			BeginFrame(&decompress);
+			wntgd_DecompressVoiceData(&handle, packets[i].data(), static_cast<int>(packets[i].size()), &audioOut, &sampleCount, &sampleRate);
+			wntgd_ReleaseDecompressBuffer(reinterpret_cast<intptr_t*>(handle));
+			EndFrame(&decompress, 1);
+		}
+		WriteResult(report, signal, "decompress", 1, GetPacketMicroSeconds(packets.front()), &decompress);
+	}
+
+	bool CreateSpeakers(std::vector<intptr_t>* speakers, int streamCount, bool mixed)
+	{
+		speakers->clear();
+		for (int i = 0; i < streamCount; i++)
+		{
+			intptr_t speaker;
+			if (!wntgd_CreateSpeakerDecoder(&speaker)) return false;
+			speakers->push_back(speaker);
+			if (!mixed) continue;
+			// spread around the listener, so the panning is measured too
+			wntgd_AddMixerSpeaker(speaker, 1.0f / streamCount);
+			wntgd_SetMixerSpeakerPosition(speaker, 360.0f * i / streamCount, SPEAKER_DISTANCE);
+		}
+		return true;
+	}
+
+	void DestroySpeakers(const std::vector<intptr_t>& speakers)
+	{
+		for (size_t i = 0; i < speakers.size(); i++)
+		{
+			wntgd_RemoveMixerSpeaker(speakers[i]);
+			wntgd_DestroySpeakerDecoder(speakers[i]);
+		}
+	}
+
+	void MeasureDecode(Report* report, const char* signal, int streamCount, const std::vector<std::vector<unsigned char>>& packets)
+	{
+		std::vector<intptr_t> speakers;
+		std::vector<int16_t> audioOut(MAX_DECODED_SAMPLE_COUNT);
+		Measurement decode;
+		InitializeMeasurement(&decode, packets.size() * streamCount);
+		if (!CreateSpeakers(&speakers, streamCount, false))
+		{
+			DestroySpeakers(speakers);
+			return;
+		}
+		for (size_t i = 0; i < packets.size(); i++)
+		{
+			for (int stream = 0; stream < streamCount; stream++)
+			{
+				int sampleCount;
+				unsigned int sampleRate;
+				BeginFrame(&decode);
+				wntgd_DecompressSpeakerVoiceDataPcm16Into(speakers[stream], packets[i].data(), static_cast<int>(packets[i].size()),
+					audioOut.data(), MAX_DECODED_SAMPLE_COUNT, &sampleCount, &sampleRate);
+				EndFrame(&decode, 1);
+			}
+		}
+		DestroySpeakers(speakers);
+		WriteResult(report, signal, "decode", streamCount, GetPacketMicroSeconds(packets.front()), &decode);
+	}
+
+	void MeasureBatch(Report* report, const char* signal, int streamCount, const std::vector<std::vector<unsigned char>>& packets)
+	{
+		std::vector<intptr_t> speakers;
+		std::vector<VoiceBatchItem> items(streamCount);
+		std::vector<int16_t> audioOut(MAX_DECODED_SAMPLE_COUNT * streamCount);
+		Measurement batch;
+		InitializeMeasurement(&batch, packets.size() * streamCount);
+		if (!CreateSpeakers(&speakers, streamCount, false))
+		{
+			DestroySpeakers(speakers);
+			return;
+		}
+		for (size_t i = 0; i < packets.size(); i++)
+		{
+			for (int stream = 0; stream < streamCount; stream++)
+			{
+				items[stream].speakerHandle = speakers[stream];
+				items[stream].inputBuffer = packets[i].data();
+				items[stream].count = static_cast<int>(packets[i].size());
+			}
+			BeginFrame(&batch);
+			wntgd_DecompressVoiceBatchPcm16(items.data(), streamCount, audioOut.data(), static_cast<int>(audioOut.size()));
+			EndFrame(&batch, streamCount);
+		}
+		DestroySpeakers(speakers);
+		WriteResult(report, signal, "batch", streamCount, GetPacketMicroSeconds(packets.front()), &batch);
+	}
+
+	void MeasureMix(Report* report, const char* signal, int streamCount, const std::vector<std::vector<unsigned char>>& packets)
+	{
+		if (!OpenPlayback()) return;
+		std::vector<intptr_t> speakers;
+		std::vector<int16_t> audioOut(MIX_FRAME_SAMPLE_COUNT * AUDIO_OUT_CHANNEL_COUNT_MAX);
+		Measurement mix;
+		InitializeMeasurement(&mix, packets.size() * 2);
+		if (CreateSpeakers(&speakers, streamCount, true))
+		{
+			// the speakers receive one frame, then the mixer plays as much audio as was received
+			int64_t receivedMicroSeconds = 0;
+			int64_t mixedMicroSeconds = 0;
+			for (size_t i = 0; i < packets.size(); i++)
+			{
+				for (int stream = 0; stream < streamCount; stream++)
+				{
+					wntgd_PushSpeakerVoiceData(speakers[stream], packets[i].data(), static_cast<int>(packets[i].size()));
+				}
+				receivedMicroSeconds += GetPacketMicroSeconds(packets[i]);
+				while (mixedMicroSeconds + MIX_FRAME_MICRO_SECONDS <= receivedMicroSeconds)
+				{
+					BeginFrame(&mix);
+					MixFrame(audioOut.data());
+					EndFrame(&mix, 1);
+					mixedMicroSeconds += MIX_FRAME_MICRO_SECONDS;
+				}
+			}
+		}
+		DestroySpeakers(speakers);
+		ClosePlayback();
+		WriteResult(report, signal, "mix", streamCount, MIX_FRAME_MICRO_SECONDS, &mix);
+	}
+
+	// The packets decoded by one speaker at the mixer rate, as the mixer hands them to its output resampler
+	bool DecodePackets(const std::vector<std::vector<unsigned char>>& packets, std::vector<int16_t>* voice)
+	{
+		intptr_t speaker;
+		if (!wntgd_CreateSpeakerDecoder(&speaker)) return false;
+		std::vector<int16_t> audioOut(MAX_DECODED_SAMPLE_COUNT);
+		voice->clear();
+		for (size_t i = 0; i < packets.size(); i++)
+		{
+			int sampleCount;
+			unsigned int sampleRate;
+			if (!wntgd_DecompressSpeakerVoiceDataPcm16Into(speaker, packets[i].data(), static_cast<int>(packets[i].size()),
+				audioOut.data(), MAX_DECODED_SAMPLE_COUNT, &sampleCount, &sampleRate)) continue;
+			voice->insert(voice->end(), audioOut.begin(), audioOut.begin() + sampleCount);
+		}
+		wntgd_DestroySpeakerDecoder(speaker);
+		return true;
+	}
+
+	void MeasureResample(Report* report, const char* signal, const std::vector<std::vector<unsigned char>>& packets)
+	{
+		std::vector<int16_t> voice;
+		if (!DecodePackets(packets, &voice)) return;
+		// the filter tables do not fit the stack of every platform
+		SwitchVoiceChatResampler::ResamplerFilter* filter = new SwitchVoiceChatResampler::ResamplerFilter;
+		SwitchVoiceChatResampler::ResamplerState* state = new SwitchVoiceChatResampler::ResamplerState;
+		for (int quality = 0; quality < static_cast<int>(sizeof(RESAMPLER_QUALITIES) / sizeof(RESAMPLER_QUALITIES[0])); quality++)
+		{
+			SwitchVoiceChatResampler::InitializeResamplerFilter(filter, MIX_SAMPLE_RATE, RESAMPLE_OUTPUT_RATE, RESAMPLER_QUALITIES[quality]);
+			SwitchVoiceChatResampler::ClearResamplerState(state);
+			int outCapacity = SwitchVoiceChatResampler::GetResamplerOutputCapacity(filter, MIX_FRAME_SAMPLE_COUNT);
+			std::vector<int16_t> audioOut(outCapacity);
+			Measurement resample;
+			InitializeMeasurement(&resample, voice.size() / MIX_FRAME_SAMPLE_COUNT);
+			for (size_t i = 0; i + MIX_FRAME_SAMPLE_COUNT <= voice.size(); i += MIX_FRAME_SAMPLE_COUNT)
+			{
+				BeginFrame(&resample);
+				SwitchVoiceChatResampler::Resample(filter, state, voice.data() + i, MIX_FRAME_SAMPLE_COUNT, audioOut.data(), outCapacity);
+				EndFrame(&resample, 1);
+			}
+			WriteResult(report, signal, RESAMPLER_STAGE_NAMES[quality], 1, MIX_FRAME_MICRO_SECONDS, &resample, MIX_FRAME_SAMPLE_COUNT);
+		}
+		delete state;
+		delete filter;
+	}
+
+	void MeasureChain(Report* report, const char* signal, int streamCount, int frameCount, int64_t frameMicroSeconds)
+	{
+		if (!OpenPlayback()) return;
+		CaptureSession* session = GetDefaultCaptureSession();
+		if (!OpenRecording(session, false, 0))
+		{
+			ClosePlayback();
+			return;
+		}
+		std::vector<intptr_t> speakers;
+		std::vector<int16_t> audioOut(MIX_FRAME_SAMPLE_COUNT * AUDIO_OUT_CHANNEL_COUNT_MAX);
+		Measurement chain;
+		InitializeMeasurement(&chain, frameCount);
+		if (CreateSpeakers(&speakers, streamCount, true))
+		{
+			// as much audio as the other stages
+			int64_t capturedMicroSeconds = 0;
+			int64_t mixedMicroSeconds = 0;
+			while (capturedMicroSeconds < frameCount * frameMicroSeconds)
+			{
+				BeginFrame(&chain);
+				int bufferCount = GetMicrophoneInput(session);
+				if (bufferCount == 0)
+				{
+					nn::os::SleepThread(nn::TimeSpan::FromMicroSeconds(0));
+					continue;
+				}
+				Encode(session);
+				intptr_t handle;
+				unsigned char* buffer;
+				int count;
+				if (wntgd_GetVoiceBuffer(&handle, &buffer, &count))
+				{
+					for (int stream = 0; stream < streamCount; stream++)
+					{
+						wntgd_PushSpeakerVoiceData(speakers[stream], buffer, count);
+					}
+					wntgd_ReleaseVoiceBuffer(&handle);
+				}
+				capturedMicroSeconds += bufferCount * CAPTURE_FRAME_MICRO_SECONDS;
+				while (mixedMicroSeconds + MIX_FRAME_MICRO_SECONDS <= capturedMicroSeconds)
+				{
+					MixFrame(audioOut.data());
+					mixedMicroSeconds += MIX_FRAME_MICRO_SECONDS;
+				}
+				EndFrame(&chain, bufferCount);
+			}
+		}
+		DestroySpeakers(speakers);
+		CloseRecording(session);
+		ClosePlayback();
+		WriteResult(report, signal, "chain", streamCount, CAPTURE_FRAME_MICRO_SECONDS, &chain);
+	}
+
+	bool MeasureSignal(Report* report, const char* signal, int frameCount, const std::vector<int>& streamCounts)
+	{
+		if (!wntgd_InitializeDecoder()) return false;
+		std::vector<std::vector<unsigned char>> packets;
+		if (!MeasureCaptureAndEncode(report, signal, frameCount, &packets))
+		{
+			wntgd_FinalizeDecoder();
+			return false;
+		}
+		int64_t frameMicroSeconds = GetPacketMicroSeconds(packets.front());
+		MeasureDecompress(report, signal, packets);
+		MeasureResample(report, signal, packets);
+
+		char decoderPoolFull[64];
+		char mixerFull[64];
+		snprintf(decoderPoolFull, sizeof(decoderPoolFull), "the memory budget declares %d speakers", MAX_SPEAKER_COUNT);
+		snprintf(mixerFull, sizeof(mixerFull), "the mixer holds %d speakers", MAX_MIXED_SPEAKER_COUNT);
+		for (size_t i = 0; i < streamCounts.size(); i++)
+		{
+			int streamCount = streamCounts[i];
+			if (streamCount <= MAX_SPEAKER_COUNT)
+			{
+				MeasureDecode(report, signal, streamCount, packets);
+				MeasureBatch(report, signal, streamCount, packets);
+			}
+			else
+			{
+				WriteSkippedResult(report, signal, "decode", streamCount, decoderPoolFull);
+				WriteSkippedResult(report, signal, "batch", streamCount, decoderPoolFull);
+			}
+			if (streamCount <= MAX_MIXED_SPEAKER_COUNT)
+			{
+				MeasureMix(report, signal, streamCount, packets);
+				MeasureChain(report, signal, streamCount, frameCount, frameMicroSeconds);
+			}
+			else
+			{
+				WriteSkippedResult(report, signal, "mix", streamCount, mixerFull);
+				WriteSkippedResult(report, signal, "chain", streamCount, mixerFull);
+			}
+		}
+		wntgd_FinalizeDecoder();
+		return true;
+	}
+}
+
+// Counts the allocations of each thread (the replaceable operator delete are replaced with them, as they must)
+void* operator new(size_t size)
+{
+	allocationCount++;
+	void* memory = malloc(size ? size : 1);
+	if (!memory) throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	allocationCount++;
+	return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+extern "C" void nnMain()
+{
+	const char* speechPath = GetArgument("speech", nullptr);
+	int frameCount = atoi(GetArgument("frames", "500"));
+	std::vector<int> streamCounts = ParseStreamCounts(GetArgument("streams", "1,2,4,8,16,32,64"));
+	int threadCount = atoi(GetArgument("threads", "0"));
+	const char* jsonPath = GetArgument("json", "VoiceBenchmark.json");
+	if (frameCount <= 0 || streamCounts.empty() || threadCount < 0 || threadCount > BATCH_DECODE_THREAD_COUNT_MAX)
+	{
+		NN_LOG("Usage: VoiceBenchmark [speech <wav>] [frames <n>] [streams <n,n,...>] [threads <0-%d>] [json <path>]\n", BATCH_DECODE_THREAD_COUNT_MAX);
+		return;
+	}
+
+	Report report;
+	report.file = fopen(jsonPath, "w");
+	report.hasResult = false;
+	if (!report.file)
+	{
+		NN_LOG("Cannot write %s\n", jsonPath);
+		return;
+	}
+
+	HostAudioDevice::SetDeviceSpeed(DEVICE_SPEED);
+	HostAudioDevice::SetAudioOutSink(nullptr);
+	HostAudioDevice::SetAudioOutFormat(MIX_SAMPLE_RATE, 2, nn::audio::SampleFormat_PcmInt16);
+	wntgd_SetVoiceActivityDetection(false);
+
+	VoiceMemoryBudget budget = {};
+	budget.maxSpeakerCount = MAX_SPEAKER_COUNT;
+	budget.maxCaptureBufferSize = MAX_CAPTURE_BUFFER_SIZE;
+	budget.decodeThreadCount = threadCount;
+	VoiceMemoryFootprint footprint;
+	if (!wntgd_InitializeVoiceMemory(&budget) || !wntgd_GetVoiceMemoryFootprint(&footprint, sizeof(footprint)))
+	{
+		NN_LOG("Cannot reserve the voice memory\n");
+		fclose(report.file);
+		return;
+	}
+
+	fprintf(report.file, "{\n\t\"benchmark\": \"VoiceBenchmark\",\n\t\"frames\": %d,\n\t\"decodeThreads\": %d,\n", frameCount, threadCount);
+	fprintf(report.file, "\t\"memory\": { \"reservedBytes\": %u, \"encoderBytes\": %u, \"decoderBytes\": %u, \"mixerBytes\": %u, \"speakers\": %d },\n\t\"results\": [",
+		footprint.reservedSize, footprint.encoderReservedSize, footprint.decoderReservedSize, footprint.mixerReservedSize, MAX_SPEAKER_COUNT);
+	for (int signalType = 0; signalType < SignalType_Count; signalType++)
+	{
+		if (signalType == SignalType_Speech)
+		{
+			if (!speechPath) continue;
+			if (!HostAudioDevice::SetAudioInSource(speechPath))
+			{
+				NN_LOG("Cannot read %s (PCM or float WAV)\n", speechPath);
+				continue;
+			}
+		}
+		else
+		{
+			std::vector<int16_t> samples = GenerateSignal(static_cast<SignalType>(signalType));
+			HostAudioDevice::SetAudioInSamples(samples.data(), samples.size(), SIGNAL_SAMPLE_RATE, 1, nn::audio::SampleFormat_PcmInt16);
+		}
+		if (!MeasureSignal(&report, SIGNAL_NAMES[signalType], frameCount, streamCounts))
+		{
+			NN_LOG("Cannot start the voice pipeline\n");
+		}
+	}
+	fprintf(report.file, "\n\t]\n}\n");
+	fclose(report.file);
+	wntgd_FinalizeVoiceMemory();
+	NN_LOG("Report written to %s\n", jsonPath);
+}
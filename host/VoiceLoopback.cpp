@@ -0,0 +1,110 @@
+#include <nn/nn_Log.h>
+#include <nn/os.h>
+#include "HostAudioDevice.h"
+#include "../SwitchVoiceChatNativeCode.h"
+#include "../SwitchVoiceChatDecodeNativeCode.h"
+#include "../SwitchVoiceChatMixNativeCode.h"
+#include "../SwitchVoiceChatStatsNativeCode.h"
+#include "../SwitchVoiceChatMemoryNativeCode.h"
+
+// Runs the whole voice path on the host: the AudioIn source is captured and encoded, the packets go to one speaker
+// whose decoded voice is mixed into the AudioOut sink.
+//   VoiceLoopback [in <wav>] [out <wav>] [seconds <n>] [speed <x>]
+// speed 1 is real time (default), speed 10 runs ten times faster. At speed 0 the microphone outruns the encoder.
+namespace {
+	const int LOOPBACK_POLL_MILIS = 1;
+	const int LOOPBACK_CAPTURE_BUFFER_SIZE = 48000 * SwitchVoiceChatNativeCode::BUFFER_LENGTH_MILIS / 1000 * 6 * sizeof(float); // any WAV up to 5.1 float
+
+	const char* GetArgument(const char* name, const char* defaultValue)
+	{
+		char** argv = nn::os::GetHostArgv();
+		for (int i = 1; i + 1 < nn::os::GetHostArgc(); i++)
+		{
+			if (strcmp(argv[i], name) == 0) return argv[i + 1];
+		}
+		return defaultValue;
+	}
+}
+
+extern "C" void nnMain()
+{
+	const char* inPath = GetArgument("in", nullptr);
+	const char* outPath = GetArgument("out", nullptr);
+	int seconds = atoi(GetArgument("seconds", "10"));
+	float speed = static_cast<float>(atof(GetArgument("speed", "1")));
+
+	if (inPath && !HostAudioDevice::SetAudioInSource(inPath))
+	{
+		NN_LOG("Cannot read %s (PCM or float WAV)\n", inPath);
+		return;
+	}
+	HostAudioDevice::SetAudioOutSink(outPath);
+	HostAudioDevice::SetDeviceSpeed(speed);
+
+	// one remote speaker
+	SwitchVoiceChatMemoryNativeCode::VoiceMemoryBudget budget = {};
+	budget.maxSpeakerCount = 1;
+	budget.maxCaptureBufferSize = LOOPBACK_CAPTURE_BUFFER_SIZE;
+	intptr_t speaker = 0;
+	if (!SwitchVoiceChatMemoryNativeCode::wntgd_InitializeVoiceMemory(&budget)
+		|| !SwitchVoiceChatDecodeNativeCode::wntgd_InitializeDecoder()
+		|| !SwitchVoiceChatDecodeNativeCode::wntgd_CreateSpeakerDecoder(&speaker)
+		|| !SwitchVoiceChatMixNativeCode::wntgd_StartVoicePlayback()
+		|| !SwitchVoiceChatMixNativeCode::wntgd_AddMixerSpeaker(speaker, 1.0f)
+		|| !SwitchVoiceChatNativeCode::wntgd_StartRecordVoice())
+	{
+		NN_LOG("Cannot start the voice pipeline\n");
+		return;
+	}
+
+	SwitchVoiceChatMemoryNativeCode::VoiceMemoryFootprint footprint;
+	if (SwitchVoiceChatMemoryNativeCode::wntgd_GetVoiceMemoryFootprint(&footprint, sizeof(footprint)))
+	{
+		NN_LOG("Voice memory in use: encoder %u of %u bytes, decoder %u of %u bytes, mixer %u of %u bytes\n", footprint.encoderUsedSize,
+			footprint.encoderReservedSize, footprint.decoderUsedSize, footprint.decoderReservedSize, footprint.mixerUsedSize, footprint.mixerReservedSize);
+	}
+
+	nn::os::Tick start = nn::os::GetSystemTick();
+	int64_t packetCount = 0;
+	int64_t byteCount = 0;
+	while (HostAudioDevice::GetAudioInDuration() < nn::TimeSpan::FromSeconds(seconds))
+	{
+		intptr_t handle;
+		unsigned char* buffer;
+		int count;
+		if (SwitchVoiceChatNativeCode::wntgd_GetVoiceBuffer(&handle, &buffer, &count))
+		{
+			SwitchVoiceChatDecodeNativeCode::wntgd_PushSpeakerVoiceData(speaker, buffer, count);
+			SwitchVoiceChatNativeCode::wntgd_ReleaseVoiceBuffer(&handle);
+			packetCount++;
+			byteCount += count;
+		}
+		else
+		{
+			nn::os::SleepThread(nn::TimeSpan::FromMilliSeconds(speed > 0 ? LOOPBACK_POLL_MILIS : 0));
+		}
+	}
+	nn::TimeSpan elapsed = (nn::os::GetSystemTick() - start).ToTimeSpan();
+
+	SwitchVoiceChatNativeCode::wntgd_StopRecordVoice();
+	SwitchVoiceChatMixNativeCode::wntgd_StopVoicePlayback();
+	SwitchVoiceChatDecodeNativeCode::wntgd_DestroySpeakerDecoder(speaker);
+	SwitchVoiceChatDecodeNativeCode::wntgd_FinalizeDecoder();
+	SwitchVoiceChatMemoryNativeCode::wntgd_FinalizeVoiceMemory();
+
+	NN_LOG("Captured %lld ms, played %lld ms in %lld ms\n", static_cast<long long>(HostAudioDevice::GetAudioInDuration().GetMilliSeconds()),
+		static_cast<long long>(HostAudioDevice::GetAudioOutDuration().GetMilliSeconds()), static_cast<long long>(elapsed.GetMilliSeconds()));
+	NN_LOG("Sent %lld voice buffers, %lld bytes\n", static_cast<long long>(packetCount), static_cast<long long>(byteCount));
+
+	using namespace SwitchVoiceChatStatsNativeCode;
+	VoiceStats stats;
+	if (wntgd_GetVoiceStats(&stats, sizeof(stats)))
+	{
+		const VoiceHistogram& captureToPacket = stats.histograms[VoiceHistogram_CaptureToPacketMicroSeconds];
+		NN_LOG("Encoded %u frames (%u silent), decoded %u (%u concealed), %u jitter buffer underruns, %u AudioOut underruns\n",
+			stats.counters[VoiceCounter_EncodedFrames], stats.counters[VoiceCounter_SilentFrames], stats.counters[VoiceCounter_DecodedFrames],
+			stats.counters[VoiceCounter_ConcealedFrames], stats.counters[VoiceCounter_JitterBufferUnderruns], stats.counters[VoiceCounter_AudioOutUnderruns]);
+		NN_LOG("Capture to packet: %llu us average, %u us maximum\n",
+			static_cast<unsigned long long>(captureToPacket.count > 0 ? captureToPacket.sum / captureToPacket.count : 0), captureToPacket.maximum);
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <nn/audio.h>
+
+// Configuration of the host audio devices, to call before the device is opened.
+// The default AudioIn is silence (48 kHz, mono, int16) and the default AudioOut discards the samples (48 kHz, stereo, int16).
+namespace HostAudioDevice {
+	// PCM (8, 16, 24 or 32 bit) or float WAV file read by the default AudioIn, the device takes its format.
+	// nullptr goes back to silence. The file is played in a loop.
+	bool SetAudioInSource(const char* path);
+	void SetAudioInFormat(int sampleRate, int channelCount, nn::audio::SampleFormat sampleFormat);
+
+	// Samples (interleaved, in the format of the device) played in a loop by the default AudioIn instead of a file.
+	// They are copied; nullptr goes back to silence.
+	void SetAudioInSamples(const void* samples, size_t frameCount, int sampleRate, int channelCount, nn::audio::SampleFormat sampleFormat);
+
+	// WAV file written by the default AudioOut in the format of the device, nullptr discards the samples
+	void SetAudioOutSink(const char* path);
+	void SetAudioOutFormat(int sampleRate, int channelCount, nn::audio::SampleFormat sampleFormat);
+
+	// Speed of the device clock: 1 is real time, 4 releases the buffers 4 times faster.
+	// 0 releases every buffer as soon as it is appended, so the pipeline runs as fast as the code allows.
+	void SetDeviceSpeed(float speed);
+
+	// Audio handled by the devices since the start of the program
+	nn::TimeSpan GetAudioInDuration();
+	nn::TimeSpan GetAudioOutDuration();
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <nn/nn_Common.h>
+#include <nn/os.h>
+
+// Audio devices of the host build: every AudioIn reads a WAV file (or silence), every AudioOut writes a WAV file
+// (or discards the samples). See HostAudioDevice.h to choose the files and the speed of the device clock.
+namespace nn { namespace audio {
+	struct HostAudioDevice;
+
+	enum SampleFormat
+	{
+		SampleFormat_Invalid,
+		SampleFormat_PcmInt8,
+		SampleFormat_PcmInt16,
+		SampleFormat_PcmInt24,
+		SampleFormat_PcmInt32,
+		SampleFormat_PcmFloat
+	};
+
+	enum AudioInState
+	{
+		AudioInState_Started,
+		AudioInState_Stopped
+	};
+
+	enum AudioOutState
+	{
+		AudioOutState_Started,
+		AudioOutState_Stopped
+	};
+
+	const int AudioInCountMax = 8;
+	const int AudioOutCountMax = 8;
+	const int AudioDeviceNameLengthMax = 256;
+
+	struct AudioInInfo
+	{
+		char name[AudioDeviceNameLengthMax];
+	};
+
+	struct AudioOutInfo
+	{
+		char name[AudioDeviceNameLengthMax];
+	};
+
+	struct AudioInParameter
+	{
+		int sampleRate; // 0: the rate of the device
+		int channelCount; // 0: the channels of the device
+	};
+
+	struct AudioOutParameter
+	{
+		int sampleRate;
+		int channelCount;
+	};
+
+	struct AudioInBuffer
+	{
+		static const size_t AddressAlignment = 4096;
+		static const size_t SizeGranularity = 4096;
+
+		void* buffer;
+		size_t bufferSize;
+		size_t dataSize;
+		AudioInBuffer* next;
+	};
+
+	struct AudioOutBuffer
+	{
+		static const size_t AddressAlignment = 4096;
+		static const size_t SizeGranularity = 4096;
+
+		void* buffer;
+		size_t bufferSize;
+		size_t dataSize;
+		AudioOutBuffer* next;
+	};
+
+	struct AudioIn
+	{
+		HostAudioDevice* device;
+	};
+
+	struct AudioOut
+	{
+		static float GetVolumeMin() { return 0.0f; }
+		static float GetVolumeMax() { return 2.0f; }
+
+		HostAudioDevice* device;
+	};
+
+	size_t GetSampleByteSize(SampleFormat format);
+
+	int ListAudioIns(AudioInInfo* outInfos, int count);
+	void InitializeAudioInParameter(AudioInParameter* parameter);
+	Result OpenDefaultAudioIn(AudioIn* audioIn, const AudioInParameter& parameter);
+	Result OpenDefaultAudioIn(AudioIn* audioIn, os::SystemEvent* bufferEvent, const AudioInParameter& parameter);
+	Result OpenAudioIn(AudioIn* audioIn, const char* name, const AudioInParameter& parameter);
+	Result OpenAudioIn(AudioIn* audioIn, os::SystemEvent* bufferEvent, const char* name, const AudioInParameter& parameter);
+	void CloseAudioIn(AudioIn* audioIn);
+	Result StartAudioIn(AudioIn* audioIn);
+	void StopAudioIn(AudioIn* audioIn);
+	AudioInState GetAudioInState(const AudioIn* audioIn);
+	const char* GetAudioInName(const AudioIn* audioIn);
+	int GetAudioInChannelCount(const AudioIn* audioIn);
+	int GetAudioInSampleRate(const AudioIn* audioIn);
+	SampleFormat GetAudioInSampleFormat(const AudioIn* audioIn);
+	void SetAudioInBufferInfo(AudioInBuffer* audioInBuffer, void* buffer, size_t bufferSize, size_t dataSize);
+	bool AppendAudioInBuffer(AudioIn* audioIn, AudioInBuffer* audioInBuffer);
+	AudioInBuffer* GetReleasedAudioInBuffer(AudioIn* audioIn);
+	void* GetAudioInBufferDataPointer(const AudioInBuffer* audioInBuffer);
+	size_t GetAudioInBufferDataSize(const AudioInBuffer* audioInBuffer);
+
+	int ListAudioOuts(AudioOutInfo* outInfos, int count);
+	void InitializeAudioOutParameter(AudioOutParameter* parameter);
+	Result OpenDefaultAudioOut(AudioOut* audioOut, const AudioOutParameter& parameter);
+	Result OpenDefaultAudioOut(AudioOut* audioOut, os::SystemEvent* bufferEvent, const AudioOutParameter& parameter);
+	Result OpenAudioOut(AudioOut* audioOut, const char* name, const AudioOutParameter& parameter);
+	Result OpenAudioOut(AudioOut* audioOut, os::SystemEvent* bufferEvent, const char* name, const AudioOutParameter& parameter);
+	void CloseAudioOut(AudioOut* audioOut);
+	Result StartAudioOut(AudioOut* audioOut);
+	void StopAudioOut(AudioOut* audioOut);
+	AudioOutState GetAudioOutState(const AudioOut* audioOut);
+	const char* GetAudioOutName(const AudioOut* audioOut);
+	int GetAudioOutChannelCount(const AudioOut* audioOut);
+	int GetAudioOutSampleRate(const AudioOut* audioOut);
+	SampleFormat GetAudioOutSampleFormat(const AudioOut* audioOut);
+	float GetAudioOutVolume(const AudioOut* audioOut);
+	void SetAudioOutVolume(AudioOut* audioOut, float volume);
+	void SetAudioOutBufferInfo(AudioOutBuffer* audioOutBuffer, void* buffer, size_t bufferSize, size_t dataSize);
+	bool AppendAudioOutBuffer(AudioOut* audioOut, AudioOutBuffer* audioOutBuffer);
+	AudioOutBuffer* GetReleasedAudioOutBuffer(AudioOut* audioOut);
+	void* GetAudioOutBufferDataPointer(const AudioOutBuffer* audioOutBuffer);
+	size_t GetAudioOutBufferDataSize(const AudioOutBuffer* audioOutBuffer);
+}}
@@ -0,0 +1,71 @@
+#pragma once
+#include <nn/nn_Common.h>
+
+// nn::codec Opus encoder and decoder on top of libopus. Like on the device, a packet is an Opus packet
+// after an 8 byte header: its size and the final range of the encoder (both big endian).
+namespace nn { namespace codec {
+	enum OpusResult
+	{
+		OpusResult_Success,
+		OpusResult_InvalidSampleRate,
+		OpusResult_InvalidChannelCount,
+		OpusResult_InvalidWorkBuffer,
+		OpusResult_InvalidPacket,
+		OpusResult_InsufficientOpusBuffer,
+		OpusResult_InsufficientPcmBuffer,
+		OpusResult_UnsupportedFrameSize,
+		OpusResult_InternalError
+	};
+
+	enum OpusCodingMode
+	{
+		OpusCodingMode_Auto,
+		OpusCodingMode_Celt,
+		OpusCodingMode_Silk
+	};
+
+	const int OpusPacketHeaderSize = 8;
+	const size_t OpusPacketSizeMaximum = 1275 + OpusPacketHeaderSize;
+
+	class OpusEncoder
+	{
+	public:
+		OpusEncoder() : m_Encoder(nullptr), m_SampleRate(0), m_ChannelCount(0) {}
+		size_t GetWorkBufferSize(int sampleRate, int channelCount) const;
+		OpusResult Initialize(int sampleRate, int channelCount, void* workBuffer, size_t workBufferSize);
+		void Finalize();
+		bool IsInitialized() const { return m_Encoder != nullptr; }
+		int GetSampleRate() const { return m_SampleRate; }
+		int GetChannelCount() const { return m_ChannelCount; }
+		void SetBitRate(int bitRate);
+		int GetBitRate() const;
+		// libopus cannot force a mode on a running encoder: Celt and Silk only hint the signal type
+		void BindCodingMode(OpusCodingMode codingMode);
+		int CalculateFrameSampleCount(int frameDurationMicroSeconds) const;
+		OpusResult EncodeInterleaved(size_t* outputSize, void* outputBuffer, size_t outputBufferSize, const int16_t* inputBuffer, int inputSampleCount);
+
+	private:
+		void* m_Encoder; // libopus state in the work buffer
+		int m_SampleRate;
+		int m_ChannelCount;
+	};
+
+	class OpusDecoder
+	{
+	public:
+		OpusDecoder() : m_Decoder(nullptr), m_SampleRate(0), m_ChannelCount(0) {}
+		size_t GetWorkBufferSize(int sampleRate, int channelCount) const;
+		OpusResult Initialize(int sampleRate, int channelCount, void* workBuffer, size_t workBufferSize);
+		void Finalize();
+		bool IsInitialized() const { return m_Decoder != nullptr; }
+		int GetSampleRate() const { return m_SampleRate; }
+		int GetChannelCount() const { return m_ChannelCount; }
+		// outputSize is in bytes
+		OpusResult DecodeInterleaved(size_t* consumed, int* outputSampleCount, int16_t* outputBuffer, size_t outputSize, const void* inputBuffer, size_t inputSize);
+
+	private:
+		void* m_Decoder;
+		int m_SampleRate;
+		int m_ChannelCount;
+	};
+}}
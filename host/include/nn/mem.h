@@ -0,0 +1,30 @@
+#pragma once
+#include <nn/nn_Common.h>
+
+namespace nn { namespace mem {
+	struct HostAllocatorState;
+
+	// First fit allocator over the memory given to Initialize, so a budget that is too small fails like on the device.
+	// It is thread safe.
+	class StandardAllocator
+	{
+	public:
+		StandardAllocator() : m_State(nullptr) {}
+		StandardAllocator(void* address, size_t size) : m_State(nullptr) { Initialize(address, size); }
+		~StandardAllocator() { Finalize(); }
+		void Initialize(void* address, size_t size);
+		void Finalize();
+		void* Allocate(size_t size) { return Allocate(size, DefaultAlignment); }
+		void* Allocate(size_t size, size_t alignment);
+		void Free(void* address);
+		size_t GetTotalFreeSize() const;
+		size_t GetAllocatableSize() const;
+
+		static const size_t DefaultAlignment = 16;
+
+	private:
+		StandardAllocator(const StandardAllocator&);
+		StandardAllocator& operator=(const StandardAllocator&);
+		HostAllocatorState* m_State;
+	};
+}}
@@ -0,0 +1,2 @@
+#pragma once
+#include <nn/nn_Common.h>
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Host (Linux) replacement of the parts of the Nintendo SDK used by the voice library (see host/CMakeLists.txt)
+namespace nn {
+	class Result
+	{
+	public:
+		Result() : m_Value(0) {}
+		explicit Result(int value) : m_Value(value) {}
+		bool IsSuccess() const { return m_Value == 0; }
+		bool IsFailure() const { return m_Value != 0; }
+		int GetInnerValueForDebug() const { return m_Value; }
+
+	private:
+		int m_Value;
+	};
+
+	inline Result ResultSuccess() { return Result(); }
+
+	namespace util {
+		template <typename T>
+		T align_up(T value, size_t alignment)
+		{
+			return static_cast<T>((value + alignment - 1) / alignment * alignment);
+		}
+	}
+}
+
+#define NN_UNUSED(variable) (void)(variable)
+#define NN_LOG(...) printf(__VA_ARGS__)
+#define NN_ABORT(...) do { fprintf(stderr, __VA_ARGS__); abort(); } while (0)
+#define NN_ABORT_UNLESS(condition, ...) do { if (!(condition)) NN_ABORT(__VA_ARGS__); } while (0)
+#define NN_ASSERT(condition) do { if (!(condition)) NN_ABORT("Assertion failed: %s (%s:%d)\n", #condition, __FILE__, __LINE__); } while (0)
+#define NN_ASSERT_NOT_NULL(pointer) NN_ASSERT((pointer) != nullptr)
+#define NN_SDK_ASSERT(condition) NN_ASSERT(condition)
+#define NN_UNEXPECTED_DEFAULT NN_ABORT("Unexpected default (%s:%d)\n", __FILE__, __LINE__)
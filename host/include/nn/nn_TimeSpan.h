@@ -0,0 +1,28 @@
+#pragma once
+#include <nn/nn_Common.h>
+
+namespace nn {
+	class TimeSpan
+	{
+	public:
+		TimeSpan() : m_NanoSeconds(0) {}
+		static TimeSpan FromNanoSeconds(int64_t value) { TimeSpan span; span.m_NanoSeconds = value; return span; }
+		static TimeSpan FromMicroSeconds(int64_t value) { return FromNanoSeconds(value * 1000); }
+		static TimeSpan FromMilliSeconds(int64_t value) { return FromNanoSeconds(value * 1000 * 1000); }
+		static TimeSpan FromSeconds(int64_t value) { return FromNanoSeconds(value * 1000 * 1000 * 1000); }
+		int64_t GetNanoSeconds() const { return m_NanoSeconds; }
+		int64_t GetMicroSeconds() const { return m_NanoSeconds / 1000; }
+		int64_t GetMilliSeconds() const { return m_NanoSeconds / (1000 * 1000); }
+		int64_t GetSeconds() const { return m_NanoSeconds / (1000 * 1000 * 1000); }
+
+		friend TimeSpan operator+(TimeSpan left, TimeSpan right) { return FromNanoSeconds(left.m_NanoSeconds + right.m_NanoSeconds); }
+		friend TimeSpan operator-(TimeSpan left, TimeSpan right) { return FromNanoSeconds(left.m_NanoSeconds - right.m_NanoSeconds); }
+		friend bool operator<(TimeSpan left, TimeSpan right) { return left.m_NanoSeconds < right.m_NanoSeconds; }
+		friend bool operator>(TimeSpan left, TimeSpan right) { return left.m_NanoSeconds > right.m_NanoSeconds; }
+		friend bool operator<=(TimeSpan left, TimeSpan right) { return left.m_NanoSeconds <= right.m_NanoSeconds; }
+		friend bool operator>=(TimeSpan left, TimeSpan right) { return left.m_NanoSeconds >= right.m_NanoSeconds; }
+
+	private:
+		int64_t m_NanoSeconds;
+	};
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include <nn/nn_Common.h>
+#include <nn/nn_TimeSpan.h>
+
+// Threads, events and mutexes on top of the C++ standard library. Thread stacks given by the caller are not used,
+// priorities and cores are ignored.
+namespace nn { namespace os {
+	struct HostEvent;
+	struct HostMutex;
+	struct HostThread;
+
+	enum EventClearMode
+	{
+		EventClearMode_ManualClear,
+		EventClearMode_AutoClear
+	};
+
+	struct EventType
+	{
+		HostEvent* event;
+	};
+
+	struct SystemEventType
+	{
+		HostEvent* event;
+	};
+
+	struct MutexType
+	{
+		HostMutex* mutex;
+	};
+
+	typedef void (*ThreadFunction)(void* argument);
+
+	struct ThreadType
+	{
+		HostThread* thread;
+	};
+
+	const size_t ThreadStackAlignment = 4096;
+	const int HighestThreadPriority = 0;
+	const int DefaultThreadPriority = 16;
+	const int LowestThreadPriority = 31;
+
+	void InitializeEvent(EventType* event, bool signaled, EventClearMode clearMode);
+	void FinalizeEvent(EventType* event);
+	void WaitEvent(EventType* event);
+	bool TimedWaitEvent(EventType* event, TimeSpan timeout);
+	void SignalEvent(EventType* event);
+	void ClearEvent(EventType* event);
+
+	// The host audio devices create the system events they signal
+	void CreateSystemEvent(SystemEventType* event, EventClearMode clearMode);
+	void DestroySystemEvent(SystemEventType* event);
+	void WaitSystemEvent(SystemEventType* event);
+	bool TimedWaitSystemEvent(SystemEventType* event, TimeSpan timeout);
+	void SignalSystemEvent(SystemEventType* event);
+	void ClearSystemEvent(SystemEventType* event);
+
+	void InitializeMutex(MutexType* mutex, bool recursive, int lockLevel);
+	void FinalizeMutex(MutexType* mutex);
+	void LockMutex(MutexType* mutex);
+	bool TryLockMutex(MutexType* mutex);
+	void UnlockMutex(MutexType* mutex);
+
+	Result CreateThread(ThreadType* thread, ThreadFunction function, void* argument, void* stack, size_t stackSize, int priority);
+	Result CreateThread(ThreadType* thread, ThreadFunction function, void* argument, void* stack, size_t stackSize, int priority, int idealCore);
+	void StartThread(ThreadType* thread);
+	void WaitThread(ThreadType* thread);
+	void DestroyThread(ThreadType* thread);
+	void SetThreadName(ThreadType* thread, const char* name);
+	void SleepThread(TimeSpan time);
+	int GetCurrentCoreNumber();
+
+	class Event
+	{
+	public:
+		explicit Event(EventClearMode clearMode) { InitializeEvent(&m_Event, false, clearMode); }
+		~Event() { FinalizeEvent(&m_Event); }
+		void Wait() { WaitEvent(&m_Event); }
+		bool TimedWait(TimeSpan timeout) { return TimedWaitEvent(&m_Event, timeout); }
+		void Signal() { SignalEvent(&m_Event); }
+		void Clear() { ClearEvent(&m_Event); }
+		EventType* GetBase() { return &m_Event; }
+
+	private:
+		Event(const Event&);
+		Event& operator=(const Event&);
+		EventType m_Event;
+	};
+
+	class SystemEvent
+	{
+	public:
+		SystemEvent() { m_Event.event = nullptr; }
+		void Wait() { WaitSystemEvent(&m_Event); }
+		bool TimedWait(TimeSpan timeout) { return TimedWaitSystemEvent(&m_Event, timeout); }
+		void Signal() { SignalSystemEvent(&m_Event); }
+		void Clear() { ClearSystemEvent(&m_Event); }
+		SystemEventType* GetBase() { return &m_Event; }
+
+	private:
+		SystemEvent(const SystemEvent&);
+		SystemEvent& operator=(const SystemEvent&);
+		SystemEventType m_Event;
+	};
+
+	class Mutex
+	{
+	public:
+		explicit Mutex(bool recursive) { InitializeMutex(&m_Mutex, recursive, 0); }
+		~Mutex() { FinalizeMutex(&m_Mutex); }
+		void Lock() { LockMutex(&m_Mutex); }
+		bool TryLock() { return TryLockMutex(&m_Mutex); }
+		void Unlock() { UnlockMutex(&m_Mutex); }
+		MutexType* GetBase() { return &m_Mutex; }
+
+	private:
+		Mutex(const Mutex&);
+		Mutex& operator=(const Mutex&);
+		MutexType m_Mutex;
+	};
+
+	// One tick is one nanosecond of the steady clock
+	class Tick
+	{
+	public:
+		Tick() : m_Value(0) {}
+		explicit Tick(int64_t value) : m_Value(value) {}
+		int64_t GetInt64Value() const { return m_Value; }
+		TimeSpan ToTimeSpan() const { return TimeSpan::FromNanoSeconds(m_Value); }
+		friend Tick operator+(Tick left, Tick right) { return Tick(left.m_Value + right.m_Value); }
+		friend Tick operator-(Tick left, Tick right) { return Tick(left.m_Value - right.m_Value); }
+
+	private:
+		int64_t m_Value;
+	};
+
+	Tick GetSystemTick();
+	int64_t GetSystemTickFrequency();
+
+	// Set by the host main() before nnMain is called
+	void SetHostArgument(int argc, char** argv);
+	int GetHostArgc();
+	char** GetHostArgv();
+}}
@@ -0,0 +1,4 @@
+#pragma once
+#include <nn/nn_Common.h>
+
+#define NNS_LOG(...) NN_LOG(__VA_ARGS__)
@@ -0,0 +1,696 @@
+#include <nn/audio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HostAudioDevice.h"
+
+namespace nn { namespace audio {
+	const int DEFAULT_SAMPLE_RATE = 48000;
+	// every microphone reads the same source, like players sitting next to each other
+	const char* const AUDIO_IN_NAMES[] = { "HostAudioIn", "HostAudioIn2", "HostAudioIn3", "HostAudioIn4" };
+	const int AUDIO_IN_NAME_COUNT = sizeof(AUDIO_IN_NAMES) / sizeof(AUDIO_IN_NAMES[0]);
+	const char AUDIO_OUT_NAME[] = "HostAudioOut";
+	const int WAV_HEADER_SIZE = 44;
+	const uint16_t WAV_FORMAT_PCM = 1;
+	const uint16_t WAV_FORMAT_FLOAT = 3;
+	const uint16_t WAV_FORMAT_EXTENSIBLE = 0xfffe;
+	const int QUEUED_BUFFER_COUNT_MAX = 32; // like the device, appending more fails
+
+	struct HostAudioFormat
+	{
+		int sampleRate;
+		int channelCount;
+		SampleFormat sampleFormat;
+	};
+
+	struct QueuedBuffer
+	{
+		void* owner; // the AudioInBuffer or AudioOutBuffer
+		void* data;
+		size_t dataSize;
+	};
+
+	// Fixed ring of buffers, so appending and releasing never allocates
+	struct BufferQueue
+	{
+		QueuedBuffer buffers[QUEUED_BUFFER_COUNT_MAX];
+		int head;
+		int count;
+	};
+
+	// One opened device: a thread plays the part of the hardware, taking the appended buffers one by one
+	// at the pace of the device clock and releasing them once they are filled (AudioIn) or consumed (AudioOut).
+	struct HostAudioDevice
+	{
+		bool isOutput;
+		const char* name;
+		HostAudioFormat format;
+		size_t frameByteSize;
+		os::SystemEventType* bufferEvent;
+		float volume;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		BufferQueue appendedBuffers;
+		BufferQueue releasedBuffers;
+		bool isStarted;
+		bool isClosing;
+		std::thread thread;
+
+		FILE* file; // nullptr: samples or null device
+		std::vector<unsigned char> samples; // source of the AudioIn without a file
+		long dataOffset; // of the samples in the WAV file
+		long dataByteCount;
+		long readPosition; // in the samples of the WAV file
+	};
+
+	std::string audioInSourcePath;
+	std::vector<unsigned char> audioInSourceSamples;
+	HostAudioFormat audioInFormat = { DEFAULT_SAMPLE_RATE, 1, SampleFormat_PcmInt16 };
+	std::string audioOutSinkPath;
+	HostAudioFormat audioOutFormat = { DEFAULT_SAMPLE_RATE, 2, SampleFormat_PcmInt16 };
+	std::atomic<float> deviceSpeed(1.0f);
+	std::atomic<int64_t> audioInNanoSeconds;
+	std::atomic<int64_t> audioOutNanoSeconds;
+
+	uint32_t ReadLittleEndian(const unsigned char* data, int size)
+	{
+		uint32_t value = 0;
+		for (int i = size - 1; i >= 0; i--)
+		{
+			value = (value << 8) | data[i];
+		}
+		return value;
+	}
+
+	void WriteLittleEndian(unsigned char* data, uint32_t value, int size)
+	{
+		for (int i = 0; i < size; i++)
+		{
+			data[i] = static_cast<unsigned char>(value >> (8 * i));
+		}
+	}
+
+	// Finds the format and the samples of a WAV file, the file is left at the first sample
+	bool ReadWavHeader(FILE* file, HostAudioFormat* format, long* dataOffset, long* dataByteCount)
+	{
+		unsigned char riff[12];
+		if (fread(riff, 1, sizeof(riff), file) != sizeof(riff) || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) return false;
+
+		bool hasFormat = false;
+		unsigned char chunk[8];
+		while (fread(chunk, 1, sizeof(chunk), file) == sizeof(chunk))
+		{
+			uint32_t chunkSize = ReadLittleEndian(chunk + 4, 4);
+			if (memcmp(chunk, "fmt ", 4) == 0)
+			{
+				unsigned char fields[40] = { 0 };
+				size_t fieldSize = chunkSize < sizeof(fields) ? chunkSize : sizeof(fields);
+				if (chunkSize < 16 || fread(fields, 1, fieldSize, file) != fieldSize) return false;
+				fseek(file, static_cast<long>(chunkSize - fieldSize + (chunkSize & 1)), SEEK_CUR);
+
+				uint16_t tag = static_cast<uint16_t>(ReadLittleEndian(fields, 2));
+				if (tag == WAV_FORMAT_EXTENSIBLE && chunkSize >= 26) tag = static_cast<uint16_t>(ReadLittleEndian(fields + 24, 2));
+				int bitCount = ReadLittleEndian(fields + 14, 2);
+				format->channelCount = ReadLittleEndian(fields + 2, 2);
+				format->sampleRate = ReadLittleEndian(fields + 4, 4);
+				if (tag == WAV_FORMAT_FLOAT && bitCount == 32) format->sampleFormat = SampleFormat_PcmFloat;
+				else if (tag == WAV_FORMAT_PCM && bitCount == 8) format->sampleFormat = SampleFormat_PcmInt8;
+				else if (tag == WAV_FORMAT_PCM && bitCount == 16) format->sampleFormat = SampleFormat_PcmInt16;
+				else if (tag == WAV_FORMAT_PCM && bitCount == 24) format->sampleFormat = SampleFormat_PcmInt24;
+				else if (tag == WAV_FORMAT_PCM && bitCount == 32) format->sampleFormat = SampleFormat_PcmInt32;
+				else return false;
+				hasFormat = true;
+			}
+			else if (memcmp(chunk, "data", 4) == 0)
+			{
+				*dataOffset = ftell(file);
+				*dataByteCount = chunkSize;
+				return hasFormat && format->channelCount > 0;
+			}
+			else
+			{
+				fseek(file, static_cast<long>(chunkSize + (chunkSize & 1)), SEEK_CUR);
+			}
+		}
+		return false;
+	}
+
+	// The sizes stay 0 until FinishWavFile
+	void WriteWavHeader(FILE* file, const HostAudioFormat& format, long dataByteCount)
+	{
+		int sampleByteSize = static_cast<int>(GetSampleByteSize(format.sampleFormat));
+		unsigned char header[WAV_HEADER_SIZE];
+		memcpy(header, "RIFF", 4);
+		WriteLittleEndian(header + 4, static_cast<uint32_t>(WAV_HEADER_SIZE - 8 + dataByteCount), 4);
+		memcpy(header + 8, "WAVEfmt ", 8);
+		WriteLittleEndian(header + 16, 16, 4);
+		WriteLittleEndian(header + 20, format.sampleFormat == SampleFormat_PcmFloat ? WAV_FORMAT_FLOAT : WAV_FORMAT_PCM, 2);
+		WriteLittleEndian(header + 22, format.channelCount, 2);
+		WriteLittleEndian(header + 24, format.sampleRate, 4);
+		WriteLittleEndian(header + 28, format.sampleRate * format.channelCount * sampleByteSize, 4);
+		WriteLittleEndian(header + 32, format.channelCount * sampleByteSize, 2);
+		WriteLittleEndian(header + 34, sampleByteSize * 8, 2);
+		memcpy(header + 36, "data", 4);
+		WriteLittleEndian(header + 40, static_cast<uint32_t>(dataByteCount), 4);
+		fseek(file, 0, SEEK_SET);
+		fwrite(header, 1, sizeof(header), file);
+	}
+
+	// 8 bit WAV samples are unsigned, the device ones are signed
+	void FlipInt8Sign(void* data, size_t size)
+	{
+		unsigned char* bytes = reinterpret_cast<unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			bytes[i] ^= 0x80;
+		}
+	}
+
+	void ReadSamples(HostAudioDevice* device, void* data, size_t size)
+	{
+		if (!device->file && device->samples.empty())
+		{
+			memset(data, 0, size);
+			return;
+		}
+
+		// the file (or the samples) is played in a loop
+		unsigned char* out = reinterpret_cast<unsigned char*>(data);
+		size_t remaining = size;
+		while (remaining > 0)
+		{
+			long available = device->dataByteCount - device->readPosition;
+			if (available <= 0)
+			{
+				if (device->dataByteCount == 0)
+				{
+					memset(out, 0, remaining);
+					break;
+				}
+				if (device->file) fseek(device->file, device->dataOffset, SEEK_SET);
+				device->readPosition = 0;
+				continue;
+			}
+			size_t count = remaining < static_cast<size_t>(available) ? remaining : available;
+			if (device->file) count = fread(out, 1, count, device->file);
+			else memcpy(out, device->samples.data() + device->readPosition, count);
+			if (count == 0)
+			{
+				// the file is shorter than its data chunk says
+				device->dataByteCount = device->readPosition;
+				continue;
+			}
+			out += count;
+			remaining -= count;
+			device->readPosition += static_cast<long>(count);
+		}
+		if (device->file && device->format.sampleFormat == SampleFormat_PcmInt8) FlipInt8Sign(data, size);
+	}
+
+	void WriteSamples(HostAudioDevice* device, void* data, size_t size)
+	{
+		if (!device->file) return;
+		if (device->format.sampleFormat == SampleFormat_PcmInt8) FlipInt8Sign(data, size);
+		fwrite(data, 1, size, device->file);
+		if (device->format.sampleFormat == SampleFormat_PcmInt8) FlipInt8Sign(data, size);
+		device->dataByteCount += static_cast<long>(size);
+	}
+
+	bool PushBuffer(BufferQueue* queue, const QueuedBuffer& buffer)
+	{
+		if (queue->count == QUEUED_BUFFER_COUNT_MAX) return false;
+		queue->buffers[(queue->head + queue->count) % QUEUED_BUFFER_COUNT_MAX] = buffer;
+		queue->count++;
+		return true;
+	}
+
+	void PopBuffer(BufferQueue* queue)
+	{
+		queue->head = (queue->head + 1) % QUEUED_BUFFER_COUNT_MAX;
+		queue->count--;
+	}
+
+	void DeviceThreadFunction(HostAudioDevice* device)
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now();
+		std::unique_lock<std::mutex> lock(device->mutex);
+		while (true)
+		{
+			device->condition.wait(lock, [device] { return device->isClosing || (device->isStarted && device->appendedBuffers.count > 0); });
+			if (device->isClosing) break;
+
+			QueuedBuffer buffer = device->appendedBuffers.buffers[device->appendedBuffers.head];
+			size_t frameCount = buffer.dataSize / device->frameByteSize;
+			int64_t duration = static_cast<int64_t>(frameCount * 1000000000ull / device->format.sampleRate);
+			float speed = deviceSpeed.load(std::memory_order_relaxed);
+			lock.unlock();
+
+			// a buffer is released at the end of its period; after a starvation the clock restarts from now
+			if (speed > 0)
+			{
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				if (deadline < now) deadline = now;
+				deadline += std::chrono::nanoseconds(static_cast<int64_t>(duration / speed));
+				std::this_thread::sleep_until(deadline);
+			}
+			if (device->isOutput)
+			{
+				WriteSamples(device, buffer.data, buffer.dataSize);
+				audioOutNanoSeconds.fetch_add(duration, std::memory_order_relaxed);
+			}
+			else
+			{
+				ReadSamples(device, buffer.data, buffer.dataSize);
+				audioInNanoSeconds.fetch_add(duration, std::memory_order_relaxed);
+			}
+
+			lock.lock();
+			// StopAudio* may have revoked the buffer meanwhile
+			if (device->appendedBuffers.count > 0 && device->appendedBuffers.buffers[device->appendedBuffers.head].owner == buffer.owner)
+			{
+				PopBuffer(&device->appendedBuffers);
+				PushBuffer(&device->releasedBuffers, buffer);
+				if (device->bufferEvent) os::SignalSystemEvent(device->bufferEvent);
+			}
+		}
+	}
+
+	// Only the configured format is supported, like a real device: 0 in the parameter takes it
+	Result OpenDevice(HostAudioDevice** outDevice, os::SystemEvent* bufferEvent, bool isOutput, const char* name, int sampleRate, int channelCount)
+	{
+		HostAudioFormat format = isOutput ? audioOutFormat : audioInFormat;
+		const std::string& path = isOutput ? audioOutSinkPath : audioInSourcePath;
+		FILE* file = nullptr;
+		long dataOffset = WAV_HEADER_SIZE;
+		long dataByteCount = 0;
+		if (!path.empty())
+		{
+			file = fopen(path.c_str(), isOutput ? "wb" : "rb");
+			if (!file) return Result(1);
+			if (!isOutput && !ReadWavHeader(file, &format, &dataOffset, &dataByteCount))
+			{
+				fclose(file);
+				return Result(1);
+			}
+		}
+		if ((sampleRate != 0 && sampleRate != format.sampleRate) || (channelCount != 0 && channelCount != format.channelCount))
+		{
+			if (file) fclose(file);
+			return Result(1);
+		}
+		if (file && isOutput) WriteWavHeader(file, format, 0);
+
+		HostAudioDevice* device = new HostAudioDevice();
+		device->isOutput = isOutput;
+		device->name = name;
+		device->format = format;
+		device->frameByteSize = GetSampleByteSize(format.sampleFormat) * format.channelCount;
+		device->bufferEvent = nullptr;
+		device->volume = 1.0f;
+		device->appendedBuffers.head = 0;
+		device->appendedBuffers.count = 0;
+		device->releasedBuffers.head = 0;
+		device->releasedBuffers.count = 0;
+		device->isStarted = false;
+		device->isClosing = false;
+		device->file = file;
+		device->dataOffset = dataOffset;
+		device->dataByteCount = isOutput ? 0 : dataByteCount;
+		device->readPosition = 0;
+		if (!isOutput && !file)
+		{
+			device->samples = audioInSourceSamples;
+			device->dataByteCount = static_cast<long>(device->samples.size());
+		}
+		if (bufferEvent)
+		{
+			os::CreateSystemEvent(bufferEvent->GetBase(), os::EventClearMode_AutoClear);
+			device->bufferEvent = bufferEvent->GetBase();
+		}
+		device->thread = std::thread(DeviceThreadFunction, device);
+		*outDevice = device;
+		return ResultSuccess();
+	}
+
+	void CloseDevice(HostAudioDevice* device)
+	{
+		{
+			std::lock_guard<std::mutex> lock(device->mutex);
+			device->isClosing = true;
+		}
+		device->condition.notify_all();
+		device->thread.join();
+		if (device->file)
+		{
+			if (device->isOutput) WriteWavHeader(device->file, device->format, device->dataByteCount);
+			fclose(device->file);
+		}
+		delete device;
+	}
+
+	void SetDeviceStarted(HostAudioDevice* device, bool isStarted)
+	{
+		{
+			std::lock_guard<std::mutex> lock(device->mutex);
+			device->isStarted = isStarted;
+			// stopping revokes the buffers that are not released yet
+			if (!isStarted) device->appendedBuffers.count = 0;
+		}
+		device->condition.notify_all();
+	}
+
+	bool AppendBuffer(HostAudioDevice* device, void* owner, void* data, size_t dataSize)
+	{
+		if (dataSize == 0 || dataSize % device->frameByteSize != 0) return false;
+		{
+			std::lock_guard<std::mutex> lock(device->mutex);
+			QueuedBuffer buffer = { owner, data, dataSize };
+			// a released buffer not taken back yet still counts
+			if (device->appendedBuffers.count + device->releasedBuffers.count == QUEUED_BUFFER_COUNT_MAX) return false;
+			PushBuffer(&device->appendedBuffers, buffer);
+		}
+		device->condition.notify_all();
+		return true;
+	}
+
+	void* GetReleasedBuffer(HostAudioDevice* device)
+	{
+		std::lock_guard<std::mutex> lock(device->mutex);
+		if (device->releasedBuffers.count == 0) return nullptr;
+		void* owner = device->releasedBuffers.buffers[device->releasedBuffers.head].owner;
+		PopBuffer(&device->releasedBuffers);
+		return owner;
+	}
+
+	size_t GetSampleByteSize(SampleFormat format)
+	{
+		switch (format)
+		{
+		case SampleFormat_PcmInt8: return 1;
+		case SampleFormat_PcmInt16: return 2;
+		case SampleFormat_PcmInt24: return 3;
+		case SampleFormat_PcmInt32: return 4;
+		case SampleFormat_PcmFloat: return 4;
+		default: return 0;
+		}
+	}
+
+	int ListAudioIns(AudioInInfo* outInfos, int count)
+	{
+		if (count > AUDIO_IN_NAME_COUNT) count = AUDIO_IN_NAME_COUNT;
+		for (int i = 0; i < count; i++)
+		{
+			strcpy(outInfos[i].name, AUDIO_IN_NAMES[i]);
+		}
+		return count < 0 ? 0 : count;
+	}
+
+	void InitializeAudioInParameter(AudioInParameter* parameter)
+	{
+		parameter->sampleRate = 0;
+		parameter->channelCount = 0;
+	}
+
+	Result OpenDefaultAudioIn(AudioIn* audioIn, const AudioInParameter& parameter)
+	{
+		return OpenDevice(&audioIn->device, nullptr, false, AUDIO_IN_NAMES[0], parameter.sampleRate, parameter.channelCount);
+	}
+
+	Result OpenDefaultAudioIn(AudioIn* audioIn, os::SystemEvent* bufferEvent, const AudioInParameter& parameter)
+	{
+		return OpenDevice(&audioIn->device, bufferEvent, false, AUDIO_IN_NAMES[0], parameter.sampleRate, parameter.channelCount);
+	}
+
+	Result OpenAudioIn(AudioIn* audioIn, const char* name, const AudioInParameter& parameter)
+	{
+		return OpenAudioIn(audioIn, nullptr, name, parameter);
+	}
+
+	Result OpenAudioIn(AudioIn* audioIn, os::SystemEvent* bufferEvent, const char* name, const AudioInParameter& parameter)
+	{
+		for (int i = 0; i < AUDIO_IN_NAME_COUNT; i++)
+		{
+			if (strcmp(name, AUDIO_IN_NAMES[i]) == 0) return OpenDevice(&audioIn->device, bufferEvent, false, AUDIO_IN_NAMES[i], parameter.sampleRate, parameter.channelCount);
+		}
+		return Result(1);
+	}
+
+	void CloseAudioIn(AudioIn* audioIn)
+	{
+		CloseDevice(audioIn->device);
+		audioIn->device = nullptr;
+	}
+
+	Result StartAudioIn(AudioIn* audioIn)
+	{
+		SetDeviceStarted(audioIn->device, true);
+		return ResultSuccess();
+	}
+
+	void StopAudioIn(AudioIn* audioIn)
+	{
+		SetDeviceStarted(audioIn->device, false);
+	}
+
+	AudioInState GetAudioInState(const AudioIn* audioIn)
+	{
+		std::lock_guard<std::mutex> lock(audioIn->device->mutex);
+		return audioIn->device->isStarted ? AudioInState_Started : AudioInState_Stopped;
+	}
+
+	const char* GetAudioInName(const AudioIn* audioIn)
+	{
+		return audioIn->device->name;
+	}
+
+	int GetAudioInChannelCount(const AudioIn* audioIn)
+	{
+		return audioIn->device->format.channelCount;
+	}
+
+	int GetAudioInSampleRate(const AudioIn* audioIn)
+	{
+		return audioIn->device->format.sampleRate;
+	}
+
+	SampleFormat GetAudioInSampleFormat(const AudioIn* audioIn)
+	{
+		return audioIn->device->format.sampleFormat;
+	}
+
+	void SetAudioInBufferInfo(AudioInBuffer* audioInBuffer, void* buffer, size_t bufferSize, size_t dataSize)
+	{
+		audioInBuffer->buffer = buffer;
+		audioInBuffer->bufferSize = bufferSize;
+		audioInBuffer->dataSize = dataSize;
+		audioInBuffer->next = nullptr;
+	}
+
+	bool AppendAudioInBuffer(AudioIn* audioIn, AudioInBuffer* audioInBuffer)
+	{
+		return AppendBuffer(audioIn->device, audioInBuffer, audioInBuffer->buffer, audioInBuffer->dataSize);
+	}
+
+	AudioInBuffer* GetReleasedAudioInBuffer(AudioIn* audioIn)
+	{
+		return reinterpret_cast<AudioInBuffer*>(GetReleasedBuffer(audioIn->device));
+	}
+
+	void* GetAudioInBufferDataPointer(const AudioInBuffer* audioInBuffer)
+	{
+		return audioInBuffer->buffer;
+	}
+
+	size_t GetAudioInBufferDataSize(const AudioInBuffer* audioInBuffer)
+	{
+		return audioInBuffer->dataSize;
+	}
+
+	int ListAudioOuts(AudioOutInfo* outInfos, int count)
+	{
+		if (count < 1) return 0;
+		strcpy(outInfos[0].name, AUDIO_OUT_NAME);
+		return 1;
+	}
+
+	void InitializeAudioOutParameter(AudioOutParameter* parameter)
+	{
+		parameter->sampleRate = 0;
+		parameter->channelCount = 0;
+	}
+
+	Result OpenDefaultAudioOut(AudioOut* audioOut, const AudioOutParameter& parameter)
+	{
+		return OpenDevice(&audioOut->device, nullptr, true, AUDIO_OUT_NAME, parameter.sampleRate, parameter.channelCount);
+	}
+
+	Result OpenDefaultAudioOut(AudioOut* audioOut, os::SystemEvent* bufferEvent, const AudioOutParameter& parameter)
+	{
+		return OpenDevice(&audioOut->device, bufferEvent, true, AUDIO_OUT_NAME, parameter.sampleRate, parameter.channelCount);
+	}
+
+	Result OpenAudioOut(AudioOut* audioOut, const char* name, const AudioOutParameter& parameter)
+	{
+		return OpenAudioOut(audioOut, nullptr, name, parameter);
+	}
+
+	Result OpenAudioOut(AudioOut* audioOut, os::SystemEvent* bufferEvent, const char* name, const AudioOutParameter& parameter)
+	{
+		if (strcmp(name, AUDIO_OUT_NAME) != 0) return Result(1);
+		return OpenDevice(&audioOut->device, bufferEvent, true, AUDIO_OUT_NAME, parameter.sampleRate, parameter.channelCount);
+	}
+
+	void CloseAudioOut(AudioOut* audioOut)
+	{
+		CloseDevice(audioOut->device);
+		audioOut->device = nullptr;
+	}
+
+	Result StartAudioOut(AudioOut* audioOut)
+	{
+		SetDeviceStarted(audioOut->device, true);
+		return ResultSuccess();
+	}
+
+	void StopAudioOut(AudioOut* audioOut)
+	{
+		SetDeviceStarted(audioOut->device, false);
+	}
+
+	AudioOutState GetAudioOutState(const AudioOut* audioOut)
+	{
+		std::lock_guard<std::mutex> lock(audioOut->device->mutex);
+		return audioOut->device->isStarted ? AudioOutState_Started : AudioOutState_Stopped;
+	}
+
+	const char* GetAudioOutName(const AudioOut* audioOut)
+	{
+		NN_UNUSED(audioOut);
+		return AUDIO_OUT_NAME;
+	}
+
+	int GetAudioOutChannelCount(const AudioOut* audioOut)
+	{
+		return audioOut->device->format.channelCount;
+	}
+
+	int GetAudioOutSampleRate(const AudioOut* audioOut)
+	{
+		return audioOut->device->format.sampleRate;
+	}
+
+	SampleFormat GetAudioOutSampleFormat(const AudioOut* audioOut)
+	{
+		return audioOut->device->format.sampleFormat;
+	}
+
+	// The volume is kept but not applied, the WAV file gets the samples as they were appended
+	float GetAudioOutVolume(const AudioOut* audioOut)
+	{
+		return audioOut->device->volume;
+	}
+
+	void SetAudioOutVolume(AudioOut* audioOut, float volume)
+	{
+		audioOut->device->volume = volume;
+	}
+
+	void SetAudioOutBufferInfo(AudioOutBuffer* audioOutBuffer, void* buffer, size_t bufferSize, size_t dataSize)
+	{
+		audioOutBuffer->buffer = buffer;
+		audioOutBuffer->bufferSize = bufferSize;
+		audioOutBuffer->dataSize = dataSize;
+		audioOutBuffer->next = nullptr;
+	}
+
+	bool AppendAudioOutBuffer(AudioOut* audioOut, AudioOutBuffer* audioOutBuffer)
+	{
+		return AppendBuffer(audioOut->device, audioOutBuffer, audioOutBuffer->buffer, audioOutBuffer->dataSize);
+	}
+
+	AudioOutBuffer* GetReleasedAudioOutBuffer(AudioOut* audioOut)
+	{
+		return reinterpret_cast<AudioOutBuffer*>(GetReleasedBuffer(audioOut->device));
+	}
+
+	void* GetAudioOutBufferDataPointer(const AudioOutBuffer* audioOutBuffer)
+	{
+		return audioOutBuffer->buffer;
+	}
+
+	size_t GetAudioOutBufferDataSize(const AudioOutBuffer* audioOutBuffer)
+	{
+		return audioOutBuffer->dataSize;
+	}
+}}
+
+namespace HostAudioDevice {
+	using namespace nn::audio;
+
+	bool SetAudioInSource(const char* path)
+	{
+		audioInSourceSamples.clear();
+		if (!path)
+		{
+			audioInSourcePath.clear();
+			return true;
+		}
+		FILE* file = fopen(path, "rb");
+		if (!file) return false;
+		HostAudioFormat format;
+		long dataOffset;
+		long dataByteCount;
+		bool result = ReadWavHeader(file, &format, &dataOffset, &dataByteCount);
+		fclose(file);
+		if (result) audioInSourcePath = path;
+		return result;
+	}
+
+	void SetAudioInFormat(int sampleRate, int channelCount, SampleFormat sampleFormat)
+	{
+		HostAudioFormat format = { sampleRate, channelCount, sampleFormat };
+		audioInFormat = format;
+	}
+
+	void SetAudioInSamples(const void* samples, size_t frameCount, int sampleRate, int channelCount, SampleFormat sampleFormat)
+	{
+		audioInSourcePath.clear();
+		audioInSourceSamples.clear();
+		if (!samples) return;
+		SetAudioInFormat(sampleRate, channelCount, sampleFormat);
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(samples);
+		audioInSourceSamples.assign(bytes, bytes + frameCount * channelCount * GetSampleByteSize(sampleFormat));
+	}
+
+	void SetAudioOutSink(const char* path)
+	{
+		if (path) audioOutSinkPath = path;
+		else audioOutSinkPath.clear();
+	}
+
+	void SetAudioOutFormat(int sampleRate, int channelCount, SampleFormat sampleFormat)
+	{
+		HostAudioFormat format = { sampleRate, channelCount, sampleFormat };
+		audioOutFormat = format;
+	}
+
+	void SetDeviceSpeed(float speed)
+	{
+		deviceSpeed.store(speed, std::memory_order_relaxed);
+	}
+
+	nn::TimeSpan GetAudioInDuration()
+	{
+		return nn::TimeSpan::FromNanoSeconds(audioInNanoSeconds.load(std::memory_order_relaxed));
+	}
+
+	nn::TimeSpan GetAudioOutDuration()
+	{
+		return nn::TimeSpan::FromNanoSeconds(audioOutNanoSeconds.load(std::memory_order_relaxed));
+	}
+}
@@ -0,0 +1,141 @@
+#include <nn/codec.h>
+#include <opus.h>
+
+namespace nn { namespace codec {
+	::OpusEncoder* GetEncoderState(void* encoder)
+	{
+		return reinterpret_cast<::OpusEncoder*>(encoder);
+	}
+
+	::OpusDecoder* GetDecoderState(void* decoder)
+	{
+		return reinterpret_cast<::OpusDecoder*>(decoder);
+	}
+
+	void WriteBigEndian(unsigned char* data, uint32_t value)
+	{
+		data[0] = static_cast<unsigned char>(value >> 24);
+		data[1] = static_cast<unsigned char>(value >> 16);
+		data[2] = static_cast<unsigned char>(value >> 8);
+		data[3] = static_cast<unsigned char>(value);
+	}
+
+	uint32_t ReadBigEndian(const unsigned char* data)
+	{
+		return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+	}
+
+	bool IsValidSampleRate(int sampleRate)
+	{
+		return sampleRate == 8000 || sampleRate == 12000 || sampleRate == 16000 || sampleRate == 24000 || sampleRate == 48000;
+	}
+
+	size_t OpusEncoder::GetWorkBufferSize(int sampleRate, int channelCount) const
+	{
+		NN_UNUSED(sampleRate);
+		return opus_encoder_get_size(channelCount);
+	}
+
+	// The state lives in the work buffer, libopus does not allocate
+	OpusResult OpusEncoder::Initialize(int sampleRate, int channelCount, void* workBuffer, size_t workBufferSize)
+	{
+		if (!IsValidSampleRate(sampleRate)) return OpusResult_InvalidSampleRate;
+		if (channelCount != 1 && channelCount != 2) return OpusResult_InvalidChannelCount;
+		if (!workBuffer || workBufferSize < static_cast<size_t>(opus_encoder_get_size(channelCount))) return OpusResult_InvalidWorkBuffer;
+
+		::OpusEncoder* encoder = reinterpret_cast<::OpusEncoder*>(workBuffer);
+		if (opus_encoder_init(encoder, sampleRate, channelCount, OPUS_APPLICATION_VOIP) != OPUS_OK) return OpusResult_InternalError;
+		m_Encoder = encoder;
+		m_SampleRate = sampleRate;
+		m_ChannelCount = channelCount;
+		return OpusResult_Success;
+	}
+
+	void OpusEncoder::Finalize()
+	{
+		m_Encoder = nullptr;
+	}
+
+	void OpusEncoder::SetBitRate(int bitRate)
+	{
+		opus_encoder_ctl(GetEncoderState(m_Encoder), OPUS_SET_BITRATE(bitRate));
+	}
+
+	int OpusEncoder::GetBitRate() const
+	{
+		opus_int32 bitRate = 0;
+		opus_encoder_ctl(GetEncoderState(m_Encoder), OPUS_GET_BITRATE(&bitRate));
+		return bitRate;
+	}
+
+	void OpusEncoder::BindCodingMode(OpusCodingMode codingMode)
+	{
+		opus_int32 signal = codingMode == OpusCodingMode_Celt ? OPUS_SIGNAL_MUSIC : codingMode == OpusCodingMode_Silk ? OPUS_SIGNAL_VOICE : OPUS_AUTO;
+		opus_encoder_ctl(GetEncoderState(m_Encoder), OPUS_SET_SIGNAL(signal));
+	}
+
+	int OpusEncoder::CalculateFrameSampleCount(int frameDurationMicroSeconds) const
+	{
+		return static_cast<int>(static_cast<int64_t>(m_SampleRate) * frameDurationMicroSeconds / 1000000);
+	}
+
+	OpusResult OpusEncoder::EncodeInterleaved(size_t* outputSize, void* outputBuffer, size_t outputBufferSize, const int16_t* inputBuffer, int inputSampleCount)
+	{
+		if (outputBufferSize <= static_cast<size_t>(OpusPacketHeaderSize)) return OpusResult_InsufficientOpusBuffer;
+		unsigned char* packet = reinterpret_cast<unsigned char*>(outputBuffer);
+		opus_int32 size = opus_encode(GetEncoderState(m_Encoder), inputBuffer, inputSampleCount,
+			packet + OpusPacketHeaderSize, static_cast<opus_int32>(outputBufferSize - OpusPacketHeaderSize));
+		if (size == OPUS_BAD_ARG) return OpusResult_UnsupportedFrameSize;
+		if (size == OPUS_BUFFER_TOO_SMALL) return OpusResult_InsufficientOpusBuffer;
+		if (size < 0) return OpusResult_InternalError;
+
+		opus_uint32 finalRange = 0;
+		opus_encoder_ctl(GetEncoderState(m_Encoder), OPUS_GET_FINAL_RANGE(&finalRange));
+		WriteBigEndian(packet, static_cast<uint32_t>(size));
+		WriteBigEndian(packet + 4, finalRange);
+		*outputSize = OpusPacketHeaderSize + size;
+		return OpusResult_Success;
+	}
+
+	size_t OpusDecoder::GetWorkBufferSize(int sampleRate, int channelCount) const
+	{
+		NN_UNUSED(sampleRate);
+		return opus_decoder_get_size(channelCount);
+	}
+
+	OpusResult OpusDecoder::Initialize(int sampleRate, int channelCount, void* workBuffer, size_t workBufferSize)
+	{
+		if (!IsValidSampleRate(sampleRate)) return OpusResult_InvalidSampleRate;
+		if (channelCount != 1 && channelCount != 2) return OpusResult_InvalidChannelCount;
+		if (!workBuffer || workBufferSize < static_cast<size_t>(opus_decoder_get_size(channelCount))) return OpusResult_InvalidWorkBuffer;
+
+		::OpusDecoder* decoder = reinterpret_cast<::OpusDecoder*>(workBuffer);
+		if (opus_decoder_init(decoder, sampleRate, channelCount) != OPUS_OK) return OpusResult_InternalError;
+		m_Decoder = decoder;
+		m_SampleRate = sampleRate;
+		m_ChannelCount = channelCount;
+		return OpusResult_Success;
+	}
+
+	void OpusDecoder::Finalize()
+	{
+		m_Decoder = nullptr;
+	}
+
+	OpusResult OpusDecoder::DecodeInterleaved(size_t* consumed, int* outputSampleCount, int16_t* outputBuffer, size_t outputSize, const void* inputBuffer, size_t inputSize)
+	{
+		const unsigned char* packet = reinterpret_cast<const unsigned char*>(inputBuffer);
+		if (inputSize < static_cast<size_t>(OpusPacketHeaderSize)) return OpusResult_InvalidPacket;
+		uint32_t size = ReadBigEndian(packet);
+		if (size > inputSize - OpusPacketHeaderSize) return OpusResult_InvalidPacket;
+
+		int capacity = static_cast<int>(outputSize / (sizeof(int16_t) * m_ChannelCount));
+		int sampleCount = opus_decode(GetDecoderState(m_Decoder), packet + OpusPacketHeaderSize, static_cast<opus_int32>(size), outputBuffer, capacity, 0);
+		if (sampleCount == OPUS_BUFFER_TOO_SMALL) return OpusResult_InsufficientPcmBuffer;
+		if (sampleCount == OPUS_INVALID_PACKET || sampleCount == OPUS_BAD_ARG) return OpusResult_InvalidPacket;
+		if (sampleCount < 0) return OpusResult_InternalError;
+		*consumed = OpusPacketHeaderSize + size;
+		*outputSampleCount = sampleCount;
+		return OpusResult_Success;
+	}
+}}
@@ -0,0 +1,11 @@
+#include <nn/os.h>
+
+extern "C" void nnMain();
+
+// Entry point of the host programs: the samples and tools only define nnMain
+int main(int argc, char** argv)
+{
+	nn::os::SetHostArgument(argc, argv);
+	nnMain();
+	return 0;
+}
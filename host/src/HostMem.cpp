@@ -0,0 +1,138 @@
+#include <nn/mem.h>
+#include <mutex>
+
+namespace nn { namespace mem {
+	// Every block (used or free) starts with a header, the blocks follow each other in address order
+	struct HostBlock
+	{
+		size_t size; // with the header
+		bool used;
+		HostBlock* next;
+	};
+
+	struct HostAllocatorState
+	{
+		std::mutex mutex;
+		HostBlock* first;
+	};
+
+	const size_t BLOCK_HEADER_SIZE = (sizeof(HostBlock) + StandardAllocator::DefaultAlignment - 1) / StandardAllocator::DefaultAlignment * StandardAllocator::DefaultAlignment;
+	const size_t BLOCK_SIZE_MIN = BLOCK_HEADER_SIZE + StandardAllocator::DefaultAlignment;
+
+	uintptr_t AlignUp(uintptr_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	void StandardAllocator::Initialize(void* address, size_t size)
+	{
+		Finalize();
+		uintptr_t start = AlignUp(reinterpret_cast<uintptr_t>(address), DefaultAlignment);
+		uintptr_t end = reinterpret_cast<uintptr_t>(address) + size;
+		m_State = new HostAllocatorState();
+		m_State->first = nullptr;
+		if (end < start + BLOCK_SIZE_MIN) return;
+
+		m_State->first = reinterpret_cast<HostBlock*>(start);
+		m_State->first->size = (end - start) / DefaultAlignment * DefaultAlignment;
+		m_State->first->used = false;
+		m_State->first->next = nullptr;
+	}
+
+	void StandardAllocator::Finalize()
+	{
+		delete m_State;
+		m_State = nullptr;
+	}
+
+	void* StandardAllocator::Allocate(size_t size, size_t alignment)
+	{
+		if (!m_State) return nullptr;
+		if (alignment < DefaultAlignment) alignment = DefaultAlignment;
+		size = AlignUp(size == 0 ? 1 : size, DefaultAlignment);
+
+		std::lock_guard<std::mutex> lock(m_State->mutex);
+		for (HostBlock* block = m_State->first; block; block = block->next)
+		{
+			if (block->used) continue;
+			uintptr_t start = reinterpret_cast<uintptr_t>(block);
+			uintptr_t data = AlignUp(start + BLOCK_HEADER_SIZE, alignment);
+			// the space skipped for the alignment becomes a free block of its own
+			while (data - BLOCK_HEADER_SIZE != start && data - BLOCK_HEADER_SIZE < start + BLOCK_SIZE_MIN) data += alignment;
+			if (data + size > start + block->size) continue;
+
+			if (data - BLOCK_HEADER_SIZE != start)
+			{
+				HostBlock* aligned = reinterpret_cast<HostBlock*>(data - BLOCK_HEADER_SIZE);
+				aligned->size = start + block->size - (data - BLOCK_HEADER_SIZE);
+				aligned->used = false;
+				aligned->next = block->next;
+				block->size -= aligned->size;
+				block->next = aligned;
+				block = aligned;
+			}
+			if (block->size >= BLOCK_HEADER_SIZE + size + BLOCK_SIZE_MIN)
+			{
+				HostBlock* rest = reinterpret_cast<HostBlock*>(data + size);
+				rest->size = block->size - BLOCK_HEADER_SIZE - size;
+				rest->used = false;
+				rest->next = block->next;
+				block->size = BLOCK_HEADER_SIZE + size;
+				block->next = rest;
+			}
+			block->used = true;
+			return reinterpret_cast<void*>(data);
+		}
+		return nullptr;
+	}
+
+	void StandardAllocator::Free(void* address)
+	{
+		if (!address || !m_State) return;
+		std::lock_guard<std::mutex> lock(m_State->mutex);
+		HostBlock* previous = nullptr;
+		HostBlock* block = m_State->first;
+		while (block && reinterpret_cast<uintptr_t>(block) + BLOCK_HEADER_SIZE != reinterpret_cast<uintptr_t>(address))
+		{
+			previous = block;
+			block = block->next;
+		}
+		NN_ABORT_UNLESS(block && block->used, "StandardAllocator::Free of an unknown address %p\n", address);
+
+		block->used = false;
+		if (block->next && !block->next->used)
+		{
+			block->size += block->next->size;
+			block->next = block->next->next;
+		}
+		if (previous && !previous->used)
+		{
+			previous->size += block->size;
+			previous->next = block->next;
+		}
+	}
+
+	size_t StandardAllocator::GetTotalFreeSize() const
+	{
+		if (!m_State) return 0;
+		std::lock_guard<std::mutex> lock(m_State->mutex);
+		size_t size = 0;
+		for (HostBlock* block = m_State->first; block; block = block->next)
+		{
+			if (!block->used) size += block->size - BLOCK_HEADER_SIZE;
+		}
+		return size;
+	}
+
+	size_t StandardAllocator::GetAllocatableSize() const
+	{
+		if (!m_State) return 0;
+		std::lock_guard<std::mutex> lock(m_State->mutex);
+		size_t size = 0;
+		for (HostBlock* block = m_State->first; block; block = block->next)
+		{
+			if (!block->used && block->size - BLOCK_HEADER_SIZE > size) size = block->size - BLOCK_HEADER_SIZE;
+		}
+		return size;
+	}
+}}
@@ -0,0 +1,238 @@
+#include <nn/os.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sched.h>
+
+namespace nn { namespace os {
+	struct HostEvent
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool signaled;
+		EventClearMode clearMode;
+	};
+
+	struct HostMutex
+	{
+		std::recursive_mutex mutex;
+	};
+
+	struct HostThread
+	{
+		std::thread thread;
+		ThreadFunction function;
+		void* argument;
+		std::string name;
+	};
+
+	int hostArgc;
+	char** hostArgv;
+
+	HostEvent* CreateHostEvent(bool signaled, EventClearMode clearMode)
+	{
+		HostEvent* event = new HostEvent();
+		event->signaled = signaled;
+		event->clearMode = clearMode;
+		return event;
+	}
+
+	void WaitHostEvent(HostEvent* event)
+	{
+		std::unique_lock<std::mutex> lock(event->mutex);
+		event->condition.wait(lock, [event] { return event->signaled; });
+		if (event->clearMode == EventClearMode_AutoClear) event->signaled = false;
+	}
+
+	bool TimedWaitHostEvent(HostEvent* event, TimeSpan timeout)
+	{
+		std::unique_lock<std::mutex> lock(event->mutex);
+		if (!event->condition.wait_for(lock, std::chrono::nanoseconds(timeout.GetNanoSeconds()), [event] { return event->signaled; })) return false;
+		if (event->clearMode == EventClearMode_AutoClear) event->signaled = false;
+		return true;
+	}
+
+	void SignalHostEvent(HostEvent* event)
+	{
+		std::lock_guard<std::mutex> lock(event->mutex);
+		event->signaled = true;
+		if (event->clearMode == EventClearMode_AutoClear) event->condition.notify_one();
+		else event->condition.notify_all();
+	}
+
+	void ClearHostEvent(HostEvent* event)
+	{
+		std::lock_guard<std::mutex> lock(event->mutex);
+		event->signaled = false;
+	}
+
+	void InitializeEvent(EventType* event, bool signaled, EventClearMode clearMode)
+	{
+		event->event = CreateHostEvent(signaled, clearMode);
+	}
+
+	void FinalizeEvent(EventType* event)
+	{
+		delete event->event;
+		event->event = nullptr;
+	}
+
+	void WaitEvent(EventType* event)
+	{
+		WaitHostEvent(event->event);
+	}
+
+	bool TimedWaitEvent(EventType* event, TimeSpan timeout)
+	{
+		return TimedWaitHostEvent(event->event, timeout);
+	}
+
+	void SignalEvent(EventType* event)
+	{
+		SignalHostEvent(event->event);
+	}
+
+	void ClearEvent(EventType* event)
+	{
+		ClearHostEvent(event->event);
+	}
+
+	void CreateSystemEvent(SystemEventType* event, EventClearMode clearMode)
+	{
+		event->event = CreateHostEvent(false, clearMode);
+	}
+
+	void DestroySystemEvent(SystemEventType* event)
+	{
+		delete event->event;
+		event->event = nullptr;
+	}
+
+	void WaitSystemEvent(SystemEventType* event)
+	{
+		WaitHostEvent(event->event);
+	}
+
+	bool TimedWaitSystemEvent(SystemEventType* event, TimeSpan timeout)
+	{
+		return TimedWaitHostEvent(event->event, timeout);
+	}
+
+	void SignalSystemEvent(SystemEventType* event)
+	{
+		SignalHostEvent(event->event);
+	}
+
+	void ClearSystemEvent(SystemEventType* event)
+	{
+		ClearHostEvent(event->event);
+	}
+
+	// Always recursive: a non recursive mutex locked twice is a bug the device build would catch
+	void InitializeMutex(MutexType* mutex, bool recursive, int lockLevel)
+	{
+		NN_UNUSED(recursive);
+		NN_UNUSED(lockLevel);
+		mutex->mutex = new HostMutex();
+	}
+
+	void FinalizeMutex(MutexType* mutex)
+	{
+		delete mutex->mutex;
+		mutex->mutex = nullptr;
+	}
+
+	void LockMutex(MutexType* mutex)
+	{
+		mutex->mutex->mutex.lock();
+	}
+
+	bool TryLockMutex(MutexType* mutex)
+	{
+		return mutex->mutex->mutex.try_lock();
+	}
+
+	void UnlockMutex(MutexType* mutex)
+	{
+		mutex->mutex->mutex.unlock();
+	}
+
+	Result CreateThread(ThreadType* thread, ThreadFunction function, void* argument, void* stack, size_t stackSize, int priority)
+	{
+		return CreateThread(thread, function, argument, stack, stackSize, priority, 0);
+	}
+
+	Result CreateThread(ThreadType* thread, ThreadFunction function, void* argument, void* stack, size_t stackSize, int priority, int idealCore)
+	{
+		NN_UNUSED(stack);
+		NN_UNUSED(stackSize);
+		NN_UNUSED(priority);
+		NN_UNUSED(idealCore);
+		thread->thread = new HostThread();
+		thread->thread->function = function;
+		thread->thread->argument = argument;
+		return ResultSuccess();
+	}
+
+	void StartThread(ThreadType* thread)
+	{
+		HostThread* hostThread = thread->thread;
+		hostThread->thread = std::thread([hostThread] { hostThread->function(hostThread->argument); });
+	}
+
+	void WaitThread(ThreadType* thread)
+	{
+		if (thread->thread->thread.joinable()) thread->thread->thread.join();
+	}
+
+	void DestroyThread(ThreadType* thread)
+	{
+		WaitThread(thread);
+		delete thread->thread;
+		thread->thread = nullptr;
+	}
+
+	void SetThreadName(ThreadType* thread, const char* name)
+	{
+		thread->thread->name = name;
+	}
+
+	void SleepThread(TimeSpan time)
+	{
+		std::this_thread::sleep_for(std::chrono::nanoseconds(time.GetNanoSeconds()));
+	}
+
+	int GetCurrentCoreNumber()
+	{
+		int core = sched_getcpu();
+		return core < 0 ? 0 : core;
+	}
+
+	Tick GetSystemTick()
+	{
+		return Tick(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	int64_t GetSystemTickFrequency()
+	{
+		return 1000 * 1000 * 1000;
+	}
+
+	void SetHostArgument(int argc, char** argv)
+	{
+		hostArgc = argc;
+		hostArgv = argv;
+	}
+
+	int GetHostArgc()
+	{
+		return hostArgc;
+	}
+
+	char** GetHostArgv()
+	{
+		return hostArgv;
+	}
+}}